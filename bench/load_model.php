@@ -0,0 +1,56 @@
+<?php
+/*
+ * Time loading a model saved as text against the same model saved with saveBinary() and restored by
+ * unserialize().
+ *
+ * Usage: php bench/load_model.php [data file] [repetitions]
+ */
+$file = isset($argv[1]) ? $argv[1] : dirname(__FILE__) . '/../tests/abalone.scale';
+$reps = isset($argv[2]) ? (int)$argv[2] : 20;
+
+$rows = array();
+foreach (file($file) as $line) {
+	$parts = preg_split('/\s+/', trim($line));
+	array_shift($parts);
+	$row = array();
+	foreach ($parts as $pair) {
+		list($idx, $value) = explode(':', $pair);
+		$row[(int)$idx] = (float)$value;
+	}
+	$rows[] = $row;
+}
+
+$svm = new SVM();
+$model = $svm->train($file);
+
+$text = tempnam(sys_get_temp_dir(), 'svm');
+$binary = tempnam(sys_get_temp_dir(), 'svm');
+$model->save($text);
+$model->saveBinary($binary);
+
+$start = microtime(true);
+for ($r = 0; $r < $reps; $r++) {
+	$fromText = new SVMModel($text);
+}
+$textTime = (microtime(true) - $start) / $reps;
+
+$start = microtime(true);
+for ($r = 0; $r < $reps; $r++) {
+	$fromBinary = new SVMModel($binary);
+}
+$binaryTime = (microtime(true) - $start) / $reps;
+
+$serialized = serialize($model);
+$start = microtime(true);
+for ($r = 0; $r < $reps; $r++) {
+	$fromSerialized = unserialize($serialized);
+}
+$serializedTime = (microtime(true) - $start) / $reps;
+
+printf("text: %d bytes, %.5fs\n", filesize($text), $textTime);
+printf("binary: %d bytes, %.5fs (%.2fx)\n", filesize($binary), $binaryTime, $textTime / $binaryTime);
+printf("unserialize: %d bytes, %.5fs (%.2fx)\n", strlen($serialized), $serializedTime, $textTime / $serializedTime);
+printf("identical: %s\n", $fromText->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b && $fromBinary->predictValuesBatch($rows, $c) === $fromText->predictValuesBatch($rows, $d) && $c === $d && $fromSerialized->predictValuesBatch($rows, $e) === $fromText->predictValuesBatch($rows, $f) && $e === $f ? "yes" : "no");
+
+unlink($text);
+unlink($binary);
@@ -0,0 +1,43 @@
+<?php
+/*
+ * Compare SVMModel::predictBatch() against calling SVMModel::predict() once per row.
+ *
+ * Usage: php bench/predict_batch.php [data file] [repetitions]
+ */
+$file = isset($argv[1]) ? $argv[1] : dirname(__FILE__) . '/../tests/abalone.scale';
+$reps = isset($argv[2]) ? (int)$argv[2] : 3;
+
+$rows = array();
+foreach (file($file) as $line) {
+	$parts = preg_split('/\s+/', trim($line));
+	array_shift($parts);
+	$row = array();
+	foreach ($parts as $pair) {
+		list($idx, $value) = explode(':', $pair);
+		$row[(int)$idx] = (float)$value;
+	}
+	$rows[] = $row;
+}
+
+$svm = new SVM();
+$model = $svm->train($file);
+
+$start = microtime(true);
+for ($r = 0; $r < $reps; $r++) {
+	$single = array();
+	foreach ($rows as $row) {
+		$single[] = $model->predict($row);
+	}
+}
+$loop = (microtime(true) - $start) / $reps;
+
+$start = microtime(true);
+for ($r = 0; $r < $reps; $r++) {
+	$batch = $model->predictBatch($rows);
+}
+$blocked = (microtime(true) - $start) / $reps;
+
+printf("rows: %d\n", count($rows));
+printf("predict() loop: %.4fs\n", $loop);
+printf("predictBatch(): %.4fs (%.2fx)\n", $blocked, $loop / $blocked);
+printf("identical: %s\n", $single === $batch ? "yes" : "no");
@@ -50,8 +50,10 @@ dnl Get PHP version depending on shared/static build
 
     PHP_REQUIRE_CXX()
     PHP_ADD_LIBRARY(stdc++,,SVM_SHARED_LIBADD)
+    dnl the bundled libsvm trains on several threads
+    PHP_ADD_LIBRARY(pthread,,SVM_SHARED_LIBADD)
 
-    PHP_NEW_EXTENSION(svm, svm.c, $ext_shared,, -DZEND_ENABLE_STATIC_TSRMLS_CACHE=1, cxx)
+    PHP_NEW_EXTENSION(svm, svm.c svm_predict.c svm_compress.c svm_rff.c svm_nystrom.c svm_cache.c svm_compact.c svm_binary.c svm_store.c svm_text.c svm_simd.c, $ext_shared,, -DZEND_ENABLE_STATIC_TSRMLS_CACHE=1, cxx)
     PHP_ADD_SOURCES_X(PHP_EXT_DIR(svm), $ext_builddir/libsvm/svm.cpp,, shared_objects_svm, yes)
 
     PHP_ADD_INCLUDE($ext_srcdir/libsvm)
@@ -70,7 +72,7 @@ dnl Get PHP version depending on shared/static build
       SVM_SHARED_LIBADD -lsvm
     ])
   
-    PHP_NEW_EXTENSION(svm, svm.c, $ext_shared,, -DZEND_ENABLE_STATIC_TSRMLS_CACHE=1)
+    PHP_NEW_EXTENSION(svm, svm.c svm_predict.c svm_compress.c svm_rff.c svm_nystrom.c svm_cache.c svm_compact.c svm_binary.c svm_store.c svm_text.c svm_simd.c, $ext_shared,, -DZEND_ENABLE_STATIC_TSRMLS_CACHE=1)
   fi
   AC_DEFINE(HAVE_SVM,1,[ ])
 
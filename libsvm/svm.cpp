@@ -7,6 +7,16 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <locale.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #include "svm.h"
 int libsvm_version = LIBSVM_VERSION;
 typedef float Qfloat;
@@ -58,6 +68,207 @@ static void info(const char *fmt,...)
 static void info(const char *fmt,...) {}
 #endif
 
+//
+// Training threads
+//
+// Thread_Pool::run(n, nr_threads, task) calls task(k) for every k in [0,n) on up to
+// nr_threads threads, the calling thread included, and returns once all are done.
+// The workers are started on first use and kept until svm_shutdown_threads().
+// Calls made from inside a task, or while another thread has the pool, run
+// serially on the calling thread, so nesting and concurrent callers are safe.
+//
+// The number of threads is set per calling thread by svm_set_num_threads().
+//
+static thread_local int nr_threads_wanted = 1;
+static thread_local bool in_thread_pool = false;
+
+// Folds of the probability estimates, set per calling thread by svm_set_probability_folds()
+static thread_local int probability_folds_wanted = 5;
+
+class Thread_Pool
+{
+public:
+	static void run(int n, int nr_threads, const std::function<void(int)>& task);
+	static void shutdown();
+private:
+	static std::mutex busy;		// held by the thread running a job
+	static std::mutex lock;		// guards the job below
+	static std::condition_variable wake, finished;
+	static std::vector<std::thread *> workers;
+	static const std::function<void(int)> *task;
+	static int n;
+	static std::atomic<int> next;
+	static int wanted;		// workers taking part in the current job
+	static int running;		// workers still busy with it
+	static unsigned long job;
+	static bool stop;
+#ifndef _WIN32
+	static pid_t pid;
+#endif
+
+	static void drain();
+	static void work(int id, unsigned long seen);
+};
+
+std::mutex Thread_Pool::busy;
+std::mutex Thread_Pool::lock;
+std::condition_variable Thread_Pool::wake;
+std::condition_variable Thread_Pool::finished;
+std::vector<std::thread *> Thread_Pool::workers;
+const std::function<void(int)> *Thread_Pool::task = NULL;
+int Thread_Pool::n = 0;
+std::atomic<int> Thread_Pool::next(0);
+int Thread_Pool::wanted = 0;
+int Thread_Pool::running = 0;
+unsigned long Thread_Pool::job = 0;
+bool Thread_Pool::stop = false;
+#ifndef _WIN32
+pid_t Thread_Pool::pid = 0;
+#endif
+
+void Thread_Pool::drain()
+{
+	int k;
+	while((k = next++) < n)
+		(*task)(k);
+}
+
+void Thread_Pool::work(int id, unsigned long seen)
+{
+	in_thread_pool = true;
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;)
+	{
+		wake.wait(guard, [&] { return stop || (job != seen && id < wanted); });
+		if(stop)
+			return;
+		seen = job;
+		guard.unlock();
+		drain();
+		guard.lock();
+		if(--running == 0)
+			finished.notify_one();
+	}
+}
+
+void Thread_Pool::run(int n_, int nr_threads, const std::function<void(int)>& task_)
+{
+	int k;
+	if(nr_threads > n_)
+		nr_threads = n_;
+	if(nr_threads <= 1 || in_thread_pool || !busy.try_lock())
+	{
+		for(k=0;k<n_;k++)
+			task_(k);
+		return;
+	}
+
+#ifndef _WIN32
+	// Workers don't survive fork(), a child starts over with its own
+	if(pid != getpid())
+	{
+		workers.clear();
+		pid = getpid();
+	}
+#endif
+	while((int)workers.size() < nr_threads-1)
+		workers.push_back(new std::thread(work, (int)workers.size(), job));
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		task = &task_;
+		n = n_;
+		next = 0;
+		wanted = nr_threads-1;
+		running = wanted;
+		job++;
+	}
+	wake.notify_all();
+
+	in_thread_pool = true;
+	drain();
+	in_thread_pool = false;
+
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard, [] { return running == 0; });
+		task = NULL;
+	}
+	busy.unlock();
+}
+
+void Thread_Pool::shutdown()
+{
+	std::lock_guard<std::mutex> held(busy);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+	}
+	wake.notify_all();
+#ifndef _WIN32
+	if(pid == getpid())
+#endif
+	for(size_t i=0;i<workers.size();i++)
+	{
+		workers[i]->join();
+		delete workers[i];
+	}
+	workers.clear();
+	stop = false;
+}
+
+//
+// Random numbers for the shuffles, splitmix64
+//
+// Each shuffle draws from a generator of its own, seeded from a constant and
+// the place of the shuffle (fold, pair of classes), so results are the same
+// on every run whichever thread does the work.
+//
+#define RANDOM_SEED 1
+
+class Random
+{
+public:
+	Random(unsigned long long seed):state(seed) {}
+
+	// a number in [0,n)
+	int next(int n)
+	{
+		return (int)(mix(state += 0x9e3779b97f4a7c15ULL) % (unsigned long long)n);
+	}
+
+	// seed for the k-th part of a task seeded with seed
+	static unsigned long long derive(unsigned long long seed, int k)
+	{
+		return mix(seed + mix((unsigned long long)k + 1));
+	}
+private:
+	unsigned long long state;
+
+	static unsigned long long mix(unsigned long long z)
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+};
+
+// Settings of one svm_train or svm_cross_validation call. They are taken from
+// the calling thread once and handed down, as the threads doing the work have
+// settings of their own.
+struct train_options
+{
+	unsigned long long seed;	// of the shuffles
+	int probability_folds;		// 1 for a single held out split
+};
+
+static train_options derive_options(const train_options& opt, int k)
+{
+	train_options sub = opt;
+	sub.seed = Random::derive(opt.seed,k);
+	return sub;
+}
+
 //
 // Kernel Cache
 //
@@ -217,6 +428,10 @@ protected:
 
 	double (Kernel::*kernel_function)(int i, int j) const;
 
+	// fill data[start,len) of column i, times y[i]*y[j] if y is given,
+	// splitting long columns over the training threads
+	void fill_column(int i, int start, int len, const schar *y, Qfloat *data) const;
+
 private:
 	const svm_node **x;
 	double *x_square;
@@ -291,6 +506,33 @@ Kernel::~Kernel()
 	delete[] x_square;
 }
 
+// columns shorter than this per thread are filled on one thread
+#define MIN_COLUMN_CHUNK 2048
+
+void Kernel::fill_column(int i, int start, int len, const schar *y, Qfloat *data) const
+{
+	int nr_chunks = (len-start)/MIN_COLUMN_CHUNK;
+	if(nr_threads_wanted > 1 && nr_chunks > 1 && !in_thread_pool)
+	{
+		// a few chunks per thread, so that threads finishing early take more
+		nr_chunks = min(nr_chunks, 4*nr_threads_wanted);
+		int chunk = (len-start+nr_chunks-1)/nr_chunks;
+		Thread_Pool::run(nr_chunks, nr_threads_wanted, [&](int k) {
+			int lo = start+k*chunk;
+			fill_column(i, lo, min(lo+chunk, len), y, data);
+		});
+		return;
+	}
+
+	int j;
+	if(y)
+		for(j=start;j<len;j++)
+			data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
+	else
+		for(j=start;j<len;j++)
+			data[j] = (Qfloat)(this->*kernel_function)(i,j);
+}
+
 double Kernel::dot(const svm_node *px, const svm_node *py)
 {
 	double sum = 0;
@@ -372,6 +614,147 @@ double Kernel::k_function(const svm_node *x, const svm_node *y,
 	}
 }
 
+//
+// Gradient updates
+//
+// The solver keeps the gradient in doubles and adds multiples of kernel columns,
+// in Qfloats, to it: once per column at the start, twice per iteration, and
+// whenever the gradient is reconstructed. These loops widen four Qfloats at a
+// time where the CPU allows, picked once at run time. A product and the sums are
+// still rounded one at a time, never fused, so every step of the solver is the
+// same as in the plain loops.
+//
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GRADIENT_X86_DISPATCH 1
+#define GRADIENT_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// v[k] += a*q[k]
+static void add_scaled_plain(double *v, double a, const Qfloat *q, int n)
+{
+	for(int k=0;k<n;k++)
+		v[k] += a*q[k];
+}
+
+// v[k] += qi[k]*ai + qj[k]*aj
+static void add_scaled2_plain(double *v, const Qfloat *qi, double ai, const Qfloat *qj, double aj, int n)
+{
+	for(int k=0;k<n;k++)
+		v[k] += qi[k]*ai + qj[k]*aj;
+}
+
+#ifdef GRADIENT_X86_DISPATCH
+GRADIENT_TARGET("sse2")
+static void add_scaled_sse2(double *v, double a, const Qfloat *q, int n)
+{
+	__m128d va = _mm_set1_pd(a);
+	int k;
+	for(k=0;k+4<=n;k+=4)
+	{
+		__m128 f = _mm_loadu_ps(q+k);
+		_mm_storeu_pd(v+k, _mm_add_pd(_mm_loadu_pd(v+k), _mm_mul_pd(va, _mm_cvtps_pd(f))));
+		_mm_storeu_pd(v+k+2, _mm_add_pd(_mm_loadu_pd(v+k+2), _mm_mul_pd(va, _mm_cvtps_pd(_mm_movehl_ps(f, f)))));
+	}
+	for(;k<n;k++)
+		v[k] += a*q[k];
+}
+
+GRADIENT_TARGET("sse2")
+static void add_scaled2_sse2(double *v, const Qfloat *qi, double ai, const Qfloat *qj, double aj, int n)
+{
+	__m128d vai = _mm_set1_pd(ai), vaj = _mm_set1_pd(aj);
+	int k;
+	for(k=0;k+4<=n;k+=4)
+	{
+		__m128 fi = _mm_loadu_ps(qi+k), fj = _mm_loadu_ps(qj+k);
+		__m128d t0 = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(fi), vai), _mm_mul_pd(_mm_cvtps_pd(fj), vaj));
+		__m128d t1 = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(fi, fi)), vai),
+					_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(fj, fj)), vaj));
+		_mm_storeu_pd(v+k, _mm_add_pd(_mm_loadu_pd(v+k), t0));
+		_mm_storeu_pd(v+k+2, _mm_add_pd(_mm_loadu_pd(v+k+2), t1));
+	}
+	for(;k<n;k++)
+		v[k] += qi[k]*ai + qj[k]*aj;
+}
+
+GRADIENT_TARGET("avx")
+static void add_scaled_avx(double *v, double a, const Qfloat *q, int n)
+{
+	__m256d va = _mm256_set1_pd(a);
+	int k;
+	for(k=0;k+8<=n;k+=8)
+	{
+		_mm256_storeu_pd(v+k, _mm256_add_pd(_mm256_loadu_pd(v+k), _mm256_mul_pd(va, _mm256_cvtps_pd(_mm_loadu_ps(q+k)))));
+		_mm256_storeu_pd(v+k+4, _mm256_add_pd(_mm256_loadu_pd(v+k+4), _mm256_mul_pd(va, _mm256_cvtps_pd(_mm_loadu_ps(q+k+4)))));
+	}
+	for(;k<n;k++)
+		v[k] += a*q[k];
+}
+
+GRADIENT_TARGET("avx")
+static void add_scaled2_avx(double *v, const Qfloat *qi, double ai, const Qfloat *qj, double aj, int n)
+{
+	__m256d vai = _mm256_set1_pd(ai), vaj = _mm256_set1_pd(aj);
+	int k;
+	for(k=0;k+4<=n;k+=4)
+	{
+		__m256d t = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(qi+k)), vai),
+					  _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(qj+k)), vaj));
+		_mm256_storeu_pd(v+k, _mm256_add_pd(_mm256_loadu_pd(v+k), t));
+	}
+	for(;k<n;k++)
+		v[k] += qi[k]*ai + qj[k]*aj;
+}
+#endif
+
+struct Gradient_Loops
+{
+	void (*add_scaled)(double *v, double a, const Qfloat *q, int n);
+	void (*add_scaled2)(double *v, const Qfloat *qi, double ai, const Qfloat *qj, double aj, int n);
+
+	Gradient_Loops():add_scaled(add_scaled_plain),add_scaled2(add_scaled2_plain)
+	{
+#ifdef GRADIENT_X86_DISPATCH
+		// this may run before the constructor of libgcc that fills in the CPU features
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx"))
+		{
+			add_scaled = add_scaled_avx;
+			add_scaled2 = add_scaled2_avx;
+		}
+		else if(__builtin_cpu_supports("sse2"))
+		{
+			add_scaled = add_scaled_sse2;
+			add_scaled2 = add_scaled2_sse2;
+		}
+#endif
+	}
+};
+
+static const Gradient_Loops gradient_loops;
+
+// v[k] += a*q[k], and w[k] += b*q[k] unless w is NULL, for k in [start,end).
+// Long columns are split between threads like Kernel::fill_column.
+static void add_column(double *v, double a, double *w, double b, const Qfloat *q, int start, int end)
+{
+	int nr_chunks = (end-start)/MIN_COLUMN_CHUNK;
+	if(nr_threads_wanted > 1 && nr_chunks > 1 && !in_thread_pool)
+	{
+		nr_chunks = min(nr_chunks, 4*nr_threads_wanted);
+		int chunk = (end-start+nr_chunks-1)/nr_chunks;
+		Thread_Pool::run(nr_chunks, nr_threads_wanted, [&](int k) {
+			int lo = start+k*chunk;
+			add_column(v, a, w, b, q, lo, min(lo+chunk, end));
+		});
+		return;
+	}
+
+	gradient_loops.add_scaled(v+start, a, q+start, end-start);
+	if(w)
+		gradient_loops.add_scaled(w+start, b, q+start, end-start);
+}
+
 // An SMO algorithm in Fan et al., JMLR 6(2005), p. 1889--1918
 // Solves:
 //
@@ -480,13 +863,21 @@ void Solver::reconstruct_gradient()
 
 	if (nr_free*l > 2*active_size*(l-active_size))
 	{
+		// the free variables are the same for every row, so they are listed once
+		int *free_set = new int[nr_free];
+		int k = 0;
+		for(j=0;j<active_size;j++)
+			if(is_free(j))
+				free_set[k++] = j;
 		for(i=active_size;i<l;i++)
 		{
 			const Qfloat *Q_i = Q->get_Q(i,active_size);
-			for(j=0;j<active_size;j++)
-				if(is_free(j))
-					G[i] += alpha[j] * Q_i[j];
+			double G_i = G[i];
+			for(k=0;k<nr_free;k++)
+				G_i += alpha[free_set[k]] * Q_i[free_set[k]];
+			G[i] = G_i;
 		}
+		delete[] free_set;
 	}
 	else
 	{
@@ -494,9 +885,7 @@ void Solver::reconstruct_gradient()
 			if(is_free(i))
 			{
 				const Qfloat *Q_i = Q->get_Q(i,l);
-				double alpha_i = alpha[i];
-				for(j=active_size;j<l;j++)
-					G[j] += alpha_i * Q_i[j];
+				add_column(G,alpha[i],NULL,0,Q_i,active_size,l);
 			}
 	}
 }
@@ -545,13 +934,7 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			if(!is_lower_bound(i))
 			{
 				const Qfloat *Q_i = Q.get_Q(i,l);
-				double alpha_i = alpha[i];
-				int j;
-				for(j=0;j<l;j++)
-					G[j] += alpha_i*Q_i[j];
-				if(is_upper_bound(i))
-					for(j=0;j<l;j++)
-						G_bar[j] += get_C(i) * Q_i[j];
+				add_column(G,alpha[i],is_upper_bound(i) ? G_bar : NULL,get_C(i),Q_i,0,l);
 			}
 	}
 
@@ -691,10 +1074,7 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		double delta_alpha_i = alpha[i] - old_alpha_i;
 		double delta_alpha_j = alpha[j] - old_alpha_j;
 
-		for(int k=0;k<active_size;k++)
-		{
-			G[k] += Q_i[k]*delta_alpha_i + Q_j[k]*delta_alpha_j;
-		}
+		gradient_loops.add_scaled2(G,Q_i,delta_alpha_i,Q_j,delta_alpha_j,active_size);
 
 		// update alpha_status and G_bar
 
@@ -703,27 +1083,16 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			bool uj = is_upper_bound(j);
 			update_alpha_status(i);
 			update_alpha_status(j);
-			int k;
 			if(ui != is_upper_bound(i))
 			{
 				Q_i = Q.get_Q(i,l);
-				if(ui)
-					for(k=0;k<l;k++)
-						G_bar[k] -= C_i * Q_i[k];
-				else
-					for(k=0;k<l;k++)
-						G_bar[k] += C_i * Q_i[k];
+				add_column(G_bar,ui ? -C_i : C_i,NULL,0,Q_i,0,l);
 			}
 
 			if(uj != is_upper_bound(j))
 			{
 				Q_j = Q.get_Q(j,l);
-				if(uj)
-					for(k=0;k<l;k++)
-						G_bar[k] -= C_j * Q_j[k];
-				else
-					for(k=0;k<l;k++)
-						G_bar[k] += C_j * Q_j[k];
+				add_column(G_bar,uj ? -C_j : C_j,NULL,0,Q_j,0,l);
 			}
 		}
 	}
@@ -1279,12 +1648,9 @@ public:
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
-		}
+			fill_column(i,start,len,y,data);
 		return data;
 	}
 
@@ -1328,12 +1694,9 @@ public:
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(i,j);
-		}
+			fill_column(i,start,len,NULL,data);
 		return data;
 	}
 
@@ -1396,10 +1759,7 @@ public:
 		Qfloat *data;
 		int j, real_i = index[i];
 		if(cache->get_data(real_i,&data,l) < l)
-		{
-			for(j=0;j<l;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(real_i,j);
-		}
+			fill_column(real_i,0,l,NULL,data);
 
 		// reorder and copy
 		Qfloat *buf = buffer[next_buffer];
@@ -1889,27 +2249,49 @@ static void multiclass_probability(int k, double **r, double *p)
 	free(Qp);
 }
 
-// Cross-validation decision values for probability estimates
+// Cross-validation decision values for probability estimates. With a single
+// split only the first fifth of the shuffled data is held out and the sigmoid
+// is fitted to its decision values.
 static void svm_binary_svc_probability(
 	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn, double& probA, double& probB)
+	double Cp, double Cn, double& probA, double& probB, const train_options& opt)
 {
 	int i;
-	int nr_fold = 5;
+	int nr_fold = opt.probability_folds;
+	int nr_run;
+	if(nr_fold == 1)
+	{
+		nr_fold = 5;
+		nr_run = prob->l >= 2*nr_fold ? 1 : nr_fold;
+	}
+	else
+	{
+		// no more folds than rows, though never fewer than the 5 libsvm always used,
+		// so that small problems are calibrated as before
+		nr_fold = min(nr_fold,max(prob->l,5));
+		nr_run = nr_fold;
+	}
 	int *perm = Malloc(int,prob->l);
 	double *dec_values = Malloc(double,prob->l);
+	Random random(opt.seed);
 
 	// random shuffle
 	for(i=0;i<prob->l;i++) perm[i]=i;
 	for(i=0;i<prob->l;i++)
 	{
-		int j = i+rand()%(prob->l-i);
+		int j = i+random.next(prob->l-i);
 		swap(perm[i],perm[j]);
 	}
-	for(i=0;i<nr_fold;i++)
-	{
-		int begin = i*prob->l/nr_fold;
-		int end = (i+1)*prob->l/nr_fold;
+
+	// The folds are independent and fill separate parts of dec_values, so they are trained
+	// side by side, each with a share of the kernel cache
+	int nr_threads = max(1,min(nr_threads_wanted,nr_run));
+	svm_parameter fold_param = *param;
+	fold_param.cache_size = param->cache_size/nr_threads;
+
+	Thread_Pool::run(nr_run,nr_threads,[&](int i) {
+		int begin = (int)((long long)i*prob->l/nr_fold);
+		int end = (int)((long long)(i+1)*prob->l/nr_fold);
 		int j,k;
 		struct svm_problem subprob;
 
@@ -1948,7 +2330,7 @@ static void svm_binary_svc_probability(
 				dec_values[perm[j]] = -1;
 		else
 		{
-			svm_parameter subparam = *param;
+			svm_parameter subparam = fold_param;
 			subparam.probability=0;
 			subparam.C=1.0;
 			subparam.nr_weight=2;
@@ -1970,39 +2352,92 @@ static void svm_binary_svc_probability(
 		}
 		free(subprob.x);
 		free(subprob.y);
+	});
+	if(nr_run == nr_fold)
+		sigmoid_train(prob->l,dec_values,prob->y,probA,probB);
+	else
+	{
+		int held = prob->l/nr_fold;
+		double *held_values = Malloc(double,held);
+		double *held_labels = Malloc(double,held);
+		for(i=0;i<held;i++)
+		{
+			held_values[i] = dec_values[perm[i]];
+			held_labels[i] = prob->y[perm[i]];
+		}
+		sigmoid_train(held,held_values,held_labels,probA,probB);
+		free(held_values);
+		free(held_labels);
 	}
-	sigmoid_train(prob->l,dec_values,prob->y,probA,probB);
 	free(dec_values);
 	free(perm);
 }
 
-// Return parameter of a Laplace distribution
+static svm_model *svm_train_with(const svm_problem *prob, const svm_parameter *param, const train_options& opt);
+static void svm_cross_validation_with(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target, const train_options& opt);
+
+// Return parameter of a Laplace distribution, fitted to the residuals of
+// cross validation or of a single held out fifth of the data
 static double svm_svr_probability(
-	const svm_problem *prob, const svm_parameter *param)
+	const svm_problem *prob, const svm_parameter *param, const train_options& opt)
 {
 	int i;
 	int nr_fold = 5;
+	int l = prob->l;	// residuals in ymv
 	double *ymv = Malloc(double,prob->l);
 	double mae = 0;
 
 	svm_parameter newparam = *param;
 	newparam.probability = 0;
-	svm_cross_validation(prob,&newparam,nr_fold,ymv);
-	for(i=0;i<prob->l;i++)
+	if(opt.probability_folds == 1 && prob->l >= 2*nr_fold)
 	{
-		ymv[i]=prob->y[i]-ymv[i];
-		mae += fabs(ymv[i]);
+		int *perm = Malloc(int,prob->l);
+		Random random(opt.seed);
+		for(i=0;i<prob->l;i++) perm[i]=i;
+		for(i=0;i<prob->l;i++)
+		{
+			int j = i+random.next(prob->l-i);
+			swap(perm[i],perm[j]);
+		}
+		l = prob->l/nr_fold;
+
+		struct svm_problem subprob;
+		subprob.l = prob->l-l;
+		subprob.x = Malloc(struct svm_node*,subprob.l);
+		subprob.y = Malloc(double,subprob.l);
+		for(i=l;i<prob->l;i++)
+		{
+			subprob.x[i-l] = prob->x[perm[i]];
+			subprob.y[i-l] = prob->y[perm[i]];
+		}
+		struct svm_model *submodel = svm_train_with(&subprob,&newparam,opt);
+		for(i=0;i<l;i++)
+			ymv[i] = prob->y[perm[i]]-svm_predict(submodel,prob->x[perm[i]]);
+		svm_free_and_destroy_model(&submodel);
+		free(subprob.x);
+		free(subprob.y);
+		free(perm);
+	}
+	else
+	{
+		if(opt.probability_folds > 1)
+			nr_fold = opt.probability_folds;
+		svm_cross_validation_with(prob,&newparam,nr_fold,ymv,opt);
+		for(i=0;i<prob->l;i++)
+			ymv[i]=prob->y[i]-ymv[i];
 	}
-	mae /= prob->l;
+	for(i=0;i<l;i++)
+		mae += fabs(ymv[i]);
+	mae /= l;
 	double std=sqrt(2*mae*mae);
 	int count=0;
 	mae=0;
-	for(i=0;i<prob->l;i++)
+	for(i=0;i<l;i++)
 		if (fabs(ymv[i]) > 5*std)
 			count=count+1;
 		else
 			mae+=fabs(ymv[i]);
-	mae /= (prob->l-count);
+	mae /= (l-count);
 	info("Prob. model for test data: target value = predicted value + z,\nz: Laplace distribution e^(-|z|/sigma)/(2sigma),sigma= %g\n",mae);
 	free(ymv);
 	return mae;
@@ -2089,7 +2524,29 @@ static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **
 //
 // Interface functions
 //
-svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+// the two class problem of classes i and j of grouped data, +1 for i and -1 for j
+static void svm_pair_problem(svm_node **x, const int *start, const int *count, int i, int j, svm_problem *sub_prob)
+{
+	int si = start[i], sj = start[j];
+	int ci = count[i], cj = count[j];
+	sub_prob->l = ci+cj;
+	sub_prob->x = Malloc(svm_node *,sub_prob->l);
+	sub_prob->y = Malloc(double,sub_prob->l);
+	int k;
+	for(k=0;k<ci;k++)
+	{
+		sub_prob->x[k] = x[si+k];
+		sub_prob->y[k] = +1;
+	}
+	for(k=0;k<cj;k++)
+	{
+		sub_prob->x[ci+k] = x[sj+k];
+		sub_prob->y[ci+k] = -1;
+	}
+}
+
+// svm_train with the settings in opt
+static svm_model *svm_train_with(const svm_problem *prob, const svm_parameter *param, const train_options& opt)
 {
 	svm_model *model = Malloc(svm_model,1);
 	model->param = *param;
@@ -2111,7 +2568,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		    param->svm_type == NU_SVR))
 		{
 			model->probA = Malloc(double,1);
-			model->probA[0] = svm_svr_probability(prob,param);
+			model->probA[0] = svm_svr_probability(prob,param,opt);
 		}
 
 		decision_function f = svm_train_one(prob,param,0,0);
@@ -2189,42 +2646,67 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 			probB=Malloc(double,nr_class*(nr_class-1)/2);
 		}
 
+		int nr_pair = nr_class*(nr_class-1)/2;
+		int *pair_i = Malloc(int,nr_pair);
+		int *pair_j = Malloc(int,nr_pair);
 		int p = 0;
 		for(i=0;i<nr_class;i++)
 			for(int j=i+1;j<nr_class;j++)
 			{
-				svm_problem sub_prob;
-				int si = start[i], sj = start[j];
-				int ci = count[i], cj = count[j];
-				sub_prob.l = ci+cj;
-				sub_prob.x = Malloc(svm_node *,sub_prob.l);
-				sub_prob.y = Malloc(double,sub_prob.l);
-				int k;
-				for(k=0;k<ci;k++)
-				{
-					sub_prob.x[k] = x[si+k];
-					sub_prob.y[k] = +1;
-				}
-				for(k=0;k<cj;k++)
-				{
-					sub_prob.x[ci+k] = x[sj+k];
-					sub_prob.y[ci+k] = -1;
-				}
-
-				if(param->probability)
-					svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p]);
+				pair_i[p] = i;
+				pair_j[p] = j;
+				++p;
+			}
 
-				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j]);
-				for(k=0;k<ci;k++)
-					if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
-						nonzero[si+k] = true;
-				for(k=0;k<cj;k++)
-					if(!nonzero[sj+k] && fabs(f[p].alpha[ci+k]) > 0)
-						nonzero[sj+k] = true;
+		// With at least as many pairs as threads, each thread trains whole pairs with its own
+		// share of the kernel cache, the largest pairs first so that the last ones finish
+		// together. Otherwise the pairs are trained in turn, each on all threads.
+		int nr_threads = nr_pair >= nr_threads_wanted ? nr_threads_wanted : 1;
+		int *order = Malloc(int,nr_pair);
+		for(p=0;p<nr_pair;p++)
+			order[p] = p;
+		if(nr_threads > 1)
+			std::stable_sort(order,order+nr_pair,[&](int a, int b) {
+				return count[pair_i[a]]+count[pair_j[a]] > count[pair_i[b]]+count[pair_j[b]];
+			});
+		svm_parameter sub_param = *param;
+		sub_param.cache_size = param->cache_size/nr_threads;
+
+		// the probability estimates of a pair shuffle with a seed of the pair's own
+		if(param->probability)
+			Thread_Pool::run(nr_pair,nr_threads,[&](int k) {
+				int q = order[k];
+				svm_problem sub_prob;
+				svm_pair_problem(x,start,count,pair_i[q],pair_j[q],&sub_prob);
+				svm_binary_svc_probability(&sub_prob,&sub_param,weighted_C[pair_i[q]],weighted_C[pair_j[q]],probA[q],probB[q],derive_options(opt,q));
 				free(sub_prob.x);
 				free(sub_prob.y);
-				++p;
-			}
+			});
+
+		Thread_Pool::run(nr_pair,nr_threads,[&](int k) {
+			int q = order[k];
+			svm_problem sub_prob;
+			svm_pair_problem(x,start,count,pair_i[q],pair_j[q],&sub_prob);
+			f[q] = svm_train_one(&sub_prob,&sub_param,weighted_C[pair_i[q]],weighted_C[pair_j[q]]);
+			free(sub_prob.x);
+			free(sub_prob.y);
+		});
+
+		for(p=0;p<nr_pair;p++)
+		{
+			int si = start[pair_i[p]], sj = start[pair_j[p]];
+			int ci = count[pair_i[p]], cj = count[pair_j[p]];
+			int k;
+			for(k=0;k<ci;k++)
+				if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
+					nonzero[si+k] = true;
+			for(k=0;k<cj;k++)
+				if(!nonzero[sj+k] && fabs(f[p].alpha[ci+k]) > 0)
+					nonzero[sj+k] = true;
+		}
+		free(pair_i);
+		free(pair_j);
+		free(order);
 
 		// build output
 
@@ -2335,10 +2817,29 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 	return model;
 }
 
-// Stratified cross validation
+static train_options caller_options()
+{
+	train_options opt;
+	opt.seed = RANDOM_SEED;
+	opt.probability_folds = probability_folds_wanted;
+	return opt;
+}
+
+svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+{
+	return svm_train_with(prob,param,caller_options());
+}
+
 void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+{
+	svm_cross_validation_with(prob,param,nr_fold,target,caller_options());
+}
+
+// Stratified cross validation
+static void svm_cross_validation_with(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target, const train_options& opt)
 {
 	int i;
+	Random random(opt.seed);
 	int *fold_start;
 	int l = prob->l;
 	int *perm = Malloc(int,l);
@@ -2368,14 +2869,14 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		for (c=0; c<nr_class; c++)
 			for(i=0;i<count[c];i++)
 			{
-				int j = i+rand()%(count[c]-i);
+				int j = i+random.next(count[c]-i);
 				swap(index[start[c]+j],index[start[c]+i]);
 			}
 		for(i=0;i<nr_fold;i++)
 		{
 			fold_count[i] = 0;
 			for (c=0; c<nr_class;c++)
-				fold_count[i]+=(i+1)*count[c]/nr_fold-i*count[c]/nr_fold;
+				fold_count[i]+=(int)((long long)(i+1)*count[c]/nr_fold-(long long)i*count[c]/nr_fold);
 		}
 		fold_start[0]=0;
 		for (i=1;i<=nr_fold;i++)
@@ -2383,8 +2884,8 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		for (c=0; c<nr_class;c++)
 			for(i=0;i<nr_fold;i++)
 			{
-				int begin = start[c]+i*count[c]/nr_fold;
-				int end = start[c]+(i+1)*count[c]/nr_fold;
+				int begin = start[c]+(int)((long long)i*count[c]/nr_fold);
+				int end = start[c]+(int)((long long)(i+1)*count[c]/nr_fold);
 				for(int j=begin;j<end;j++)
 				{
 					perm[fold_start[i]] = index[j];
@@ -2405,15 +2906,20 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		for(i=0;i<l;i++) perm[i]=i;
 		for(i=0;i<l;i++)
 		{
-			int j = i+rand()%(l-i);
+			int j = i+random.next(l-i);
 			swap(perm[i],perm[j]);
 		}
 		for(i=0;i<=nr_fold;i++)
-			fold_start[i]=i*l/nr_fold;
+			fold_start[i]=(int)((long long)i*l/nr_fold);
 	}
 
-	for(i=0;i<nr_fold;i++)
-	{
+	// The folds are independent and fill separate parts of target, so they are trained side
+	// by side, each with a share of the kernel cache
+	int nr_threads = max(1,min(nr_threads_wanted,nr_fold));
+	svm_parameter fold_param = *param;
+	fold_param.cache_size = param->cache_size/nr_threads;
+
+	Thread_Pool::run(nr_fold,nr_threads,[&](int i) {
 		int begin = fold_start[i];
 		int end = fold_start[i+1];
 		int j,k;
@@ -2436,7 +2942,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 			subprob.y[k] = prob->y[perm[j]];
 			++k;
 		}
-		struct svm_model *submodel = svm_train(&subprob,param);
+		struct svm_model *submodel = svm_train_with(&subprob,&fold_param,derive_options(opt,i));
 		if(param->probability &&
 		   (param->svm_type == C_SVC || param->svm_type == NU_SVC))
 		{
@@ -2451,7 +2957,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		svm_free_and_destroy_model(&submodel);
 		free(subprob.x);
 		free(subprob.y);
-	}
+	});
 	free(fold_start);
 	free(perm);
 }
@@ -3179,3 +3685,20 @@ void svm_set_print_string_function(void (*print_func)(const char *))
 	else
 		svm_print_string = print_func;
 }
+
+void svm_set_num_threads(int nr_threads)
+{
+	if(nr_threads <= 0)
+		nr_threads = (int)std::thread::hardware_concurrency();
+	nr_threads_wanted = max(1, min(nr_threads, 256));
+}
+
+void svm_set_probability_folds(int nr_fold)
+{
+	probability_folds_wanted = max(1, nr_fold);
+}
+
+void svm_shutdown_threads(void)
+{
+	Thread_Pool::shutdown();
+}
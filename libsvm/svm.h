@@ -97,6 +97,17 @@ int svm_check_probability_model(const struct svm_model *model);
 
 void svm_set_print_string_function(void (*print_func)(const char *));
 
+/* Training threads, an addition of the bundled copy. svm_set_num_threads sets the number
+   of threads training started from the calling thread may use, 0 for one per CPU. */
+#define LIBSVM_THREADS 1
+void svm_set_num_threads(int nr_threads);
+void svm_shutdown_threads(void);
+
+/* Folds of the cross validation behind probability estimates, 5 by default. 1 fits them
+   to a single held out fifth of the data instead, which trains once rather than five times. */
+#define LIBSVM_PROBABILITY_FOLDS 1
+void svm_set_probability_folds(int nr_fold);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,8 +40,20 @@
 
 #include "php.h"
 
+ZEND_BEGIN_MODULE_GLOBALS(svm)
+	zend_long sparse_index;  /* svm.sparse_index, one of PHP_SVM_INDEX_* */
+	zend_long model_cache_size; /* svm.model_cache_size, in bytes */
+	struct _php_svm_store *model_store; /* models kept by SVMModel::fromCache(), created on first use */
+	zend_long threads;       /* svm.threads, 0 for one per CPU */
+ZEND_END_MODULE_GLOBALS(svm)
+
+ZEND_EXTERN_MODULE_GLOBALS(svm)
+
 #ifdef ZTS
-# define SVM_G(v) TSRMG(svm_globals_id, zend_svm_globals *, v)
+# define SVM_G(v) ZEND_TSRMG(svm_globals_id, zend_svm_globals *, v)
+# ifdef COMPILE_DL_SVM
+ZEND_TSRMLS_CACHE_EXTERN()
+# endif
 #else
 # define SVM_G(v) (svm_globals.v)
 #endif
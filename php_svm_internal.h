@@ -38,19 +38,430 @@ typedef struct _php_svm_object  {
 	/* Store the last error message here */
 	char last_error[512];
 
+	/* number of landmarks for low-rank training, 0 to train on the full kernel */
+	int approx_rank;
+
+	/* threads the bundled libsvm may train with, 0 to follow svm.threads */
+	int threads;
+
+	/* folds calibrating probability estimates, 1 for a single held out split */
+	int probability_folds;
+
 	zend_object zo;
 } php_svm_object;
 
+/* Prediction state derived from a model once it has been trained or loaded */
+typedef struct _php_svm_predictor {
+	/* number of decision functions, k*(k-1)/2 for classification, 1 otherwise */
+	int nr_dec;
+
+	/* linear kernel only: w[index * nr_dec + p] is the weight of feature index in decision function p */
+	double *linear_w;
+	int linear_dim;
+
+	/* dense row-major copy of the SVs, dense_sv[i * dense_stride + index], for densely filled models */
+	double *dense_sv;
+	int dense_dim;
+	int dense_stride;
+
+	/* RBF kernel without a dense matrix: squared norm of each SV */
+	double *sv_sq;
+
+	/* offset of the first SV of each class in model->SV, classification only */
+	int *sv_start;
+
+	/* postings index for very sparse models: the SVs using feature index are post_sv[post_start[index] ..
+	   post_start[index + 1]), with their values of that feature in post_value */
+	int *post_start;
+	int *post_sv;
+	double *post_value;
+	int post_dim;
+
+	/* random feature approximation, owned by the model object. Replaces the SVs when set. */
+	const struct _php_svm_rff *rff;
+
+	/* reduced precision SV storage, owned by the model object. Replaces model->SV when set, and with a
+	   dense layout sets dense_dim and dense_stride without a dense_sv matrix. */
+	const struct _php_svm_compact *compact;
+
+	/* arrays live in persistent memory, see php_svm_predictor_persist */
+	zend_bool persistent;
+} php_svm_predictor;
+
+/* Working memory for predicting one row, sized once the model is known so that predict() doesn't
+   go through the allocator. Results of the last prediction are left in dec_values and prob_estimates. */
+typedef struct _php_svm_scratch {
+	/* the input row, grown when a row with more features comes in */
+	struct svm_node *x;
+	int x_size;
+
+	double *kvalue;         /* l kernel values */
+	double *dec_values;     /* nr_dec decision values */
+	int *vote;              /* nr_class */
+	double *xd;             /* dense_stride, only with a dense SV layout */
+	double *prob_estimates; /* nr_class */
+	double **pairwise_prob; /* nr_class x nr_class */
+	double **Q;             /* nr_class x nr_class, for multiclass probabilities */
+	double *Qp;             /* nr_class */
+	double *rff_z;          /* dimension, random features of the row */
+	double *rff_col;        /* dimension, frequencies of an uncached feature */
+} php_svm_scratch;
+
+/* Random Fourier feature map standing in for the SVs of an RBF model, see svm_rff.c. Decision function p
+   is w[p * dimension ...] . z(x) - rho[p] with z(x) = sqrt(2 / dimension) * cos(omega' x + offset). */
+typedef struct _php_svm_rff {
+	int dimension;
+	zend_long seed;
+	double gamma;
+	int nr_dec;
+
+	double *w;       /* nr_dec x dimension */
+	double *offset;  /* dimension */
+
+	/* frequencies of features below omega_dim, omega[index * dimension + d]. The rest are regenerated
+	   from the seed when they come up. */
+	double *omega;
+	int omega_dim;
+} php_svm_rff;
+
+/* SV storage of a model converted by toFloat32() or toInt8(), see svm_compact.c. The SVs are either a dense
+   row-major matrix, value[i * stride + index], or CSR rows, index/value[row[i] .. row[i + 1]). int8 storage
+   keeps qvalue instead of value, each scaled by the factor of its feature with the dense layout and of its SV
+   with CSR rows. */
+#define PHP_SVM_STORAGE_FLOAT32 1
+#define PHP_SVM_STORAGE_INT8    2
+
+/* Rows of the dense int8 layout are padded to a multiple of this many values */
+#define PHP_SVM_DENSE_I8_ALIGN 16
+
+typedef struct _php_svm_compact {
+	int storage;
+	int l;
+	int dim;        /* every SV index is below this */
+	int stride;     /* dense layout: padded row length, 0 for CSR */
+
+	int *row;       /* CSR only, l + 1 */
+	int *index;     /* CSR only */
+	float *value;   /* float32 only */
+	int8_t *qvalue; /* int8 only */
+	double *scale;  /* int8 only, stride factors with the dense layout, l with CSR rows */
+
+	float *coef;    /* (nr_class - 1) x l coefficients, or NULL when model->sv_coef is kept */
+	double *sv_sq;  /* squared norm of each SV, for RBF with CSR rows or int8 storage */
+} php_svm_compact;
+
+/* {{{ static double php_svm_compact_value(const php_svm_compact *compact, int i, size_t k)
+Value k of SV i, where k is the feature with the dense layout and the offset into index with CSR rows.
+*/
+static zend_always_inline double php_svm_compact_value(const php_svm_compact *compact, int i, size_t k)
+{
+	if (compact->storage == PHP_SVM_STORAGE_INT8) {
+		return compact->stride ? compact->qvalue[(size_t)i * compact->stride + k] * compact->scale[k] : compact->qvalue[k] * compact->scale[i];
+	}
+	return compact->stride ? compact->value[(size_t)i * compact->stride + k] : compact->value[k];
+}
+/* }}} */
+
+/* Dense vector kernels, see svm_simd.c */
+typedef double (*php_svm_dense_func)(const double *a, const double *b, int n);
+typedef double (*php_svm_dense_f32_func)(const double *a, const float *b, int n);
+typedef int64_t (*php_svm_dense_i8_func)(const int16_t *a, const int8_t *b, int n);
+
+typedef struct _php_svm_simd {
+	const char *name;
+	php_svm_dense_func dot;
+	php_svm_dense_func dist;
+	php_svm_dense_f32_func dot_f32;
+	php_svm_dense_f32_func dist_f32;
+	php_svm_dense_i8_func dot_i8;
+} php_svm_simd;
+
+/* Cached prediction results of one row, see svm_cache.c. The arrays and the key share the allocation of
+   the entry. */
+#define PHP_SVM_CACHE_VALUES      1 /* label and dec_values */
+#define PHP_SVM_CACHE_PROBABILITY 2 /* prob_label and prob_estimates */
+
+typedef struct _php_svm_cache_entry {
+	struct _php_svm_cache_entry *lru_prev;
+	struct _php_svm_cache_entry *lru_next;
+	struct _php_svm_cache_entry *hash_next;
+	zend_ulong hash;
+	size_t size;
+	int nodes;
+	int flags;
+
+	double label;
+	double prob_label;
+	double *dec_values;     /* nr_class * (nr_class - 1) / 2 */
+	double *prob_estimates; /* nr_class */
+	struct svm_node *x;     /* nodes + 1, terminator included */
+} php_svm_cache_entry;
+
+typedef struct _php_svm_cache {
+	php_svm_cache_entry **buckets;
+	int nr_buckets;
+	php_svm_cache_entry *head; /* most recently used */
+	php_svm_cache_entry *tail;
+
+	int entries;
+	size_t memory;
+	int max_entries;   /* 0 when the cache is off */
+	size_t max_memory; /* 0 for no limit */
+
+	zend_long hits;
+	zend_long misses;
+} php_svm_cache;
+
+/* File behind a model opened by php_svm_binary_load(), see svm_binary.c. Mapped read only where mmap is
+   available, otherwise read into contents, which can also be a string shared with the model store. */
+typedef struct _php_svm_mapping {
+	void *base;
+	size_t size;
+	zend_bool mapped;
+	zend_bool persistent; /* opened at startup by php_svm_binary_preload() */
+	zend_string *contents;
+} php_svm_mapping;
+
+/* What identifies the version of a file in the model store */
+typedef struct _php_svm_store_stat {
+	zend_long mtime;
+	zend_long size;
+	zend_ulong inode;
+	zend_ulong device;
+} php_svm_store_stat;
+
+/* A model kept by SVMModel::fromCache(), see svm_store.c. Everything here is persistent, and shared by the
+   objects handed out for it, each of which holds a reference. */
+typedef struct _php_svm_store_entry {
+	struct _php_svm_store_entry *lru_prev;
+	struct _php_svm_store_entry *lru_next;
+	zend_string *path;           /* resolved, as expand_filepath() gives it */
+	struct svm_model *model;     /* opened from the binary format in the mapping */
+	php_svm_mapping *mapping;
+	php_svm_predictor predictor;
+	size_t memory;               /* of the mapping and the predictor, counted against the budget */
+	int refcount;                /* the store while the entry is in it, and every object using it */
+	php_svm_store_stat stat;
+} php_svm_store_entry;
+
+typedef struct _php_svm_store {
+	php_svm_store_entry *head; /* most recently used */
+	php_svm_store_entry *tail;
+
+	int entries;
+	size_t memory;
+
+	zend_long hits;
+	zend_long misses;
+	zend_long reloads;
+	zend_long evictions;
+} php_svm_store;
+
+/* A model opened at startup from the svm.preload ini setting, shared by every object SVMModel::preloaded()
+   returns for it. Everything here is persistent and read only once the module has started. */
+typedef struct _php_svm_preload {
+	struct _php_svm_preload *next;
+	zend_string *name;
+	struct svm_model *model;
+	php_svm_mapping *mapping;
+	php_svm_predictor predictor;
+} php_svm_preload;
+
 typedef struct _php_svm_model_object {
 	/* Hold the training data */
 	struct svm_node *x_space;
 	
 	/* hold the model generated by training, or to be used for classifying*/
 	struct svm_model *model;
+
+	/* derived from model, used to speed up predictions */
+	php_svm_predictor predictor;
+
+	/* per object buffers for single row predictions */
+	php_svm_scratch scratch;
+
+	/* set for models approximated by toRandomFeatures() */
+	php_svm_rff *rff;
+
+	/* set for models converted by toFloat32() or toInt8(), or loaded with float or int8 storage, which have no
+	   model->SV */
+	php_svm_compact *compact;
+
+	/* results of earlier predictions, see setCache() */
+	php_svm_cache cache;
+
+	/* set for models opened from a binary file, whose arrays live in the mapping */
+	php_svm_mapping *mapping;
+
+	/* set for models from SVMModel::preloaded() and SVMModel::fromCache(), whose model and predictor belong to the
+	   preload or to store_entry */
+	zend_bool shared;
+
+	/* the model store entry of a model from SVMModel::fromCache(), holding a reference */
+	php_svm_store_entry *store_entry;
 		
 	zend_object zo;
 } php_svm_model_object;
 
+/* Tile sizes used by the blocked batch prediction */
+#define PHP_SVM_BATCH_ROWS 16
+#define PHP_SVM_BATCH_SV   128
+
+/* Linear weights are always collapsed when they need fewer doubles than this */
+#define PHP_SVM_LINEAR_MIN_WEIGHTS 65536
+
+/* The dense SV matrix is built when indices stay below PHP_SVM_DENSE_MAX_DIM and at least
+   PHP_SVM_DENSE_MIN_FILL of its cells are nonzero. Rows are padded to PHP_SVM_DENSE_ALIGN doubles. */
+#define PHP_SVM_DENSE_MAX_DIM  4096
+#define PHP_SVM_DENSE_MIN_FILL 0.5
+#define PHP_SVM_DENSE_ALIGN    8
+
+/* svm.sparse_index settings. In auto mode the postings index is built for sparse models that fill at most
+   PHP_SVM_INDEX_MAX_FILL of their SV x feature matrix. In either mode its feature table is only built with at
+   most PHP_SVM_INDEX_DIM_PER_NODE entries per SV node, or PHP_SVM_INDEX_MIN_DIM entries for small models. */
+#define PHP_SVM_INDEX_OFF  0
+#define PHP_SVM_INDEX_ON   1
+#define PHP_SVM_INDEX_AUTO 2
+#define PHP_SVM_INDEX_MAX_FILL 0.1
+#define PHP_SVM_INDEX_DIM_PER_NODE 4
+#define PHP_SVM_INDEX_MIN_DIM      65536
+
+/* Compression starts from this many SVs when working to an error bound, growing the set by
+   PHP_SVM_COMPRESS_GROWTH each round */
+#define PHP_SVM_COMPRESS_START  16
+#define PHP_SVM_COMPRESS_GROWTH 1.25
+
+/* Largest random feature dimension, and at most this many frequencies are cached per model */
+#define PHP_SVM_RFF_MAX_DIMENSION 4096
+#define PHP_SVM_RFF_MAX_CACHE     (1 << 22)
+
+/* Ridge applied when fitting random feature weights, relative to the mean feature variance */
+#define PHP_SVM_RFF_RIDGE 1e-3
+
+/* Low-rank training: smallest jitter added to the landmark kernel matrix, relative to its mean diagonal, and
+   the most passes the linear solver makes */
+#define PHP_SVM_APPROX_JITTER   1e-10
+#define PHP_SVM_APPROX_MAX_ITER 1000
+
+/* How far an approximated model strays from the original over some rows */
+typedef struct _php_svm_drift_report {
+	double max_drift;       /* largest change of any decision value */
+	double mean_drift;
+	double label_agreement; /* fraction of rows predicted the same */
+} php_svm_drift_report;
+
+typedef struct _php_svm_compress_report {
+	int original_svs;
+	int svs;
+	php_svm_drift_report drift;
+} php_svm_compress_report;
+
+/* Integer power, computed the same way as libsvm so results match svm_predict exactly */
+static zend_always_inline double php_svm_powi(double base, int times)
+{
+	double tmp = base, ret = 1.0;
+	int t;
+
+	for (t = times; t > 0; t /= 2) {
+		if (t % 2 == 1) {
+			ret *= tmp;
+		}
+		tmp = tmp * tmp;
+	}
+	return ret;
+}
+
+/* splitmix64 finaliser, hashing the random feature frequencies and stepping the Nystrom landmark sampling */
+static zend_always_inline uint64_t php_svm_mix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+/* svm_predict.c */
+double php_svm_kernel(const struct svm_node *x, const struct svm_node *y, const struct svm_parameter *param);
+void php_svm_predictor_init(php_svm_predictor *pred, const struct svm_model *model);
+void php_svm_predictor_init_index(php_svm_predictor *pred, const struct svm_model *model, int mode);
+void php_svm_predictor_init_compact(php_svm_predictor *pred, const struct svm_model *model, const php_svm_compact *compact);
+void php_svm_predictor_persist(php_svm_predictor *pred, const struct svm_model *model);
+size_t php_svm_predictor_memory(const php_svm_predictor *pred, const struct svm_model *model);
+void php_svm_predictor_free(php_svm_predictor *pred);
+void php_svm_scratch_init(php_svm_scratch *scratch, const struct svm_model *model, const php_svm_predictor *pred);
+void php_svm_scratch_free(php_svm_scratch *scratch);
+struct svm_node *php_svm_scratch_row(php_svm_scratch *scratch, int nodes);
+double php_svm_predict_values(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, const struct svm_node *x);
+double php_svm_predict_probability(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, const struct svm_node *x);
+void php_svm_predict_batch(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, struct svm_node **x, int rows, double *labels, double *values);
+double *php_svm_decision_values(const struct svm_model *model, struct svm_node **x, int rows);
+size_t php_svm_model_memory(const struct svm_model *model, const php_svm_predictor *pred);
+void php_svm_drift(const struct svm_model *a, const php_svm_predictor *pa, const struct svm_model *b, const php_svm_predictor *pb, struct svm_node **x, int rows, php_svm_drift_report *report);
+
+/* svm_compress.c */
+struct svm_model *php_svm_compress(const struct svm_model *model, int target, double max_error, struct svm_node **x, int rows, php_svm_compress_report *report);
+zend_bool php_svm_cholesky(double *G, int n);
+void php_svm_cholesky_solve(const double *L, double *b, int n);
+
+/* svm_rff.c */
+struct svm_model *php_svm_rff_fit(const struct svm_model *model, int dimension, zend_long seed, php_svm_rff **rff_ptr);
+void php_svm_rff_decision_values(const php_svm_rff *rff, const struct svm_model *model, const struct svm_node *x, double *z, double *col, double *dec_values);
+void php_svm_rff_free(php_svm_rff *rff);
+zend_bool php_svm_rff_save(php_stream *stream, const struct svm_model *model, const php_svm_rff *rff);
+int php_svm_rff_load(php_stream *stream, struct svm_model **model_ptr, php_svm_rff **rff_ptr);
+
+/* svm_compact.c */
+struct svm_model *php_svm_compact_fit(const struct svm_model *model, int storage, zend_bool float_coef, php_svm_compact **compact_ptr);
+void php_svm_compact_kernels(const struct svm_model *model, const php_svm_compact *compact, const struct svm_node *x, const double *xd, double x_sq, int s0, int s1, double *kvalue);
+size_t php_svm_compact_memory(const php_svm_compact *compact, const struct svm_model *model);
+void php_svm_compact_free(php_svm_compact *compact);
+zend_bool php_svm_compact_save(php_stream *stream, const struct svm_model *model, const php_svm_compact *compact);
+int php_svm_compact_load(php_stream *stream, struct svm_model **model_ptr, php_svm_compact **compact_ptr);
+
+/* svm_binary.c */
+zend_bool php_svm_binary_save(php_stream *stream, const struct svm_model *model);
+zend_bool php_svm_binary_open(php_svm_mapping *mapping, struct svm_model **model_ptr);
+int php_svm_binary_load(php_stream *stream, struct svm_model **model_ptr, php_svm_mapping **mapping_ptr);
+void php_svm_binary_free(struct svm_model *model, php_svm_mapping *mapping);
+php_svm_mapping *php_svm_binary_preload(const char *filename, struct svm_model **model_ptr);
+
+/* svm_store.c */
+php_svm_store *php_svm_store_new(void);
+php_svm_store_entry *php_svm_store_find(php_svm_store *store, const char *path, size_t path_len);
+void php_svm_store_use(php_svm_store *store, php_svm_store_entry *entry);
+void php_svm_store_remove(php_svm_store *store, php_svm_store_entry *entry);
+void php_svm_store_trim(php_svm_store *store, size_t max_memory);
+php_svm_store_entry *php_svm_store_entry_new(const char *path, size_t path_len, struct svm_model *model, php_svm_mapping *mapping, const php_svm_predictor *pred, const php_svm_store_stat *stat);
+void php_svm_store_release(php_svm_store_entry *entry);
+zend_bool php_svm_store_put(php_svm_store *store, php_svm_store_entry *entry, size_t max_memory);
+void php_svm_store_free(php_svm_store *store);
+
+/* svm_text.c */
+struct svm_model *php_svm_text_load(php_stream *stream);
+zend_bool php_svm_text_save(php_stream *stream, const struct svm_model *model);
+extern const char *php_svm_svm_type_names[];
+extern const char *php_svm_kernel_type_names[];
+int php_svm_find_name(const char **names, const char *name);
+zend_bool php_svm_write_line(php_stream *stream, const char *format, ...);
+zend_bool php_svm_write_values(php_stream *stream, const char *key, const double *values, int n);
+char *php_svm_get_line(php_stream *stream);
+int php_svm_read_values(const char *p, double *values, int n);
+
+/* svm_nystrom.c */
+const char *php_svm_nystrom_check(const struct svm_problem *prob, const struct svm_parameter *param);
+struct svm_model *php_svm_nystrom_train(const struct svm_problem *prob, const struct svm_parameter *param, int rank);
+
+/* svm_cache.c */
+void php_svm_cache_configure(php_svm_cache *cache, int max_entries, size_t max_memory);
+void php_svm_cache_clear(php_svm_cache *cache);
+void php_svm_cache_free(php_svm_cache *cache);
+php_svm_cache_entry *php_svm_cache_find(php_svm_cache *cache, const struct svm_node *x, int flags);
+php_svm_cache_entry *php_svm_cache_store(php_svm_cache *cache, const struct svm_node *x, int nr_dec, int nr_class);
+
+/* svm_simd.c */
+extern php_svm_simd php_svm_simd_impl;
+void php_svm_simd_init(void);
+
 #endif /* _PHP_SVM_INTERNAL_H_ */
 
 
@@ -31,6 +31,11 @@
 #include "php_ini.h" /* needed for 5.2 */
 #include "Zend/zend_exceptions.h"
 #include "ext/standard/info.h"
+#include "php_memory_streams.h"
+#include "ext/standard/php_filestat.h"
+#include "zend_smart_str.h"
+
+#include <ctype.h>
 
 static zend_class_entry *php_svm_sc_entry;
 static zend_class_entry *php_svm_model_sc_entry;
@@ -39,6 +44,11 @@ static zend_class_entry *php_svm_exception_sc_entry;
 static zend_object_handlers svm_object_handlers;
 static zend_object_handlers svm_model_object_handlers;
 
+/* Models from svm.preload, opened at startup and shared by every request and thread */
+static php_svm_preload *php_svm_preloaded = NULL;
+
+ZEND_DECLARE_MODULE_GLOBALS(svm)
+
 #ifndef TRUE
 #       define TRUE 1
 #       define FALSE 0
@@ -47,6 +57,7 @@ static zend_object_handlers svm_model_object_handlers;
 #define SUCCESS 0
 
 #define SVM_MAX_LINE_SIZE 4096
+#define PHP_SVM_MAX_PROBABILITY_FOLDS 100
 #define SVM_THROW(message, code) \
 		zend_throw_exception(php_svm_exception_sc_entry, message, code); \
 		return;
@@ -62,6 +73,9 @@ typedef enum SvmLongAttribute {
 	phpsvm_svm_type,
 	phpsvm_kernel_type,
 	phpsvm_degree,
+	phpsvm_approx_rank,
+	phpsvm_threads,
+	phpsvm_probability_folds,
 	SvmLongAttributeMax /* Always add before this */
 } SvmLongAttribute;
 
@@ -184,6 +198,25 @@ static zend_bool php_svm_set_long_attribute(php_svm_object *intern, SvmLongAttri
 		case phpsvm_degree:
 			intern->param.degree = (int)value;
 			break;
+		case phpsvm_approx_rank:
+			if (value < 0 || value > INT_MAX) {
+				return FALSE;
+			}
+			intern->approx_rank = (int)value;
+			break;
+		case phpsvm_threads:
+			if (value < 0 || value > INT_MAX) {
+				return FALSE;
+			}
+			intern->threads = (int)value;
+			break;
+		case phpsvm_probability_folds:
+			/* every fold is another full training per pair of classes */
+			if (value < 1 || value > PHP_SVM_MAX_PROBABILITY_FOLDS) {
+				return FALSE;
+			}
+			intern->probability_folds = (int)value;
+			break;
 		default:
 			return FALSE;
 	}
@@ -191,11 +224,11 @@ static zend_bool php_svm_set_long_attribute(php_svm_object *intern, SvmLongAttri
 	return TRUE;
 }/*}}}*/
 
-/** {{{ zend_bool php_svm_stream_to_array(php_svm_object *intern, php_stream *stream, zval *retval)
+/** {{{ zend_bool php_svm_stream_to_array(char *last_error, php_stream *stream, zval *retval)
 	Take a stream containing lines of SVMLight format data and convert them into a PHP array for use by the training
-	function.
+	function. Errors are written to last_error, SVM_ERROR_MSG_SIZE bytes.
 */
-static zend_bool php_svm_stream_to_array(php_svm_object *intern, php_stream *stream, zval *retval)
+static zend_bool php_svm_stream_to_array(char *last_error, php_stream *stream, zval *retval)
 {
 	while (!php_stream_eof(stream)) {
 		char buf[SVM_MAX_LINE_SIZE];
@@ -212,7 +245,7 @@ static zend_bool php_svm_stream_to_array(php_svm_object *intern, php_stream *str
 			label = php_strtok_r(ptr, " \t", &l);
 
 			if (!label) {
-			    snprintf(intern->last_error, SVM_ERROR_MSG_SIZE, "Incorrect data format on line %d", line);
+			    snprintf(last_error, SVM_ERROR_MSG_SIZE, "Incorrect data format on line %d", line);
 				return FALSE;
 			}
 			
@@ -438,8 +471,361 @@ return_error:
 }
 /* }}} */
 
+/* {{{ static void php_svm_model_free_data(php_svm_model_object *intern_model)
+Release the model, its training data and anything derived from it, leaving the object empty.
+*/
+static void php_svm_model_free_data(php_svm_model_object *intern_model)
+{
+	/* Cached results belong to the model going away, the budget stays with the object */
+	php_svm_cache_clear(&intern_model->cache);
+	php_svm_scratch_free(&intern_model->scratch);
+
+	if (intern_model->shared) {
+		/* Only the scratch buffers were the object's own */
+		memset(&intern_model->predictor, 0, sizeof(php_svm_predictor));
+		intern_model->model = NULL;
+		intern_model->shared = 0;
+		if (intern_model->store_entry) {
+			php_svm_store_release(intern_model->store_entry);
+			intern_model->store_entry = NULL;
+		}
+	} else {
+		php_svm_predictor_free(&intern_model->predictor);
+	}
+
+	if (intern_model->mapping) {
+		php_svm_binary_free(intern_model->model, intern_model->mapping);
+		intern_model->mapping = NULL;
+		intern_model->model = NULL;
+	} else if (intern_model->model) {
+		#if LIBSVM_VERSION >= 300
+			svm_free_and_destroy_model(&intern_model->model);
+		#else
+			svm_destroy_model(intern_model->model);
+		#endif
+		intern_model->model = NULL;
+	}
+
+	if (intern_model->rff) {
+		php_svm_rff_free(intern_model->rff);
+		intern_model->rff = NULL;
+	}
+
+	if (intern_model->compact) {
+		php_svm_compact_free(intern_model->compact);
+		intern_model->compact = NULL;
+	}
+
+	if (intern_model->x_space) {
+		efree(intern_model->x_space);
+		intern_model->x_space = NULL;
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_model_prepare(php_svm_model_object *intern_model)
+Set up the prediction state for a freshly trained or loaded model.
+*/
+static void php_svm_model_prepare(php_svm_model_object *intern_model)
+{
+	php_svm_predictor_init(&intern_model->predictor, intern_model->model);
+	intern_model->predictor.rff = intern_model->rff;
+	php_svm_predictor_init_compact(&intern_model->predictor, intern_model->model, intern_model->compact);
+	php_svm_predictor_init_index(&intern_model->predictor, intern_model->model, (int)SVM_G(sparse_index));
+	php_svm_scratch_init(&intern_model->scratch, intern_model->model, &intern_model->predictor);
+}
+/* }}} */
+
+/* {{{ static void php_svm_model_cache_values(php_svm_model_object *intern_model, const struct svm_node *x, double label)
+Remember the label and decision values just predicted for a row, if the object caches results.
+*/
+static void php_svm_model_cache_values(php_svm_model_object *intern_model, const struct svm_node *x, double label)
+{
+	php_svm_cache_entry *entry;
+
+	entry = php_svm_cache_store(&intern_model->cache, x, intern_model->predictor.nr_dec, intern_model->model->nr_class);
+	if (entry) {
+		entry->label = label;
+		memcpy(entry->dec_values, intern_model->scratch.dec_values, intern_model->predictor.nr_dec * sizeof(double));
+		entry->flags |= PHP_SVM_CACHE_VALUES;
+	}
+}
+/* }}} */
+
+/* {{{ static int php_svm_model_read_stream(php_stream *stream, struct svm_model **model_ptr, php_svm_mapping **mapping_ptr, php_svm_rff **rff_ptr, php_svm_compact **compact_ptr)
+Read a model from a stream, either a binary model, a random feature model, a model with float or int8 storage or
+anything libsvm can read. The formats are told apart by their first bytes, so a stream that can't seek back to
+them, such as a socket, is read into memory first. Returns 1 with the model and whichever of the mapping, random
+features or compact storage it came with, the others left NULL, or 0 or less if nothing could be read.
+*/
+static int php_svm_model_read_stream(php_stream *stream, struct svm_model **model_ptr, php_svm_mapping **mapping_ptr, php_svm_rff **rff_ptr, php_svm_compact **compact_ptr)
+{
+	zend_string *contents = NULL;
+	php_stream *memory = NULL;
+	zend_off_t start;
+	int status;
+
+	*model_ptr = NULL;
+	*mapping_ptr = NULL;
+	*rff_ptr = NULL;
+	*compact_ptr = NULL;
+
+	if (!stream->ops->seek || (stream->flags & PHP_STREAM_FLAG_NO_SEEK)) {
+		contents = php_stream_copy_to_mem(stream, PHP_STREAM_COPY_ALL, 0);
+		if (!contents) {
+			return -1;
+		}
+		memory = php_stream_memory_open(TEMP_STREAM_READONLY, ZSTR_VAL(contents), ZSTR_LEN(contents));
+		if (!memory) {
+			zend_string_release(contents);
+			return -1;
+		}
+		stream = memory;
+	}
+	start = php_stream_tell(stream);
+
+	status = php_svm_binary_load(stream, model_ptr, mapping_ptr);
+	if (status == 0 && php_stream_seek(stream, start, SEEK_SET) == 0) {
+		status = php_svm_rff_load(stream, model_ptr, rff_ptr);
+	}
+	if (status == 0 && php_stream_seek(stream, start, SEEK_SET) == 0) {
+		status = php_svm_compact_load(stream, model_ptr, compact_ptr);
+	}
+	if (status == 0 && php_stream_seek(stream, start, SEEK_SET) == 0) {
+		*model_ptr = php_svm_text_load(stream);
+		status = *model_ptr ? 1 : -1;
+	}
+
+	if (memory) {
+		php_stream_close(memory);
+		zend_string_release(contents);
+	}
+	return status;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_model_load_stream(php_svm_model_object *intern_model, php_stream *stream)
+Replace the model held by the object with one read from a stream by php_svm_model_read_stream. If nothing can be
+read, the object keeps the model it had.
+*/
+static zend_bool php_svm_model_load_stream(php_svm_model_object *intern_model, php_stream *stream)
+{
+	struct svm_model *model;
+	php_svm_mapping *mapping;
+	php_svm_rff *rff;
+	php_svm_compact *compact;
+
+	if (php_svm_model_read_stream(stream, &model, &mapping, &rff, &compact) <= 0) {
+		return FALSE;
+	}
+
+	php_svm_model_free_data(intern_model);
+	intern_model->model = model;
+	intern_model->mapping = mapping;
+	intern_model->rff = rff;
+	intern_model->compact = compact;
+	php_svm_model_prepare(intern_model);
+	return TRUE;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_model_load_file(php_svm_model_object *intern_model, zval *zfile)
+Replace the model held by the object with one loaded from a file name or a stream resource.
+*/
+static zend_bool php_svm_model_load_file(php_svm_model_object *intern_model, zval *zfile)
+{
+	php_stream *stream;
+	zend_bool ok;
+
+	if (Z_TYPE_P(zfile) == IS_RESOURCE) {
+		php_stream_from_zval_no_verify(stream, zfile);
+		return stream ? php_svm_model_load_stream(intern_model, stream) : FALSE;
+	}
+	if (Z_TYPE_P(zfile) != IS_STRING) {
+		return FALSE;
+	}
+
+	stream = php_stream_open_wrapper(Z_STRVAL_P(zfile), "rb", 0, NULL);
+	if (!stream) {
+		return FALSE;
+	}
+	ok = php_svm_model_load_stream(intern_model, stream);
+	php_stream_close(stream);
+	return ok;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_model_save_stream(php_svm_model_object *intern_model, php_stream *stream, zend_bool binary)
+Write the model held by the object to a stream, in the binary format or in the text format for its storage.
+*/
+static zend_bool php_svm_model_save_stream(php_svm_model_object *intern_model, php_stream *stream, zend_bool binary)
+{
+	if (binary) {
+		return php_svm_binary_save(stream, intern_model->model);
+	} else if (intern_model->rff) {
+		return php_svm_rff_save(stream, intern_model->model, intern_model->rff);
+	} else if (intern_model->compact) {
+		return php_svm_compact_save(stream, intern_model->model, intern_model->compact);
+	}
+	return php_svm_text_save(stream, intern_model->model);
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_model_save_file(php_svm_model_object *intern_model, zval *zfile, zend_bool binary)
+Write the model held by the object to a file name or a stream resource.
+*/
+static zend_bool php_svm_model_save_file(php_svm_model_object *intern_model, zval *zfile, zend_bool binary)
+{
+	php_stream *stream;
+	zend_bool ok;
+
+	if (Z_TYPE_P(zfile) == IS_RESOURCE) {
+		php_stream_from_zval_no_verify(stream, zfile);
+		return stream ? php_svm_model_save_stream(intern_model, stream, binary) : FALSE;
+	}
+	if (Z_TYPE_P(zfile) != IS_STRING) {
+		return FALSE;
+	}
+
+	stream = php_stream_open_wrapper(Z_STRVAL_P(zfile), "wb", REPORT_ERRORS, NULL);
+	if (!stream) {
+		return FALSE;
+	}
+	ok = php_svm_model_save_stream(intern_model, stream, binary);
+	php_stream_close(stream);
+	return ok;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_model_load_string(php_svm_model_object *intern_model, const char *data, size_t data_len)
+Replace the model held by the object with one read from a string holding a saved model.
+*/
+static zend_bool php_svm_model_load_string(php_svm_model_object *intern_model, const char *data, size_t data_len)
+{
+	php_stream *stream;
+	zend_bool ok;
+
+	stream = php_stream_memory_open(TEMP_STREAM_READONLY, (char *)data, data_len);
+	if (!stream) {
+		return FALSE;
+	}
+	ok = php_svm_model_load_stream(intern_model, stream);
+	php_stream_close(stream);
+	return ok;
+}
+/* }}} */
+
+/* {{{ static zend_string *php_svm_model_save_string(php_svm_model_object *intern_model, zend_bool binary)
+The model held by the object as a string, as php_svm_model_save_stream writes it, or NULL on failure.
+*/
+static zend_string *php_svm_model_save_string(php_svm_model_object *intern_model, zend_bool binary)
+{
+	php_stream *stream;
+	zend_string *contents = NULL;
+
+	stream = php_stream_memory_create(TEMP_STREAM_DEFAULT);
+	if (!stream) {
+		return NULL;
+	}
+	if (php_svm_model_save_stream(intern_model, stream, binary) && php_stream_seek(stream, 0, SEEK_SET) == 0) {
+		contents = php_stream_copy_to_mem(stream, PHP_STREAM_COPY_ALL, 0);
+	}
+	php_stream_close(stream);
+	return contents;
+}
+/* }}} */
+
+/* {{{ static php_svm_store_entry *php_svm_model_store_open(const char *path, size_t path_len, const php_svm_store_stat *stat, zend_bool *unsupported)
+Load a model file for the model store: read without any prediction state, written out again in the binary format
+and opened from that in persistent memory, with its prediction state built once, as php_svm_preload_model does.
+Returns NULL if the file can't be loaded, or if it holds a model the binary format can't, in which case unsupported
+is set. The caller holds the reference the entry starts with.
+*/
+static php_svm_store_entry *php_svm_model_store_open(const char *path, size_t path_len, const php_svm_store_stat *stat, zend_bool *unsupported)
+{
+	php_svm_mapping *mapping;
+	php_svm_rff *rff;
+	php_svm_compact *compact;
+	php_svm_predictor predictor;
+	php_stream *stream, *memory;
+	struct svm_model *model;
+	zend_string *contents = NULL, *persistent = NULL;
+	int status;
+
+	stream = php_stream_open_wrapper((char *)path, "rb", 0, NULL);
+	if (!stream) {
+		return NULL;
+	}
+	status = php_svm_model_read_stream(stream, &model, &mapping, &rff, &compact);
+	php_stream_close(stream);
+	if (status <= 0) {
+		return NULL;
+	}
+
+	if (rff || compact) {
+		*unsupported = 1;
+	} else if ((memory = php_stream_memory_create(TEMP_STREAM_DEFAULT)) != NULL) {
+		if (php_svm_binary_save(memory, model) && php_stream_seek(memory, 0, SEEK_SET) == 0) {
+			contents = php_stream_copy_to_mem(memory, PHP_STREAM_COPY_ALL, 0);
+		}
+		php_stream_close(memory);
+	}
+
+	if (mapping) {
+		php_svm_binary_free(model, mapping);
+	} else {
+		#if LIBSVM_VERSION >= 300
+			svm_free_and_destroy_model(&model);
+		#else
+			svm_destroy_model(model);
+		#endif
+	}
+	if (rff) {
+		php_svm_rff_free(rff);
+	}
+	if (compact) {
+		php_svm_compact_free(compact);
+	}
+	if (!contents) {
+		return NULL;
+	}
+	persistent = zend_string_init(ZSTR_VAL(contents), ZSTR_LEN(contents), 1);
+	zend_string_release(contents);
+
+	mapping = pecalloc(1, sizeof(php_svm_mapping), 1);
+	mapping->persistent = 1;
+	mapping->base = ZSTR_VAL(persistent);
+	mapping->size = ZSTR_LEN(persistent);
+	mapping->contents = persistent;
+	if (!php_svm_binary_open(mapping, &model)) {
+		return NULL;
+	}
+
+	php_svm_predictor_init(&predictor, model);
+	php_svm_predictor_init_index(&predictor, model, (int)SVM_G(sparse_index));
+	php_svm_predictor_persist(&predictor, model);
+
+	return php_svm_store_entry_new(path, path_len, model, mapping, &predictor, stat);
+}
+/* }}} */
+
+/* {{{ static void php_svm_use_training_options(php_svm_object *intern)
+Tell the bundled libsvm how many threads training may use, from OPT_THREADS or else svm.threads, and how many
+folds calibrate probability estimates. Other libsvm builds always train on one thread with 5 folds.
+*/
+static void php_svm_use_training_options(php_svm_object *intern)
+{
+#ifdef LIBSVM_THREADS
+	svm_set_num_threads(intern->threads > 0 ? intern->threads : (int)SVM_G(threads));
+#endif
+#ifdef LIBSVM_PROBABILITY_FOLDS
+	svm_set_probability_folds(intern->probability_folds);
+#endif
+}
+/* }}} */
+
 /* {{{ static zend_bool php_svm_train(php_svm_object *intern, php_svm_model_object *intern_model, struct svm_problem *problem) 
-Train based on a libsvm problem structure
+Train based on a libsvm problem structure, on a Nystrom approximation of the kernel when OPT_APPROX_RANK is set
 */
 static zend_bool php_svm_train(php_svm_object *intern, php_svm_model_object *intern_model, struct svm_problem *problem) 
 {
@@ -450,22 +836,34 @@ static zend_bool php_svm_train(php_svm_object *intern, php_svm_model_object *int
 		return FALSE;
 	}
 
-	intern_model->model = svm_train(problem, &(intern->param));
+	php_svm_use_training_options(intern);
+	if (intern->approx_rank > 0) {
+		err_msg = php_svm_nystrom_check(problem, &(intern->param));
+		if (err_msg) {
+			snprintf(intern->last_error, SVM_ERROR_MSG_SIZE, "%s", err_msg);
+			return FALSE;
+		}
+		intern_model->model = php_svm_nystrom_train(problem, &(intern->param), intern->approx_rank);
+	} else {
+		intern_model->model = svm_train(problem, &(intern->param));
+	}
 
 	/* Failure ? */
 	if (!intern_model->model) {
 		snprintf(intern->last_error, SVM_ERROR_MSG_SIZE, "Failed to train using the data");
 		return FALSE;
 	}
+
+	php_svm_model_prepare(intern_model);
 	
 	return TRUE;
 }
 /* }}} */
 
-/* {{{ static zval* php_svm_get_data_from_param(php_svm_object *intern, zval *zparam)
+/* {{{ static zval* php_svm_get_data_from_param(char *last_error, zval *zparam)
 Take an incoming parameter and convert it into a PHP array of svmlight style data.
 */
-static int php_svm_get_data_from_param(php_svm_object *intern, zval *zparam, zval ** data_ptr) 
+static int php_svm_get_data_from_param(char *last_error, zval *zparam, zval ** data_ptr) 
 {
 	zend_bool our_stream = 0;
 	zend_bool need_read = 1;
@@ -488,7 +886,7 @@ static int php_svm_get_data_from_param(php_svm_object *intern, zval *zparam, zva
 		break;
 		
 		default:
-			snprintf(intern->last_error, SVM_ERROR_MSG_SIZE, "Incorrect parameter type, expecting string, stream or an array");
+			snprintf(last_error, SVM_ERROR_MSG_SIZE, "Incorrect parameter type, expecting string, stream or an array");
 			return FALSE;
 		break;
 	}
@@ -496,17 +894,16 @@ static int php_svm_get_data_from_param(php_svm_object *intern, zval *zparam, zva
 	/* If we got stream then read it in */
 	if (need_read) {
 		if (!stream) {
-			snprintf(intern->last_error, SVM_ERROR_MSG_SIZE, "Failed to open the data file");
+			snprintf(last_error, SVM_ERROR_MSG_SIZE, "Failed to open the data file");
 			return FALSE;
 		}
 	
-		if (!php_svm_stream_to_array(intern, stream, *data_ptr)) {
-			zval_dtor(*data_ptr);
-			efree(data_ptr);
+		/* What was read so far is left for the caller to destroy with the rest of the array */
+		if (!php_svm_stream_to_array(last_error, stream, *data_ptr)) {
 			if (our_stream) {
 				php_stream_close(stream);
 			}
-			snprintf(intern->last_error, SVM_ERROR_MSG_SIZE, "Failed to read the data");
+			snprintf(last_error, SVM_ERROR_MSG_SIZE, "Failed to read the data");
 			return FALSE;
 		}
 	} else {
@@ -521,50 +918,154 @@ static int php_svm_get_data_from_param(php_svm_object *intern, zval *zparam, zva
 }
 /* }}} */
 
-/* {{{ static svm_node* php_svm_get_data_from_array(zval *arr)
-Take an array of training data and turn it into an array of svm nodes.
+/* {{{ static int php_svm_fill_nodes(zval *arr, struct svm_node *x, double *label)
+Convert one array of index => value pairs into svm nodes, terminated with index -1. x must have room
+for one more node than the array has elements. When label is given the first element is the label of the row,
+as in training data, and is stored there instead. Returns the number of nodes written, including the terminator.
 */
-static struct svm_node* php_svm_get_data_from_array(zval* arr) 
+static int php_svm_fill_nodes(zval *arr, struct svm_node *x, double *label)
 {
-	struct svm_node *x;
 	HashTable *arr_hash;
-	int array_count, i;
+	int i;
 	char *endptr;
-	zval temp;
 	zend_string *key;
 	zend_ulong num_key;
 	zval *val;
-	
+
 	arr_hash = Z_ARRVAL_P(arr);
-	array_count = zend_hash_num_elements(arr_hash);
-	
-	/* need 1 extra to indicate the end */
-	x = safe_emalloc((array_count + 1), sizeof(struct svm_node), 0);
 	i = 0;
-	
+
 	/* Loop over the array in the argument and convert into svm_nodes for the prediction */
 	ZEND_HASH_FOREACH_KEY_VAL(arr_hash, num_key, key, val) 
 	{
+		if (label) {
+			*label = zval_get_double(val);
+			label = NULL;
+			continue;
+		}
 		if (key) {
 			x[i].index = (int) strtol(ZSTR_VAL(key), &endptr, 10);
 		} else {
 			x[i].index = (int) num_key;
 		} 
-		temp = *val;
-		zval_copy_ctor(&temp);
-		convert_to_double(&temp);
-		x[i].value = Z_DVAL(temp);
-		zval_dtor(&temp);
+		x[i].value = zval_get_double(val);
 		i++;
 	} ZEND_HASH_FOREACH_END();
 
 	/* needed so the predictor knows when to end */
 	x[i].index = -1;
+
+	return i + 1;
+}
+/* }}} */
+
+/* {{{ static svm_node* php_svm_get_data_from_array(php_svm_scratch *scratch, zval *arr)
+Take an array of data to predict and turn it into svm nodes, in the row buffer of the model object.
+The nodes are only valid until the next prediction on the same model.
+*/
+static struct svm_node* php_svm_get_data_from_array(php_svm_scratch *scratch, zval* arr) 
+{
+	struct svm_node *x;
+	int array_count;
+	
+	array_count = zend_hash_num_elements(Z_ARRVAL_P(arr));
+	
+	/* need 1 extra to indicate the end */
+	x = php_svm_scratch_row(scratch, array_count + 1);
+	php_svm_fill_nodes(arr, x, NULL);
 	
 	return x;
 }
 /* }}} */
 
+/* {{{ static int php_svm_get_rows_from_array(zval *arr, struct svm_node **x_space_ptr, struct svm_node ***x_ptr, double **y_ptr)
+Convert an array of rows, each an array of index => value pairs, into svm nodes. All rows share one
+allocation returned in x_space_ptr, x_ptr gets a pointer to the start of each row. If y_ptr is given, each row
+starts with its label as in training data, and y_ptr gets the labels. Returns the number of rows, or -1 without
+allocating anything if one of them is not an array.
+*/
+static int php_svm_get_rows_from_array(zval *arr, struct svm_node **x_space_ptr, struct svm_node ***x_ptr, double **y_ptr)
+{
+	struct svm_node *x_space, **x;
+	double *y = NULL;
+	zval *row;
+	int rows, elements, i, j;
+
+	rows = zend_hash_num_elements(Z_ARRVAL_P(arr));
+	ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(arr), row) {
+		if (Z_TYPE_P(row) != IS_ARRAY) {
+			return -1;
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	/* One terminator per row on top of the feature values */
+	elements = _php_count_values(arr) + rows;
+	x_space = safe_emalloc(elements, sizeof(struct svm_node), 0);
+	x = safe_emalloc(rows, sizeof(struct svm_node *), 0);
+	if (y_ptr) {
+		/* Rows without even a label count as 0 */
+		y = ecalloc(rows > 0 ? rows : 1, sizeof(double));
+	}
+
+	i = 0;
+	j = 0;
+	ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(arr), row) {
+		x[i] = &x_space[j];
+		j += php_svm_fill_nodes(row, &x_space[j], y ? &y[i] : NULL);
+		i++;
+	} ZEND_HASH_FOREACH_END();
+
+	*x_space_ptr = x_space;
+	*x_ptr = x;
+	if (y_ptr) {
+		*y_ptr = y;
+	}
+	return rows;
+}
+/* }}} */
+
+/* {{{ static void php_svm_values_to_array(zval *arr, const double *values, int n)
+Initialise arr as a list of n decision values.
+*/
+static void php_svm_values_to_array(zval *arr, const double *values, int n)
+{
+	int i;
+
+	array_init_size(arr, n);
+	for (i = 0; i < n; i++) {
+		add_next_index_double(arr, values[i]);
+	}
+}
+/* }}} */
+
+/* {{{ static double php_svm_model_score(php_svm_model_object *intern_model, struct svm_node **x, const double *y, int rows)
+Accuracy of the model over labelled rows, or for regression the mean squared error, as crossvalidate reports.
+*/
+static double php_svm_model_score(php_svm_model_object *intern_model, struct svm_node **x, const double *y, int rows)
+{
+	double *labels, score = 0;
+	int svr = intern_model->model->param.svm_type == EPSILON_SVR || intern_model->model->param.svm_type == NU_SVR;
+	int i;
+
+	if (rows <= 0) {
+		return 0;
+	}
+
+	labels = safe_emalloc(rows, sizeof(double), 0);
+	php_svm_predict_batch(intern_model->model, &intern_model->predictor, &intern_model->scratch, x, rows, labels, NULL);
+	for (i = 0; i < rows; i++) {
+		if (svr) {
+			score += (labels[i] - y[i]) * (labels[i] - y[i]);
+		} else if (labels[i] == y[i]) {
+			score++;
+		}
+	}
+	efree(labels);
+
+	return score / rows;
+}
+/* }}} */
+
 /* ---- END HELPER FUNCS ---- */
 
 
@@ -588,6 +1089,9 @@ PHP_METHOD(svm, __construct)
 	php_svm_set_long_attribute(intern, phpsvm_svm_type, C_SVC);
 	php_svm_set_long_attribute(intern, phpsvm_kernel_type, RBF);
 	php_svm_set_long_attribute(intern, phpsvm_degree, 3);
+	php_svm_set_long_attribute(intern, phpsvm_approx_rank, 0);
+	php_svm_set_long_attribute(intern, phpsvm_threads, 0);
+	php_svm_set_long_attribute(intern, phpsvm_probability_folds, 5);
 	php_svm_set_double_attribute(intern, phpsvm_gamma, 0);
 	php_svm_set_double_attribute(intern, phpsvm_coef0, 0);
 	php_svm_set_double_attribute(intern, phpsvm_nu, 0.5);
@@ -619,6 +1123,9 @@ PHP_METHOD(svm, getOptions)
 	add_index_long(return_value, phpsvm_svm_type, intern->param.svm_type);
 	add_index_long(return_value, phpsvm_kernel_type, intern->param.kernel_type);
 	add_index_long(return_value, phpsvm_degree, intern->param.degree);
+	add_index_long(return_value, phpsvm_approx_rank, intern->approx_rank);
+	add_index_long(return_value, phpsvm_threads, intern->threads);
+	add_index_long(return_value, phpsvm_probability_folds, intern->probability_folds);
 	add_index_long(return_value, phpsvm_coef0, intern->param.shrinking);
 	add_index_long(return_value, phpsvm_probability, intern->param.probability == 1 ? TRUE : FALSE);
 	add_index_long(return_value, phpsvm_shrinking, intern->param.shrinking == 1 ? TRUE : FALSE);
@@ -751,8 +1258,9 @@ PHP_METHOD(svm, crossvalidate)
 	intern = php_svm_fetch_svm_object(Z_OBJ_P(getThis()));
 	
 	array_init(data_p);
-	int ret = php_svm_get_data_from_param(intern, zparam, &data_p);
+	int ret = php_svm_get_data_from_param(intern->last_error, zparam, &data_p);
 	if(ret != TRUE) {
+		zval_dtor(&data);
 		SVM_THROW_LAST_ERROR("Could not load data", 234);
 	}
 
@@ -764,6 +1272,7 @@ PHP_METHOD(svm, crossvalidate)
 	}
 	
  	target = emalloc(problem->l * sizeof(double));
+	php_svm_use_training_options(intern);
 	svm_cross_validation(problem, &(intern->param), nrfolds, target);
 	if(intern->param.svm_type == EPSILON_SVR || intern->param.svm_type == NU_SVR) {
 		for(i=0;i<problem->l;i++) {
@@ -829,7 +1338,7 @@ PHP_METHOD(svm, train)
 		SVM_THROW("Weights can only be supplied for C_SyVC training", 424);
 	}
 	array_init(data_p);
-	int ret = php_svm_get_data_from_param(intern, zparam, &data_p);
+	int ret = php_svm_get_data_from_param(intern->last_error, zparam, &data_p);
 	if(ret != TRUE) {
 		zval_dtor(data_p);
 		SVM_THROW_LAST_ERROR("Could not load data", 234);
@@ -894,27 +1403,25 @@ PHP_METHOD(svm, train)
 
 /* ---- START SVMMODEL ---- */
 
-/** {{{ SvmModel::__construct([string filename])
+/** {{{ SvmModel::__construct([string|resource file])
 	Constructs an svm model
 */ 
 PHP_METHOD(svmmodel, __construct)
 {
 	php_svm_model_object *intern;
-	char *filename = NULL;
-	size_t filename_len;
+	zval *zfile = NULL;
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS(), "|s!", &filename, &filename_len) == FAILURE) {
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "|z!", &zfile) == FAILURE) {
 		SVM_THROW("Invalid parameters passed to constructor", 154);
 	}
 	
-	if (!filename) {
+	if (!zfile) {
 		return;
 	}
 
 	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
-	intern->model = svm_load_model(filename);
 	
-	if (!intern->model) {
+	if (!php_svm_model_load_file(intern, zfile)) {
 		SVM_THROW("Failed to load the model", 1233);	
 	}
 	
@@ -922,23 +1429,21 @@ PHP_METHOD(svmmodel, __construct)
 }
 /* }}} */
 
-/** {{{ SvmModel::load(string filename)
-	Loads the svm model from a file
+/** {{{ SvmModel::load(string|resource file)
+	Loads the svm model from a file or a stream
 */
 PHP_METHOD(svmmodel, load)
 {
 	php_svm_model_object *intern;
-	char *filename = NULL;
-	size_t filename_len;
+	zval *zfile;
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS(), "s", &filename, &filename_len) == FAILURE) {
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z", &zfile) == FAILURE) {
 		return;
 	}
 
 	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
-	intern->model = svm_load_model(filename);
 	
-	if (!intern->model) {
+	if (!php_svm_model_load_file(intern, zfile)) {
 		SVM_THROW("Failed to load the model", 1233);
 	}
 	
@@ -946,16 +1451,38 @@ PHP_METHOD(svmmodel, load)
 }
 /* }}} */
 
-/** {{{ SvmModel::save(string filename)
-	Saves the svm model to a file
+/** {{{ SvmModel::loadFromString(string data)
+	Loads the svm model from a string holding a saved model in any of the formats load reads
+*/
+PHP_METHOD(svmmodel, loadFromString)
+{
+	php_svm_model_object *intern;
+	char *data;
+	size_t data_len;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "s", &data, &data_len) == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+
+	if (!php_svm_model_load_string(intern, data, data_len)) {
+		SVM_THROW("Failed to load the model", 1233);
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/** {{{ SvmModel::save(string|resource file)
+	Saves the svm model to a file or a stream
 */
 PHP_METHOD(svmmodel, save)
 {
 	php_svm_model_object *intern;
-	char *filename;
-	size_t filename_len;
+	zval *zfile;
 	
-	if (zend_parse_parameters(ZEND_NUM_ARGS(), "s", &filename, &filename_len) == FAILURE) {
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z", &zfile) == FAILURE) {
 		return;
 	}
 
@@ -965,7 +1492,7 @@ PHP_METHOD(svmmodel, save)
 		SVM_THROW("The object does not contain a model", 2321);
 	}
 	
-	if (svm_save_model(filename, intern->model) != 0) {
+	if (!php_svm_model_save_file(intern, zfile, 0)) {
 		SVM_THROW("Failed to save the model", 121);
 	}
 		
@@ -973,40 +1500,279 @@ PHP_METHOD(svmmodel, save)
 }
 /* }}} */
 
-
-/** {{{ SvmModel::getSvmType()
-	Gets the type of SVM the model was trained with
+/** {{{ SvmModel::saveBinary(string|resource file)
+	Saves the svm model to a file or a stream in the binary format, which loads by mapping the file rather than
+	parsing it
 */
-PHP_METHOD(svmmodel, getSvmType)
+PHP_METHOD(svmmodel, saveBinary)
 {
 	php_svm_model_object *intern;
-	int svm_type;
-	
-	if (zend_parse_parameters_none() == FAILURE) {
+	zval *zfile;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z", &zfile) == FAILURE) {
 		return;
-    }
+	}
 
 	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
-	if(!intern->model) {
-		SVM_THROW("No model available", 106);
+
+	if (!intern->model) {
+		SVM_THROW("The object does not contain a model", 2321);
 	}
-	
-	svm_type = svm_get_svm_type(intern->model);
-	
-	RETURN_LONG(svm_type);
-}
-/* }}} */
 
+	if (intern->rff || intern->compact) {
+		SVM_THROW("The binary format holds models with double precision SVs only", 108);
+	}
 
+	if (!php_svm_model_save_file(intern, zfile, 1)) {
+		SVM_THROW("Failed to save the model", 121);
+	}
 
-/** {{{ SvmModel::getNrClass()
-	Gets the number of classes the model was trained with. Note that for a regression
-	or 1 class model 2 is returned.
+	RETURN_TRUE;
+}
+/* }}} */
+
+/** {{{ SvmModel::saveToString([bool binary = false])
+	Returns the svm model as a string, in the format save writes or, if binary is true, the one saveBinary writes
 */
-PHP_METHOD(svmmodel, getNrClass)
+PHP_METHOD(svmmodel, saveToString)
 {
 	php_svm_model_object *intern;
-	int nr_classes;
+	zend_string *contents;
+	zend_bool binary = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "|b", &binary) == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+
+	if (!intern->model) {
+		SVM_THROW("The object does not contain a model", 2321);
+	}
+
+	if (binary && (intern->rff || intern->compact)) {
+		SVM_THROW("The binary format holds models with double precision SVs only", 108);
+	}
+
+	contents = php_svm_model_save_string(intern, binary);
+	if (!contents) {
+		SVM_THROW("Failed to save the model", 121);
+	}
+
+	RETURN_STR(contents);
+}
+/* }}} */
+
+/** {{{ SvmModel::__serialize()
+	Returns the model for serialize(), in the binary format, or for models with other storage in their own format
+*/
+PHP_METHOD(svmmodel, __serialize)
+{
+	php_svm_model_object *intern;
+	zend_string *contents;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+
+	array_init(return_value);
+	if (!intern->model) {
+		return;
+	}
+
+	contents = php_svm_model_save_string(intern, !intern->rff && !intern->compact);
+	if (!contents) {
+		SVM_THROW("Failed to save the model", 121);
+	}
+	add_assoc_str(return_value, "model", contents);
+}
+/* }}} */
+
+/** {{{ SvmModel::__unserialize(array data)
+	Restores a model returned by __serialize
+*/
+PHP_METHOD(svmmodel, __unserialize)
+{
+	php_svm_model_object *intern;
+	zval *data, *zmodel;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "a", &data) == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+
+	zmodel = zend_hash_str_find(Z_ARRVAL_P(data), "model", sizeof("model") - 1);
+	if (!zmodel) {
+		return;
+	}
+	if (Z_TYPE_P(zmodel) != IS_STRING || !php_svm_model_load_string(intern, Z_STRVAL_P(zmodel), Z_STRLEN_P(zmodel))) {
+		SVM_THROW("Failed to load the model", 1233);
+	}
+}
+/* }}} */
+
+/** {{{ SvmModel::fromCache(string filename)
+	Returns the model in a file, kept in memory across requests and loaded again when the file changes
+*/
+PHP_METHOD(svmmodel, fromCache)
+{
+	php_svm_model_object *intern;
+	php_svm_store *store;
+	php_svm_store_entry *entry, *loaded;
+	php_svm_store_stat stat;
+	php_stream_statbuf ssb;
+	zend_bool unsupported = 0;
+	size_t max_memory, path_len;
+	char *filename, *path;
+	size_t filename_len;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "p", &filename, &filename_len) == FAILURE) {
+		return;
+	}
+
+	/* Relative names are resolved, so that the same name from another directory is another model */
+	path = expand_filepath(filename, NULL);
+	if (!path) {
+		SVM_THROW("Failed to load the model", 1233);
+	}
+	path_len = strlen(path);
+
+	if (!SVM_G(model_store)) {
+		SVM_G(model_store) = php_svm_store_new();
+	}
+	store = SVM_G(model_store);
+	max_memory = SVM_G(model_cache_size) > 0 ? (size_t)SVM_G(model_cache_size) : 0;
+	entry = php_svm_store_find(store, path, path_len);
+
+	/* The file has to be looked at again, not at what an earlier stat in this request saw */
+	php_clear_stat_cache(0, path, path_len);
+	if (php_stream_stat_path_ex(path, PHP_STREAM_URL_STAT_QUIET, &ssb, NULL) != 0) {
+		efree(path);
+		if (entry) {
+			php_svm_store_remove(store, entry);
+		}
+		SVM_THROW("Failed to load the model", 1233);
+	}
+	stat.mtime = (zend_long)ssb.sb.st_mtime;
+	stat.size = (zend_long)ssb.sb.st_size;
+	stat.inode = (zend_ulong)ssb.sb.st_ino;
+	stat.device = (zend_ulong)ssb.sb.st_dev;
+
+	if (entry && entry->stat.mtime == stat.mtime && entry->stat.size == stat.size && entry->stat.inode == stat.inode &&
+		entry->stat.device == stat.device) {
+		store->hits++;
+		php_svm_store_use(store, entry);
+		entry->refcount++;
+	} else {
+		if (entry) {
+			store->reloads++;
+		} else {
+			store->misses++;
+		}
+
+		loaded = php_svm_model_store_open(path, path_len, &stat, &unsupported);
+		if (loaded) {
+			php_svm_store_put(store, loaded, max_memory);
+			entry = loaded;
+		} else if (entry && !unsupported) {
+			/* A file that is being replaced may not read yet, so the last model read stays in use until it does */
+			php_svm_store_use(store, entry);
+			entry->refcount++;
+		} else {
+			efree(path);
+			if (unsupported) {
+				if (entry) {
+					php_svm_store_remove(store, entry);
+				}
+				SVM_THROW("The model cache holds models with double precision SVs only", 108);
+			}
+			SVM_THROW("Failed to load the model", 1233);
+		}
+	}
+	efree(path);
+
+	/* The budget may have been lowered since the models were stored */
+	php_svm_store_trim(store, max_memory);
+
+	/* The object only gets its own scratch buffers, the model and predictor stay with the entry */
+	object_init_ex(return_value, php_svm_model_sc_entry);
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(return_value));
+	intern->model = entry->model;
+	intern->predictor = entry->predictor;
+	intern->shared = 1;
+	intern->store_entry = entry;
+	php_svm_scratch_init(&intern->scratch, intern->model, &intern->predictor);
+}
+/* }}} */
+
+/** {{{ SvmModel::preloaded(string name)
+	Returns a model loaded at startup by the svm.preload ini setting
+*/
+PHP_METHOD(svmmodel, preloaded)
+{
+	php_svm_model_object *intern;
+	php_svm_preload *preload;
+	zend_string *name;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &name) == FAILURE) {
+		return;
+	}
+
+	for (preload = php_svm_preloaded; preload; preload = preload->next) {
+		if (zend_string_equals(preload->name, name)) {
+			break;
+		}
+	}
+	if (!preload) {
+		SVM_THROW("No model was preloaded under this name", 1233);
+	}
+
+	/* The object only gets its own scratch buffers, everything else is shared by all workers */
+	object_init_ex(return_value, php_svm_model_sc_entry);
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(return_value));
+	intern->model = preload->model;
+	intern->predictor = preload->predictor;
+	intern->shared = 1;
+	php_svm_scratch_init(&intern->scratch, intern->model, &intern->predictor);
+}
+/* }}} */
+
+/** {{{ SvmModel::getSvmType()
+	Gets the type of SVM the model was trained with
+*/
+PHP_METHOD(svmmodel, getSvmType)
+{
+	php_svm_model_object *intern;
+	int svm_type;
+	
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+    }
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if(!intern->model) {
+		SVM_THROW("No model available", 106);
+	}
+	
+	svm_type = svm_get_svm_type(intern->model);
+	
+	RETURN_LONG(svm_type);
+}
+/* }}} */
+
+
+
+/** {{{ SvmModel::getNrClass()
+	Gets the number of classes the model was trained with. Note that for a regression
+	or 1 class model 2 is returned.
+*/
+PHP_METHOD(svmmodel, getNrClass)
+{
+	php_svm_model_object *intern;
+	int nr_classes;
 	
 	if (zend_parse_parameters_none() == FAILURE) {
 		return;
@@ -1113,6 +1879,7 @@ PHP_METHOD(svmmodel, getSvrProbability)
 PHP_METHOD(svmmodel, predict)
 {
 	php_svm_model_object *intern;
+	php_svm_cache_entry *entry;
 	double predict_label;
 	struct svm_node *x;
 	zval *arr;
@@ -1127,26 +1894,167 @@ PHP_METHOD(svmmodel, predict)
 		SVM_THROW("No model available to classify with", 106);
 	}
 	
-	x = php_svm_get_data_from_array(arr);
-	predict_label = svm_predict(intern->model, x);
-	efree(x);
+	x = php_svm_get_data_from_array(&intern->scratch, arr);
+	entry = php_svm_cache_find(&intern->cache, x, PHP_SVM_CACHE_VALUES);
+	if (entry) {
+		RETURN_DOUBLE(entry->label);
+	}
+
+	predict_label = php_svm_predict_values(intern->model, &intern->predictor, &intern->scratch, x);
+	php_svm_model_cache_values(intern, x, predict_label);
 	
 	RETURN_DOUBLE(predict_label);
 }
 
 /* }}} */
 
+/** {{{ SvmModel::predictBatch(array rows)
+	Predicts a label for each row of an array of rows, returning them in the same order.
+	All rows are converted up front and scored together, which is much faster than calling
+	predict() in a loop.
+*/
+PHP_METHOD(svmmodel, predictBatch)
+{
+	php_svm_model_object *intern;
+	struct svm_node *x_space, **x;
+	double *labels;
+	zval *arr;
+	int rows, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "a", &arr) == FAILURE) {
+	    return;
+	}
+	
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if(!intern->model) {
+		SVM_THROW("No model available to classify with", 106);
+	}
+
+	rows = php_svm_get_rows_from_array(arr, &x_space, &x, NULL);
+	if (rows < 0) {
+		SVM_THROW("Each row must be an array of index => value pairs", 107);
+	}
+	labels = safe_emalloc(rows, sizeof(double), 0);
+
+	php_svm_predict_batch(intern->model, &intern->predictor, &intern->scratch, x, rows, labels, NULL);
+
+	array_init_size(return_value, rows);
+	for (i = 0; i < rows; i++) {
+		add_next_index_double(return_value, labels[i]);
+	}
+
+	efree(labels);
+	efree(x);
+	efree(x_space);
+}
+/* }}} */
+
+/** {{{ SvmModel::predictValues(array data [, array &values])
+	Predicts based on the model, filling values with the raw decision values from the same pass: one per pair
+	of classes for classification, in the order svm_predict_values uses, or a single value otherwise.
+*/
+PHP_METHOD(svmmodel, predictValues)
+{
+	php_svm_model_object *intern;
+	php_svm_cache_entry *entry;
+	const double *dec_values;
+	double predict_label;
+	struct svm_node *x;
+	zval *arr;
+	zval *retarr = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "a|z/", &arr, &retarr) == FAILURE) {
+	    return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if(!intern->model) {
+		SVM_THROW("No model available to classify with", 106);
+	}
+
+	x = php_svm_get_data_from_array(&intern->scratch, arr);
+	entry = php_svm_cache_find(&intern->cache, x, PHP_SVM_CACHE_VALUES);
+	if (entry) {
+		predict_label = entry->label;
+		dec_values = entry->dec_values;
+	} else {
+		predict_label = php_svm_predict_values(intern->model, &intern->predictor, &intern->scratch, x);
+		php_svm_model_cache_values(intern, x, predict_label);
+		dec_values = intern->scratch.dec_values;
+	}
+
+	if (retarr != NULL) {
+		zval_dtor(retarr);
+		php_svm_values_to_array(retarr, dec_values, intern->predictor.nr_dec);
+	}
+
+	RETURN_DOUBLE(predict_label);
+}
+/* }}} */
+
+/** {{{ SvmModel::predictValuesBatch(array rows [, array &values])
+	predictBatch() that also fills values with the decision values of each row, as predictValues() has them.
+*/
+PHP_METHOD(svmmodel, predictValuesBatch)
+{
+	php_svm_model_object *intern;
+	struct svm_node *x_space, **x;
+	double *labels, *values;
+	zval *arr, row;
+	zval *retarr = NULL;
+	int rows, nr_dec, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "a|z/", &arr, &retarr) == FAILURE) {
+	    return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if(!intern->model) {
+		SVM_THROW("No model available to classify with", 106);
+	}
+
+	rows = php_svm_get_rows_from_array(arr, &x_space, &x, NULL);
+	if (rows < 0) {
+		SVM_THROW("Each row must be an array of index => value pairs", 107);
+	}
+	nr_dec = intern->predictor.nr_dec;
+	labels = safe_emalloc(rows, sizeof(double), 0);
+	values = safe_emalloc(rows, nr_dec * sizeof(double), 0);
+
+	php_svm_predict_batch(intern->model, &intern->predictor, &intern->scratch, x, rows, labels, values);
+
+	array_init_size(return_value, rows);
+	for (i = 0; i < rows; i++) {
+		add_next_index_double(return_value, labels[i]);
+	}
+
+	if (retarr != NULL) {
+		zval_dtor(retarr);
+		array_init_size(retarr, rows);
+		for (i = 0; i < rows; i++) {
+			php_svm_values_to_array(&row, values + (size_t)i * nr_dec, nr_dec);
+			add_next_index_zval(retarr, &row);
+		}
+	}
+
+	efree(values);
+	efree(labels);
+	efree(x);
+	efree(x_space);
+}
+/* }}} */
+
 /** {{{ SvmModel::predict_probability(array data, array probabilities)
 	Predicts based on the model
 */
 PHP_METHOD(svmmodel, predict_probability)
 {
 	php_svm_model_object *intern;
+	php_svm_cache_entry *entry;
 	double predict_probability;
 	int nr_classes, i;
 	double *estimates;
 	struct svm_node *x;
-	int *labels;
 	zval *arr; 
 	zval *retarr = NULL;
 	
@@ -1160,29 +2068,417 @@ PHP_METHOD(svmmodel, predict_probability)
 		SVM_THROW("No model available to classify with", 106);
 	}
 
-	x = php_svm_get_data_from_array(arr);
+	x = php_svm_get_data_from_array(&intern->scratch, arr);
 	nr_classes = svm_get_nr_class(intern->model);
-	estimates = safe_emalloc(nr_classes, sizeof(double), 0);
-	labels = safe_emalloc(nr_classes, sizeof(int), 0);
-	predict_probability = svm_predict_probability(intern->model, x, estimates);
+	entry = php_svm_cache_find(&intern->cache, x, PHP_SVM_CACHE_PROBABILITY);
+	if (entry) {
+		predict_probability = entry->prob_label;
+		estimates = entry->prob_estimates;
+	} else {
+		predict_probability = php_svm_predict_probability(intern->model, &intern->predictor, &intern->scratch, x);
+		estimates = intern->scratch.prob_estimates;
+
+		entry = php_svm_cache_store(&intern->cache, x, intern->predictor.nr_dec, nr_classes);
+		if (entry) {
+			entry->prob_label = predict_probability;
+			memcpy(entry->prob_estimates, estimates, nr_classes * sizeof(double));
+			entry->flags |= PHP_SVM_CACHE_PROBABILITY;
+		}
+	}
 	
 	if (retarr != NULL) {
 		zval_dtor(retarr);
 		array_init(retarr);
-		svm_get_labels(intern->model, labels);
-		for (i = 0; i < nr_classes; ++i) {
-			add_index_double(retarr, labels[i], estimates[i]);
+		/* Regression and one-class models have no labels to report */
+		if (intern->model->label) {
+			for (i = 0; i < nr_classes; ++i) {
+				add_index_double(retarr, intern->model->label[i], estimates[i]);
+			}
 		}
 	}
 	
-	efree(estimates);
-	efree(labels);
-	efree(x);
-	
 	RETURN_DOUBLE(predict_probability);
 }
 /* }}} */
 
+/** {{{ SvmModel::setCache(int entries [, int max_memory])
+	Caches the results of predict(), predictValues() and predict_probability() for up to entries distinct
+	rows, and within max_memory bytes if given, dropping the least recently used rows first. Rows must match
+	exactly, index for index and value for value, to hit. Passing 0 entries turns the cache off. Any cached
+	results are dropped, as they are whenever the model changes, and the hit and miss counts start over.
+*/
+PHP_METHOD(svmmodel, setCache)
+{
+	php_svm_model_object *intern;
+	zend_long entries, max_memory = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "l|l", &entries, &max_memory) == FAILURE) {
+		return;
+	}
+
+	if (entries < 0 || entries > INT_MAX) {
+		SVM_THROW("The number of cache entries must be between 0 and INT_MAX", 108);
+	}
+
+	if (max_memory < 0) {
+		SVM_THROW("The cache memory limit must not be negative", 108);
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	intern->cache.hits = 0;
+	intern->cache.misses = 0;
+	php_svm_cache_configure(&intern->cache, (int)entries, (size_t)max_memory);
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/** {{{ SvmModel::getCacheStats()
+	Returns the size, limits and hit and miss counts of the prediction cache.
+*/
+PHP_METHOD(svmmodel, getCacheStats)
+{
+	php_svm_model_object *intern;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+
+	array_init(return_value);
+	add_assoc_long(return_value, "entries", intern->cache.entries);
+	add_assoc_long(return_value, "memory", (zend_long)intern->cache.memory);
+	add_assoc_long(return_value, "max_entries", intern->cache.max_entries);
+	add_assoc_long(return_value, "max_memory", (zend_long)intern->cache.max_memory);
+	add_assoc_long(return_value, "hits", intern->cache.hits);
+	add_assoc_long(return_value, "misses", intern->cache.misses);
+}
+/* }}} */
+
+/** {{{ SvmModel::compress(int|float target [, array validation [, array &report]])
+	Builds a smaller model approximating this one. An int target is the number of SVs to keep, a float is
+	the largest acceptable change of any decision value over the validation rows, or over the SVs if no
+	rows are given. The report array is filled in with the SV counts and the drift of the decision values.
+*/
+PHP_METHOD(svmmodel, compress)
+{
+	php_svm_model_object *intern, *intern_return;
+	php_svm_compress_report report;
+	struct svm_model *compressed;
+	struct svm_node *x_space = NULL, **x = NULL;
+	zval *ztarget, *validation = NULL, *zreport = NULL;
+	zend_long target = 0;
+	double max_error = 0;
+	int rows = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z|a!z/", &ztarget, &validation, &zreport) == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if (!intern->model) {
+		SVM_THROW("No model available", 106);
+	}
+
+	if (intern->model->param.kernel_type == PRECOMPUTED) {
+		SVM_THROW("Models with a precomputed kernel can't be compressed", 108);
+	}
+
+	if (intern->rff) {
+		SVM_THROW("Random feature models can't be compressed", 108);
+	}
+
+	if (intern->compact) {
+		SVM_THROW("Models with float or int8 storage can't be compressed", 108);
+	}
+
+	if (Z_TYPE_P(ztarget) == IS_LONG) {
+		target = Z_LVAL_P(ztarget);
+		if (target <= 0 || target >= intern->model->l) {
+			SVM_THROW("The target must be between 1 and the number of SVs of the model", 108);
+		}
+	} else if (Z_TYPE_P(ztarget) == IS_DOUBLE) {
+		max_error = Z_DVAL_P(ztarget);
+		if (!(max_error > 0)) {
+			SVM_THROW("The maximum error must be positive", 108);
+		}
+	} else {
+		SVM_THROW("The target must be a number of SVs or a maximum error", 108);
+	}
+
+	if (validation) {
+		rows = php_svm_get_rows_from_array(validation, &x_space, &x, NULL);
+		if (rows < 0) {
+			SVM_THROW("Each row must be an array of index => value pairs", 107);
+		}
+	}
+
+	compressed = php_svm_compress(intern->model, (int)target, max_error, x, rows, &report);
+
+	if (x_space) {
+		efree(x_space);
+		efree(x);
+	}
+
+	if (zreport != NULL) {
+		zval_dtor(zreport);
+		array_init(zreport);
+		add_assoc_long(zreport, "original_svs", report.original_svs);
+		add_assoc_long(zreport, "svs", report.svs);
+		add_assoc_double(zreport, "max_drift", report.drift.max_drift);
+		add_assoc_double(zreport, "mean_drift", report.drift.mean_drift);
+		/* Labels are only meaningful for classification and one-class models */
+		if (intern->model->param.svm_type != EPSILON_SVR && intern->model->param.svm_type != NU_SVR) {
+			add_assoc_double(zreport, "label_agreement", report.drift.label_agreement);
+		}
+	}
+
+	object_init_ex(return_value, php_svm_model_sc_entry);
+	intern_return = php_svm_fetch_svm_model_object(Z_OBJ_P(return_value));
+	intern_return->model = compressed;
+	php_svm_model_prepare(intern_return);
+}
+/* }}} */
+
+/** {{{ SvmModel::toRandomFeatures([int dimension [, int seed [, array validation [, array &report]]]])
+	Approximates an RBF model with a random Fourier feature map of the given dimension, so that predictions
+	cost one pass over the features of the row rather than a kernel per SV. The same seed always gives the same
+	features. The report array is filled in with the drift of the decision values over the validation rows, or
+	over the SVs if no rows are given.
+*/
+PHP_METHOD(svmmodel, toRandomFeatures)
+{
+	php_svm_model_object *intern, *intern_return;
+	php_svm_drift_report report;
+	php_svm_predictor pred;
+	php_svm_rff *rff;
+	struct svm_model *approx;
+	struct svm_node *x_space = NULL, **x = NULL;
+	zval *validation = NULL, *zreport = NULL;
+	zend_long dimension = 1024, seed = 0;
+	int rows = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "|lla!z/", &dimension, &seed, &validation, &zreport) == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if (!intern->model) {
+		SVM_THROW("No model available", 106);
+	}
+
+	if (intern->model->param.kernel_type != RBF || intern->rff || intern->model->l == 0) {
+		SVM_THROW("Only models with an RBF kernel can be approximated by random features", 108);
+	}
+
+	if (intern->compact) {
+		SVM_THROW("Models with float or int8 storage can't be approximated by random features", 108);
+	}
+
+	if (dimension <= 0 || dimension > PHP_SVM_RFF_MAX_DIMENSION) {
+		SVM_THROW("The dimension must be between 1 and 4096", 108);
+	}
+
+	if (validation) {
+		rows = php_svm_get_rows_from_array(validation, &x_space, &x, NULL);
+		if (rows < 0) {
+			SVM_THROW("Each row must be an array of index => value pairs", 107);
+		}
+	}
+
+	approx = php_svm_rff_fit(intern->model, (int)dimension, seed, &rff);
+
+	if (zreport != NULL) {
+		php_svm_predictor_init(&pred, approx);
+		pred.rff = rff;
+		if (x) {
+			php_svm_drift(intern->model, &intern->predictor, approx, &pred, x, rows, &report);
+		} else {
+			php_svm_drift(intern->model, &intern->predictor, approx, &pred, intern->model->SV, intern->model->l, &report);
+		}
+		php_svm_predictor_free(&pred);
+
+		zval_dtor(zreport);
+		array_init(zreport);
+		add_assoc_long(zreport, "dimension", dimension);
+		add_assoc_double(zreport, "max_drift", report.max_drift);
+		add_assoc_double(zreport, "mean_drift", report.mean_drift);
+		if (intern->model->param.svm_type != EPSILON_SVR && intern->model->param.svm_type != NU_SVR) {
+			add_assoc_double(zreport, "label_agreement", report.label_agreement);
+		}
+	}
+
+	if (x_space) {
+		efree(x_space);
+		efree(x);
+	}
+
+	object_init_ex(return_value, php_svm_model_sc_entry);
+	intern_return = php_svm_fetch_svm_model_object(Z_OBJ_P(return_value));
+	intern_return->model = approx;
+	intern_return->rff = rff;
+	php_svm_model_prepare(intern_return);
+}
+/* }}} */
+
+/** {{{ SvmModel::toFloat32([bool float_coef [, array validation [, array &report]]])
+	Returns a copy of the model storing its SVs as floats, and its coefficients too if float_coef is set, which
+	takes a half to a quarter of the memory. Kernels still accumulate in double. The report array is filled in
+	with the memory both models need to predict and the drift of the decision values over the validation rows,
+	or over the SVs if no rows are given. The copy saves and loads in its float form.
+*/
+PHP_METHOD(svmmodel, toFloat32)
+{
+	php_svm_model_object *intern, *intern_return;
+	php_svm_drift_report report;
+	php_svm_compact *compact;
+	struct svm_node *x_space = NULL, **x = NULL;
+	zval *validation = NULL, *zreport = NULL;
+	zend_bool float_coef = 0;
+	int rows = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "|ba!z/", &float_coef, &validation, &zreport) == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if (!intern->model) {
+		SVM_THROW("No model available", 106);
+	}
+
+	if (intern->model->param.kernel_type == PRECOMPUTED || intern->rff || intern->compact || intern->model->l == 0) {
+		SVM_THROW("Only models with support vectors in double precision can be converted", 108);
+	}
+
+	if (validation) {
+		rows = php_svm_get_rows_from_array(validation, &x_space, &x, NULL);
+		if (rows < 0) {
+			SVM_THROW("Each row must be an array of index => value pairs", 107);
+		}
+	}
+
+	object_init_ex(return_value, php_svm_model_sc_entry);
+	intern_return = php_svm_fetch_svm_model_object(Z_OBJ_P(return_value));
+	intern_return->model = php_svm_compact_fit(intern->model, PHP_SVM_STORAGE_FLOAT32, float_coef, &compact);
+	intern_return->compact = compact;
+	php_svm_model_prepare(intern_return);
+
+	if (zreport != NULL) {
+		if (x) {
+			php_svm_drift(intern->model, &intern->predictor, intern_return->model, &intern_return->predictor, x, rows, &report);
+		} else {
+			php_svm_drift(intern->model, &intern->predictor, intern_return->model, &intern_return->predictor, intern->model->SV, intern->model->l, &report);
+		}
+
+		zval_dtor(zreport);
+		array_init(zreport);
+		add_assoc_long(zreport, "memory_before", (zend_long)php_svm_model_memory(intern->model, &intern->predictor));
+		add_assoc_long(zreport, "memory_after", (zend_long)php_svm_model_memory(intern_return->model, &intern_return->predictor));
+		add_assoc_double(zreport, "max_drift", report.max_drift);
+		add_assoc_double(zreport, "mean_drift", report.mean_drift);
+		if (intern->model->param.svm_type != EPSILON_SVR && intern->model->param.svm_type != NU_SVR) {
+			add_assoc_double(zreport, "label_agreement", report.label_agreement);
+		}
+	}
+
+	if (x_space) {
+		efree(x_space);
+		efree(x);
+	}
+}
+/* }}} */
+
+/** {{{ SvmModel::toInt8([bool float_coef [, mixed heldout [, array &report]]])
+	Returns a copy of the model storing its SVs as int8 with a scale factor per feature, or per SV for sparse
+	models, and its coefficients as floats if float_coef is set. The report array is filled in with the memory
+	both models need to predict and the drift of the decision values over the held out data, or over the SVs if
+	there is none. The held out data is labelled as for training, a file, stream or array, and the report then
+	also compares the accuracy of both models on it, or their mean squared error for regression. The copy saves
+	and loads in its int8 form.
+*/
+PHP_METHOD(svmmodel, toInt8)
+{
+	php_svm_model_object *intern, *intern_return;
+	php_svm_drift_report report;
+	php_svm_compact *compact;
+	struct svm_node *x_space = NULL, **x = NULL;
+	zval *heldout = NULL, *zreport = NULL;
+	double *y = NULL;
+	zend_bool float_coef = 0;
+	int rows = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "|bz!z/", &float_coef, &heldout, &zreport) == FAILURE) {
+		return;
+	}
+
+	intern = php_svm_fetch_svm_model_object(Z_OBJ_P(getThis()));
+	if (!intern->model) {
+		SVM_THROW("No model available", 106);
+	}
+
+	if (intern->model->param.kernel_type == PRECOMPUTED || intern->rff || intern->compact || intern->model->l == 0) {
+		SVM_THROW("Only models with support vectors in double precision can be converted", 108);
+	}
+
+	if (heldout) {
+		char last_error[SVM_ERROR_MSG_SIZE] = "";
+		zval data, *data_p = &data;
+
+		array_init(data_p);
+		if (php_svm_get_data_from_param(last_error, heldout, &data_p) != TRUE) {
+			zval_dtor(&data);
+			SVM_THROW(strlen(last_error) ? last_error : "Could not load data", 234);
+		}
+		rows = php_svm_get_rows_from_array(data_p, &x_space, &x, &y);
+		zval_dtor(&data);
+		if (rows < 0) {
+			SVM_THROW("Each row must be an array of a label and index => value pairs", 107);
+		}
+	}
+
+	object_init_ex(return_value, php_svm_model_sc_entry);
+	intern_return = php_svm_fetch_svm_model_object(Z_OBJ_P(return_value));
+	intern_return->model = php_svm_compact_fit(intern->model, PHP_SVM_STORAGE_INT8, float_coef, &compact);
+	intern_return->compact = compact;
+	php_svm_model_prepare(intern_return);
+
+	if (zreport != NULL) {
+		zend_bool svr = intern->model->param.svm_type == EPSILON_SVR || intern->model->param.svm_type == NU_SVR;
+
+		if (x) {
+			php_svm_drift(intern->model, &intern->predictor, intern_return->model, &intern_return->predictor, x, rows, &report);
+		} else {
+			php_svm_drift(intern->model, &intern->predictor, intern_return->model, &intern_return->predictor, intern->model->SV, intern->model->l, &report);
+		}
+
+		zval_dtor(zreport);
+		array_init(zreport);
+		add_assoc_long(zreport, "memory_before", (zend_long)php_svm_model_memory(intern->model, &intern->predictor));
+		add_assoc_long(zreport, "memory_after", (zend_long)php_svm_model_memory(intern_return->model, &intern_return->predictor));
+		add_assoc_double(zreport, "max_drift", report.max_drift);
+		add_assoc_double(zreport, "mean_drift", report.mean_drift);
+		if (!svr) {
+			add_assoc_double(zreport, "label_agreement", report.label_agreement);
+		}
+		if (x) {
+			double before = php_svm_model_score(intern, x, y, rows);
+			double after = php_svm_model_score(intern_return, x, y, rows);
+
+			add_assoc_double(zreport, svr ? "mse_before" : "accuracy_before", before);
+			add_assoc_double(zreport, svr ? "mse_after" : "accuracy_after", after);
+			add_assoc_double(zreport, svr ? "mse_delta" : "accuracy_delta", after - before);
+		}
+	}
+
+	if (x_space) {
+		efree(x_space);
+		efree(x);
+		efree(y);
+	}
+}
+/* }}} */
+
 /* ---- END SVMMODEL ---- */
 
 static void php_svm_object_free_storage(zend_object *object)/*{{{*/
@@ -1234,21 +2530,8 @@ static void php_svm_model_object_free_storage(zend_object *object)/*{{{*/
 		return;
 	}
 	
-	if (intern->model) {
-		#if LIBSVM_VERSION >= 300
-			svm_free_and_destroy_model(&intern->model);
-		#else
-			svm_destroy_model(intern->model);
-		#endif
-	    
-	    efree(intern->model);
-		intern->model = NULL;
-	}	
-	
-	if (intern->x_space) {
-		efree(intern->x_space);
-		intern->x_space = NULL;
-	}
+	php_svm_model_free_data(intern);
+	php_svm_cache_free(&intern->cache);
 
 	zend_object_std_dtor(&intern->zo);
 }/*}}}*/
@@ -1287,6 +2570,42 @@ static zend_object * php_svm_model_object_new(zend_class_entry *class_type)/*{{{
 	return php_svm_model_object_new_ex(class_type, NULL, 0);
 }/*}}}*/
 
+#if PHP_VERSION_ID < 70400
+/* PHP before 7.4 doesn't call __serialize, so models are serialized through the class handlers instead, as the
+   string __serialize returns under "model" */
+static int php_svm_model_serialize(zval *object, unsigned char **buffer, size_t *buf_len, zend_serialize_data *data)/*{{{*/
+{
+	php_svm_model_object *intern = php_svm_fetch_svm_model_object(Z_OBJ_P(object));
+	zend_string *contents;
+
+	if (!intern->model) {
+		*buffer = (unsigned char *)estrndup("", 0);
+		*buf_len = 0;
+		return SUCCESS;
+	}
+
+	contents = php_svm_model_save_string(intern, !intern->rff && !intern->compact);
+	if (!contents) {
+		zend_throw_exception(php_svm_exception_sc_entry, "Failed to save the model", 121);
+		return FAILURE;
+	}
+	*buffer = (unsigned char *)estrndup(ZSTR_VAL(contents), ZSTR_LEN(contents));
+	*buf_len = ZSTR_LEN(contents);
+	zend_string_release(contents);
+	return SUCCESS;
+}/*}}}*/
+
+static int php_svm_model_unserialize(zval *object, zend_class_entry *ce, const unsigned char *buf, size_t buf_len, zend_unserialize_data *data)/*{{{*/
+{
+	object_init_ex(object, ce);
+	if (buf_len > 0 && !php_svm_model_load_string(php_svm_fetch_svm_model_object(Z_OBJ_P(object)), (const char *)buf, buf_len)) {
+		zend_throw_exception(php_svm_exception_sc_entry, "Failed to load the model", 1233);
+		return FAILURE;
+	}
+	return SUCCESS;
+}/*}}}*/
+#endif
+
 /* {{{ SVM arginfo */
 ZEND_BEGIN_ARG_INFO_EX(svm_empty_args, 0, 0, 0)
 ZEND_END_ARG_INFO()
@@ -1318,22 +2637,86 @@ static zend_function_entry php_svm_class_methods[] =/*{{{*/
 
 /* {{{ Model arginfo */
 ZEND_BEGIN_ARG_INFO_EX(svm_model_construct_args, 0, 0, 0)
-	ZEND_ARG_INFO(0, filename)
+	ZEND_ARG_INFO(0, file)
 ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(svm_model_predict_args, 0, 0, 1)
 	ZEND_ARG_INFO(0, data)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(svm_model_predict_batch_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, rows)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_predict_values_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, data)
+	ZEND_ARG_INFO(1, values)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_predict_values_batch_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, rows)
+	ZEND_ARG_INFO(1, values)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(svm_model_predict_probs_args, 0, 0, 1)
 	ZEND_ARG_INFO(0, data)
 	ZEND_ARG_INFO(1, probabilities)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(svm_model_compress_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, target)
+	ZEND_ARG_ARRAY_INFO(0, validation, 1)
+	ZEND_ARG_INFO(1, report)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_rff_args, 0, 0, 0)
+	ZEND_ARG_INFO(0, dimension)
+	ZEND_ARG_INFO(0, seed)
+	ZEND_ARG_ARRAY_INFO(0, validation, 1)
+	ZEND_ARG_INFO(1, report)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_float32_args, 0, 0, 0)
+	ZEND_ARG_INFO(0, float_coef)
+	ZEND_ARG_ARRAY_INFO(0, validation, 1)
+	ZEND_ARG_INFO(1, report)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_int8_args, 0, 0, 0)
+	ZEND_ARG_INFO(0, float_coef)
+	ZEND_ARG_INFO(0, heldout)
+	ZEND_ARG_INFO(1, report)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_cache_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, entries)
+	ZEND_ARG_INFO(0, max_memory)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(svm_model_file_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, file)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_string_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_to_string_args, 0, 0, 0)
+	ZEND_ARG_INFO(0, binary)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_from_cache_args, 0, 0, 1)
 	ZEND_ARG_INFO(0, filename)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(svm_model_preloaded_args, 0, 0, 1)
+	ZEND_ARG_INFO(0, name)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(svm_model_unserialize_args, 0, 0, 1)
+	ZEND_ARG_ARRAY_INFO(0, data, 0)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(svm_model_info_args, 0, 0, 0)
 ZEND_END_ARG_INFO()
 /* }}} */
@@ -1342,20 +2725,195 @@ static zend_function_entry php_svm_model_class_methods[] =/*{{{*/
 {
 	PHP_ME(svmmodel, __construct,	svm_model_construct_args,	ZEND_ACC_PUBLIC|ZEND_ACC_CTOR)
 	PHP_ME(svmmodel, save,			svm_model_file_args,	ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, saveBinary,	svm_model_file_args,	ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, saveToString,	svm_model_to_string_args,	ZEND_ACC_PUBLIC)
 	PHP_ME(svmmodel, load,			svm_model_file_args,	ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, loadFromString,	svm_model_string_args,	ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, fromCache,		svm_model_from_cache_args,	ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+	PHP_ME(svmmodel, preloaded,		svm_model_preloaded_args,	ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+	PHP_ME(svmmodel, __serialize,	svm_model_info_args,	ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, __unserialize,	svm_model_unserialize_args,	ZEND_ACC_PUBLIC)
 	PHP_ME(svmmodel, getSvmType,	svm_model_info_args,	ZEND_ACC_PUBLIC)
 	PHP_ME(svmmodel, getLabels,		svm_model_info_args,	ZEND_ACC_PUBLIC)
 	PHP_ME(svmmodel, getNrClass,	svm_model_info_args,	ZEND_ACC_PUBLIC)
 	PHP_ME(svmmodel, getSvrProbability,	svm_model_info_args,	ZEND_ACC_PUBLIC)
 	PHP_ME(svmmodel, checkProbabilityModel,	svm_model_info_args,	ZEND_ACC_PUBLIC)	
 	PHP_ME(svmmodel, predict, 		svm_model_predict_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, predictBatch,	svm_model_predict_batch_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, predictValues,	svm_model_predict_values_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, predictValuesBatch,	svm_model_predict_values_batch_args, ZEND_ACC_PUBLIC)
 	PHP_ME(svmmodel, predict_probability,	svm_model_predict_probs_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, compress,		svm_model_compress_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, toRandomFeatures,	svm_model_rff_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, toFloat32,		svm_model_float32_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, toInt8,		svm_model_int8_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, setCache,		svm_model_cache_args, ZEND_ACC_PUBLIC)
+	PHP_ME(svmmodel, getCacheStats,	svm_model_info_args, ZEND_ACC_PUBLIC)
 	{ NULL, NULL, NULL }
 };/*}}}*/
 
+/* {{{ static PHP_INI_MH(OnUpdateSvmSparseIndex)
+svm.sparse_index is "auto" or a boolean.
+*/
+static PHP_INI_MH(OnUpdateSvmSparseIndex)
+{
+	if (zend_string_equals_literal_ci(new_value, "auto")) {
+		SVM_G(sparse_index) = PHP_SVM_INDEX_AUTO;
+	} else {
+		SVM_G(sparse_index) = zend_ini_parse_bool(new_value) ? PHP_SVM_INDEX_ON : PHP_SVM_INDEX_OFF;
+	}
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ static PHP_INI_MH(OnUpdateSvmModelCacheSize)
+svm.model_cache_size is a size in bytes, with an optional K, M or G suffix.
+*/
+static PHP_INI_MH(OnUpdateSvmModelCacheSize)
+{
+	SVM_G(model_cache_size) = zend_atol(ZSTR_VAL(new_value), ZSTR_LEN(new_value));
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ static PHP_INI_MH(OnUpdateSvmThreads)
+svm.threads is a number of threads, or "auto" for one per CPU.
+*/
+static PHP_INI_MH(OnUpdateSvmThreads)
+{
+	zend_long threads;
+
+	if (zend_string_equals_literal_ci(new_value, "auto")) {
+		threads = 0;
+	} else {
+		threads = ZEND_STRTOL(ZSTR_VAL(new_value), NULL, 10);
+		if (threads < 1 || threads > INT_MAX) {
+			return FAILURE;
+		}
+	}
+	SVM_G(threads) = threads;
+	return SUCCESS;
+}
+/* }}} */
+
+PHP_INI_BEGIN()
+	PHP_INI_ENTRY("svm.sparse_index", "auto", PHP_INI_ALL, OnUpdateSvmSparseIndex)
+	PHP_INI_ENTRY("svm.model_cache_size", "64M", PHP_INI_ALL, OnUpdateSvmModelCacheSize)
+	PHP_INI_ENTRY("svm.preload", "", PHP_INI_SYSTEM, NULL)
+	PHP_INI_ENTRY("svm.threads", "1", PHP_INI_ALL, OnUpdateSvmThreads)
+PHP_INI_END()
+
+/* {{{ static void php_svm_preload_model(const char *name, size_t name_len, const char *filename)
+Open one binary model for svm.preload and build its prediction state, all in persistent memory.
+*/
+static void php_svm_preload_model(const char *name, size_t name_len, const char *filename)
+{
+	php_svm_preload *preload, **tail;
+	struct svm_model *model;
+	php_svm_mapping *mapping;
+
+	mapping = php_svm_binary_preload(filename, &model);
+	if (!mapping) {
+		php_error_docref(NULL, E_WARNING, "svm.preload: can't load %s as a binary model", filename);
+		return;
+	}
+
+	preload = pecalloc(1, sizeof(php_svm_preload), 1);
+	preload->name = zend_string_init(name, name_len, 1);
+	preload->model = model;
+	preload->mapping = mapping;
+
+	php_svm_predictor_init(&preload->predictor, model);
+	php_svm_predictor_init_index(&preload->predictor, model, (int)SVM_G(sparse_index));
+	php_svm_predictor_persist(&preload->predictor, model);
+
+	for (tail = &php_svm_preloaded; *tail; tail = &(*tail)->next);
+	*tail = preload;
+}
+/* }}} */
+
+/* {{{ static void php_svm_preload_models(const char *list)
+Preload the models svm.preload lists, as name=file pairs separated by commas.
+*/
+static void php_svm_preload_models(const char *list)
+{
+	const char *p = list;
+
+	while (*p) {
+		const char *end, *eq, *name, *file;
+		size_t name_len, file_len;
+		char *filename;
+
+		end = strchr(p, ',');
+		if (!end) {
+			end = p + strlen(p);
+		}
+		eq = memchr(p, '=', end - p);
+
+		/* Trim the name and the file, and skip empty entries such as a trailing comma */
+		for (name = p; name < end && isspace((unsigned char)*name); name++);
+		name_len = (eq ? eq : end) - name;
+		for (; name_len > 0 && isspace((unsigned char)name[name_len - 1]); name_len--);
+		file = eq ? eq + 1 : end;
+		for (; file < end && isspace((unsigned char)*file); file++);
+		for (file_len = end - file; file_len > 0 && isspace((unsigned char)file[file_len - 1]); file_len--);
+
+		if (name_len > 0 && file_len > 0) {
+			filename = estrndup(file, file_len);
+			php_svm_preload_model(name, name_len, filename);
+			efree(filename);
+		} else if (name_len > 0 || eq) {
+			php_error_docref(NULL, E_WARNING, "svm.preload: expected name=file, got %.*s", (int)(end - p), p);
+		}
+
+		p = *end ? end + 1 : end;
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_preload_free(void)
+Release the preloaded models at shutdown.
+*/
+static void php_svm_preload_free(void)
+{
+	while (php_svm_preloaded) {
+		php_svm_preload *preload = php_svm_preloaded;
+
+		php_svm_preloaded = preload->next;
+		php_svm_predictor_free(&preload->predictor);
+		php_svm_binary_free(preload->model, preload->mapping);
+		zend_string_release(preload->name);
+		pefree(preload, 1);
+	}
+}
+/* }}} */
+
+static void php_svm_init_globals(zend_svm_globals *svm_globals)/*{{{*/
+{
+#if defined(COMPILE_DL_SVM) && defined(ZTS)
+	ZEND_TSRMLS_CACHE_UPDATE();
+#endif
+	svm_globals->sparse_index = PHP_SVM_INDEX_AUTO;
+	svm_globals->model_cache_size = 0;
+	svm_globals->model_store = NULL;
+	svm_globals->threads = 1;
+}/*}}}*/
+
+static void php_svm_shutdown_globals(zend_svm_globals *svm_globals)/*{{{*/
+{
+	if (svm_globals->model_store) {
+		php_svm_store_free(svm_globals->model_store);
+		svm_globals->model_store = NULL;
+	}
+}/*}}}*/
+
 PHP_MINIT_FUNCTION(svm)/*{{{*/
 {
 	zend_class_entry ce;
+
+	ZEND_INIT_MODULE_GLOBALS(svm, php_svm_init_globals, php_svm_shutdown_globals);
+	REGISTER_INI_ENTRIES();
+
 	memcpy(&svm_object_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
 	svm_object_handlers.free_obj = php_svm_object_free_storage;
 	svm_object_handlers.offset = XtOffsetOf(php_svm_object, zo);
@@ -1371,11 +2929,18 @@ PHP_MINIT_FUNCTION(svm)/*{{{*/
 	INIT_CLASS_ENTRY(ce, "svmmodel", php_svm_model_class_methods);
 	ce.create_object = php_svm_model_object_new;
 	php_svm_model_sc_entry = zend_register_internal_class(&ce);
+#if PHP_VERSION_ID < 70400
+	php_svm_model_sc_entry->serialize = php_svm_model_serialize;
+	php_svm_model_sc_entry->unserialize = php_svm_model_unserialize;
+#endif
 
 	INIT_CLASS_ENTRY(ce, "svmexception", NULL);
 	php_svm_exception_sc_entry = zend_register_internal_class_ex(&ce, zend_exception_get_default());
 	php_svm_exception_sc_entry->ce_flags |= ZEND_ACC_FINAL;
 	
+	/* Pick the dense prediction kernels for this CPU */
+	php_svm_simd_init();
+
 	/* Redirect the lib svm output */
 	#if LIBSVM_VERSION >= 291
 	svm_set_print_string_function(&print_null);
@@ -1404,6 +2969,9 @@ PHP_MINIT_FUNCTION(svm)/*{{{*/
 	SVM_REGISTER_CONST_LONG("OPT_TYPE", phpsvm_svm_type);
 	SVM_REGISTER_CONST_LONG("OPT_KERNEL_TYPE", phpsvm_kernel_type);
 	SVM_REGISTER_CONST_LONG("OPT_DEGREE", phpsvm_degree);
+	SVM_REGISTER_CONST_LONG("OPT_APPROX_RANK", phpsvm_approx_rank);
+	SVM_REGISTER_CONST_LONG("OPT_THREADS", phpsvm_threads);
+	SVM_REGISTER_CONST_LONG("OPT_PROBABILITY_FOLDS", phpsvm_probability_folds);
 	SVM_REGISTER_CONST_LONG("OPT_SHRINKING", phpsvm_shrinking);
 	SVM_REGISTER_CONST_LONG("OPT_PROBABILITY", phpsvm_probability);
 	
@@ -1418,23 +2986,71 @@ PHP_MINIT_FUNCTION(svm)/*{{{*/
 
 #undef SVM_REGISTER_CONST_LONG
 
+	/* Models opened here are inherited by every worker forked from this process */
+	php_svm_preload_models(INI_STR("svm.preload"));
+
 	return SUCCESS;
 }/*}}}*/
 
 PHP_MSHUTDOWN_FUNCTION(svm)/*{{{*/
 {
+	php_svm_preload_free();
+#ifdef LIBSVM_THREADS
+	/* The training threads run code from this library, so they have to stop before it is unloaded */
+	svm_shutdown_threads();
+#endif
 	UNREGISTER_INI_ENTRIES();
+#ifndef ZTS
+	php_svm_shutdown_globals(&svm_globals);
+#endif
 	return SUCCESS;
 }/*}}}*/
 
 PHP_MINFO_FUNCTION(svm)/*{{{*/
 {
 	char _tmp[8];
+	char buf[32];
+	php_svm_store *store = SVM_G(model_store);
+	php_svm_preload *preload;
+	smart_str names = {0};
+
 	php_info_print_table_start();
 		php_info_print_table_header(2, "svm extension", "enabled");
 		php_info_print_table_row(2, "svm extension version", PHP_SVM_VERSION);
 		snprintf(_tmp, sizeof(_tmp), "%d.%d", (int)(LIBSVM_VERSION/100), (int)(LIBSVM_VERSION % 100));
 		php_info_print_table_row(2, "libsvm version", _tmp);
+		php_info_print_table_row(2, "dense prediction kernels", php_svm_simd_impl.name);
+#ifdef LIBSVM_THREADS
+		php_info_print_table_row(2, "training threads", "supported");
+#else
+		php_info_print_table_row(2, "training threads", "not supported by this libsvm");
+#endif
+		for (preload = php_svm_preloaded; preload; preload = preload->next) {
+			if (names.s) {
+				smart_str_appendl(&names, ", ", 2);
+			}
+			smart_str_append(&names, preload->name);
+		}
+		smart_str_0(&names);
+		php_info_print_table_row(2, "preloaded models", names.s ? ZSTR_VAL(names.s) : "none");
+		smart_str_free(&names);
+	php_info_print_table_end();
+
+	/* The model cache of the worker showing the page */
+	php_info_print_table_start();
+		php_info_print_table_header(2, "model cache", "value");
+		snprintf(buf, sizeof(buf), "%d", store ? store->entries : 0);
+		php_info_print_table_row(2, "cached models", buf);
+		snprintf(buf, sizeof(buf), ZEND_ULONG_FMT, (zend_ulong)(store ? store->memory : 0));
+		php_info_print_table_row(2, "memory used", buf);
+		snprintf(buf, sizeof(buf), ZEND_LONG_FMT, store ? store->hits : 0);
+		php_info_print_table_row(2, "hits", buf);
+		snprintf(buf, sizeof(buf), ZEND_LONG_FMT, store ? store->misses : 0);
+		php_info_print_table_row(2, "misses", buf);
+		snprintf(buf, sizeof(buf), ZEND_LONG_FMT, store ? store->reloads : 0);
+		php_info_print_table_row(2, "reloads", buf);
+		snprintf(buf, sizeof(buf), ZEND_LONG_FMT, store ? store->evictions : 0);
+		php_info_print_table_row(2, "evictions", buf);
 	php_info_print_table_end();
 
 	DISPLAY_INI_ENTRIES();
@@ -1461,6 +3077,9 @@ zend_module_entry svm_module_entry =
 
 
 #ifdef COMPILE_DL_SVM
+# ifdef ZTS
+ZEND_TSRMLS_CACHE_DEFINE()
+# endif
 ZEND_GET_MODULE(svm)
 #endif /* COMPILE_DL_SVM */
 
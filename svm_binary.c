@@ -0,0 +1,532 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+#include "zend_smart_str.h"
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+/*
+ * Binary model files, written by saveBinary(). The file holds the arrays of an svm_model in the layout they
+ * have in memory: a fixed header giving the parameters and the offset of every array, then rho, probA, probB,
+ * label, nSV, the coefficient rows, the offset of each SV and the SV nodes themselves, every array starting on
+ * an 8 byte boundary. Loading maps the file read only and points the model into the mapping, so nothing is
+ * parsed or copied, and processes mapping the same file share its pages. Only the SV and coefficient row
+ * pointers are built, one per SV. Files are tied to the byte order and node layout of the machine writing
+ * them, both of which are recorded and checked.
+ */
+
+#define PHP_SVM_BINARY_MAGIC      "PHPSVMB"
+#define PHP_SVM_BINARY_VERSION    1
+#define PHP_SVM_BINARY_BYTE_ORDER 0x01020304
+
+/* Nodes written per call when saving */
+#define PHP_SVM_BINARY_CHUNK 4096
+
+typedef struct _php_svm_binary_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t node_size;     /* sizeof(struct svm_node) */
+	int32_t svm_type;
+	int32_t kernel_type;
+	int32_t degree;
+	double gamma;
+	double coef0;
+	int32_t nr_class;
+	int32_t l;
+	uint64_t nodes;         /* SV nodes, terminators included */
+
+	/* offsets from the start of the file, 0 for arrays the model doesn't have */
+	uint64_t rho;           /* nr_dec doubles */
+	uint64_t probA;         /* nr_dec doubles */
+	uint64_t probB;         /* nr_dec doubles */
+	uint64_t label;         /* nr_class int32 */
+	uint64_t nSV;           /* nr_class int32 */
+	uint64_t sv_coef;       /* nr_class - 1 rows of l doubles */
+	uint64_t sv_start;      /* l uint64, the first node of each SV */
+	uint64_t sv;            /* nodes */
+
+	uint64_t size;          /* of the whole file */
+} php_svm_binary_header;
+
+/* ---- START SAVE FUNCS ---- */
+
+/* {{{ static uint64_t php_svm_binary_place(uint64_t *end, uint64_t count, size_t size)
+Lay out an array of count elements after the end of the previous one. Returns its offset.
+*/
+static uint64_t php_svm_binary_place(uint64_t *end, uint64_t count, size_t size)
+{
+	uint64_t offset = (*end + 7) & ~(uint64_t)7;
+
+	*end = offset + count * size;
+	return offset;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_binary_put(php_stream *stream, const void *data, size_t len)
+Write len bytes, returns 0 on a short write.
+*/
+static zend_bool php_svm_binary_put(php_stream *stream, const void *data, size_t len)
+{
+	return (size_t)php_stream_write(stream, (const char *)data, len) == len;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_binary_write(php_stream *stream, uint64_t *pos, uint64_t offset, const void *data, size_t len)
+Write an array at its offset, padding with zeros from the current position. Returns 0 on a short write.
+*/
+static zend_bool php_svm_binary_write(php_stream *stream, uint64_t *pos, uint64_t offset, const void *data, size_t len)
+{
+	static const char zeros[8] = {0};
+
+	if (offset > *pos && !php_svm_binary_put(stream, zeros, (size_t)(offset - *pos))) {
+		return 0;
+	}
+	if (len && !php_svm_binary_put(stream, data, len)) {
+		return 0;
+	}
+	*pos = offset + len;
+	return 1;
+}
+/* }}} */
+
+/* {{{ zend_bool php_svm_binary_save(php_stream *stream, const struct svm_model *model)
+Write a model with its SVs in double precision in the binary format. Returns 0 on a short write, leaving
+whatever was written before it in the stream.
+*/
+zend_bool php_svm_binary_save(php_stream *stream, const struct svm_model *model)
+{
+	php_svm_binary_header header;
+	struct svm_node *chunk;
+	uint64_t *start, pos = 0, end = sizeof(header), nodes = 0;
+	int nr_class = model->nr_class, l = model->l;
+	int nr_dec = (model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+	int32_t *ints;
+	int i, j, n;
+	zend_bool ok;
+
+	start = safe_emalloc(l > 0 ? l : 1, sizeof(uint64_t), 0);
+	for (i = 0; i < l; i++) {
+		const struct svm_node *p = model->SV[i];
+
+		start[i] = nodes;
+		while (p->index != -1) {
+			p++;
+		}
+		nodes += p - model->SV[i] + 1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PHP_SVM_BINARY_MAGIC, sizeof(PHP_SVM_BINARY_MAGIC));
+	header.version = PHP_SVM_BINARY_VERSION;
+	header.byte_order = PHP_SVM_BINARY_BYTE_ORDER;
+	header.node_size = sizeof(struct svm_node);
+	header.svm_type = model->param.svm_type;
+	header.kernel_type = model->param.kernel_type;
+	header.degree = model->param.degree;
+	header.gamma = model->param.gamma;
+	header.coef0 = model->param.coef0;
+	header.nr_class = nr_class;
+	header.l = l;
+	header.nodes = nodes;
+
+	header.rho = php_svm_binary_place(&end, nr_dec, sizeof(double));
+	if (model->probA) {
+		header.probA = php_svm_binary_place(&end, nr_dec, sizeof(double));
+	}
+	if (model->probB) {
+		header.probB = php_svm_binary_place(&end, nr_dec, sizeof(double));
+	}
+	if (model->label) {
+		header.label = php_svm_binary_place(&end, nr_class, sizeof(int32_t));
+	}
+	if (model->nSV) {
+		header.nSV = php_svm_binary_place(&end, nr_class, sizeof(int32_t));
+	}
+	header.sv_coef = php_svm_binary_place(&end, (uint64_t)(nr_class - 1) * l, sizeof(double));
+	header.sv_start = php_svm_binary_place(&end, l, sizeof(uint64_t));
+	header.sv = php_svm_binary_place(&end, nodes, sizeof(struct svm_node));
+	header.size = end;
+
+	ok = php_svm_binary_write(stream, &pos, 0, &header, sizeof(header)) &&
+		php_svm_binary_write(stream, &pos, header.rho, model->rho, nr_dec * sizeof(double));
+	if (ok && header.probA) {
+		ok = php_svm_binary_write(stream, &pos, header.probA, model->probA, nr_dec * sizeof(double));
+	}
+	if (ok && header.probB) {
+		ok = php_svm_binary_write(stream, &pos, header.probB, model->probB, nr_dec * sizeof(double));
+	}
+
+	/* int and int32_t only differ in name on the platforms PHP runs on, but copy to be sure */
+	ints = safe_emalloc(nr_class, sizeof(int32_t), 0);
+	if (ok && header.label) {
+		for (i = 0; i < nr_class; i++) {
+			ints[i] = model->label[i];
+		}
+		ok = php_svm_binary_write(stream, &pos, header.label, ints, nr_class * sizeof(int32_t));
+	}
+	if (ok && header.nSV) {
+		for (i = 0; i < nr_class; i++) {
+			ints[i] = model->nSV[i];
+		}
+		ok = php_svm_binary_write(stream, &pos, header.nSV, ints, nr_class * sizeof(int32_t));
+	}
+	efree(ints);
+
+	for (j = 0; ok && j < nr_class - 1; j++) {
+		ok = php_svm_binary_write(stream, &pos, header.sv_coef + (uint64_t)j * l * sizeof(double), model->sv_coef[j], (size_t)l * sizeof(double));
+	}
+	ok = ok && php_svm_binary_write(stream, &pos, header.sv_start, start, (size_t)l * sizeof(uint64_t));
+	efree(start);
+	if (!ok) {
+		return 0;
+	}
+
+	/* Nodes are copied through a zeroed buffer, so the padding of each node is written as zeros */
+	ok = php_svm_binary_write(stream, &pos, header.sv, NULL, 0);
+	chunk = ecalloc(PHP_SVM_BINARY_CHUNK, sizeof(struct svm_node));
+	for (i = 0, n = 0; ok && i < l; i++) {
+		const struct svm_node *p = model->SV[i];
+
+		do {
+			chunk[n].index = p->index;
+			chunk[n].value = p->value;
+			if (++n == PHP_SVM_BINARY_CHUNK) {
+				ok = ok && php_svm_binary_put(stream, chunk, n * sizeof(struct svm_node));
+				n = 0;
+			}
+		} while ((p++)->index != -1);
+	}
+	if (ok && n) {
+		ok = php_svm_binary_put(stream, chunk, n * sizeof(struct svm_node));
+	}
+	efree(chunk);
+
+	return ok;
+}
+/* }}} */
+
+/* ---- END SAVE FUNCS ---- */
+
+/* ---- START LOAD FUNCS ---- */
+
+/* {{{ static void *php_svm_binary_array(const php_svm_mapping *mapping, uint64_t offset, uint64_t count, size_t size)
+The array of count elements at an offset, or NULL if it is not aligned or doesn't fit in the file.
+*/
+static void *php_svm_binary_array(const php_svm_mapping *mapping, uint64_t offset, uint64_t count, size_t size)
+{
+	if (offset < sizeof(php_svm_binary_header) || (offset & 7) || offset > mapping->size ||
+		count > (mapping->size - offset) / size) {
+		return NULL;
+	}
+	return (char *)mapping->base + offset;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_binary_map(php_stream *stream, zend_off_t start, php_svm_mapping *mapping)
+Map the whole file read only, or where that isn't possible, such as for streams that aren't plain files or models
+that don't start the file, read the stream from the model on into memory.
+*/
+static zend_bool php_svm_binary_map(php_stream *stream, zend_off_t start, php_svm_mapping *mapping)
+{
+#ifdef HAVE_MMAP
+	php_stream_statbuf ssb;
+	int fd;
+
+	if (start == 0 && php_stream_cast(stream, PHP_STREAM_AS_FD | PHP_STREAM_CAST_INTERNAL, (void **)&fd, 0) == SUCCESS &&
+		php_stream_stat(stream, &ssb) == 0 && ssb.sb.st_size > 0) {
+		void *base = mmap(NULL, (size_t)ssb.sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (base != MAP_FAILED) {
+			mapping->base = base;
+			mapping->size = (size_t)ssb.sb.st_size;
+			mapping->mapped = 1;
+			return 1;
+		}
+	}
+#endif
+
+	if (php_stream_seek(stream, start, SEEK_SET) != 0) {
+		return 0;
+	}
+	mapping->contents = php_stream_copy_to_mem(stream, PHP_STREAM_COPY_ALL, 0);
+	if (!mapping->contents) {
+		return 0;
+	}
+	mapping->base = ZSTR_VAL(mapping->contents);
+	mapping->size = ZSTR_LEN(mapping->contents);
+	return 1;
+}
+/* }}} */
+
+/* {{{ static void php_svm_binary_unmap(php_svm_mapping *mapping)
+Release the file and the mapping.
+*/
+static void php_svm_binary_unmap(php_svm_mapping *mapping)
+{
+#ifdef HAVE_MMAP
+	if (mapping->mapped) {
+		munmap(mapping->base, mapping->size);
+	}
+#endif
+	if (mapping->contents) {
+		zend_string_release(mapping->contents);
+	}
+	pefree(mapping, mapping->persistent);
+}
+/* }}} */
+
+/* {{{ zend_bool php_svm_binary_open(php_svm_mapping *mapping, struct svm_model **model_ptr)
+Check the binary model held by a mapping and point a model into it. The model takes the mapping over, and both have
+to be released together with php_svm_binary_free. If the mapping doesn't hold a usable model it is released here.
+The model is allocated the way the mapping is, persistent or per request.
+*/
+zend_bool php_svm_binary_open(php_svm_mapping *mapping, struct svm_model **model_ptr)
+{
+	const php_svm_binary_header *header;
+	const uint64_t *start;
+	const struct svm_node *sv;
+	const int32_t *label = NULL, *nSV = NULL;
+	struct svm_model *model;
+	int nr_class, l, nr_dec, i, j;
+
+	header = (const php_svm_binary_header *)mapping->base;
+	if (mapping->size < sizeof(*header) || memcmp(header->magic, PHP_SVM_BINARY_MAGIC, sizeof(PHP_SVM_BINARY_MAGIC)) != 0 ||
+		header->version != PHP_SVM_BINARY_VERSION ||
+		header->byte_order != PHP_SVM_BINARY_BYTE_ORDER || header->node_size != sizeof(struct svm_node) ||
+		header->size != mapping->size) {
+		goto fail;
+	}
+
+	nr_class = header->nr_class;
+	l = header->l;
+	if (header->svm_type < C_SVC || header->svm_type > NU_SVR || header->kernel_type < LINEAR ||
+		header->kernel_type > PRECOMPUTED || nr_class < 1 || nr_class > 65536 || l < 0) {
+		goto fail;
+	}
+	if (header->svm_type == C_SVC || header->svm_type == NU_SVC) {
+		nr_dec = (int)((int64_t)nr_class * (nr_class - 1) / 2);
+	} else if (nr_class == 2) {
+		/* one decision function with a single row of coefficients, as libsvm builds it */
+		nr_dec = 1;
+	} else {
+		goto fail;
+	}
+
+	if (!php_svm_binary_array(mapping, header->rho, nr_dec, sizeof(double)) ||
+		(header->probA && !php_svm_binary_array(mapping, header->probA, nr_dec, sizeof(double))) ||
+		(header->probB && !php_svm_binary_array(mapping, header->probB, nr_dec, sizeof(double))) ||
+		!php_svm_binary_array(mapping, header->sv_coef, (uint64_t)(nr_class - 1) * l, sizeof(double))) {
+		goto fail;
+	}
+
+	if (header->svm_type == C_SVC || header->svm_type == NU_SVC) {
+		int total = 0;
+
+		label = php_svm_binary_array(mapping, header->label, nr_class, sizeof(int32_t));
+		nSV = php_svm_binary_array(mapping, header->nSV, nr_class, sizeof(int32_t));
+		if (!label || !nSV) {
+			goto fail;
+		}
+		for (i = 0; i < nr_class; i++) {
+			if (nSV[i] < 0 || nSV[i] > l - total) {
+				goto fail;
+			}
+			total += nSV[i];
+		}
+		if (total != l) {
+			goto fail;
+		}
+	}
+
+	/* Every SV has to start inside the node array, after the one before, and the last node has to end one, so
+	   no SV can run past the end of the file */
+	start = php_svm_binary_array(mapping, header->sv_start, l, sizeof(uint64_t));
+	sv = php_svm_binary_array(mapping, header->sv, header->nodes, sizeof(struct svm_node));
+	if (!start || !sv || (l > 0 && (header->nodes == 0 || sv[header->nodes - 1].index != -1))) {
+		goto fail;
+	}
+	for (i = 0; i < l; i++) {
+		if (start[i] >= header->nodes || (i > 0 && start[i] <= start[i - 1])) {
+			goto fail;
+		}
+	}
+
+	model = pecalloc(1, sizeof(struct svm_model), mapping->persistent);
+	model->param.svm_type = header->svm_type;
+	model->param.kernel_type = header->kernel_type;
+	model->param.degree = header->degree;
+	model->param.gamma = header->gamma;
+	model->param.coef0 = header->coef0;
+	model->nr_class = nr_class;
+	model->l = l;
+	model->free_sv = 0;
+	model->rho = (double *)((char *)mapping->base + header->rho);
+	model->probA = header->probA ? (double *)((char *)mapping->base + header->probA) : NULL;
+	model->probB = header->probB ? (double *)((char *)mapping->base + header->probB) : NULL;
+	model->label = (int *)label;
+	model->nSV = (int *)nSV;
+
+	model->SV = safe_pemalloc(l > 0 ? l : 1, sizeof(struct svm_node *), 0, mapping->persistent);
+	for (i = 0; i < l; i++) {
+		model->SV[i] = (struct svm_node *)(sv + start[i]);
+	}
+	model->sv_coef = safe_pemalloc(nr_class - 1, sizeof(double *), 0, mapping->persistent);
+	for (j = 0; j < nr_class - 1; j++) {
+		model->sv_coef[j] = (double *)((char *)mapping->base + header->sv_coef) + (size_t)j * l;
+	}
+
+	*model_ptr = model;
+	return 1;
+
+fail:
+	php_svm_binary_unmap(mapping);
+	return 0;
+}
+/* }}} */
+
+/* {{{ int php_svm_binary_load(php_stream *stream, struct svm_model **model_ptr, php_svm_mapping **mapping_ptr)
+Open a model saved by php_svm_binary_save from the current position of a stream, which has to be able to seek back
+to it. Returns 1 on success, 0 if the stream doesn't hold a binary model, so the caller can try other formats, and
+-1 if it holds one that can't be used. The model points into the mapping, and both have to be released together
+with php_svm_binary_free.
+*/
+int php_svm_binary_load(php_stream *stream, struct svm_model **model_ptr, php_svm_mapping **mapping_ptr)
+{
+	zend_off_t offset = php_stream_tell(stream);
+	php_svm_mapping *mapping;
+	char magic[sizeof(PHP_SVM_BINARY_MAGIC)];
+
+	if (php_stream_read(stream, magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, PHP_SVM_BINARY_MAGIC, sizeof(magic)) != 0) {
+		return 0;
+	}
+
+	/* The mapping outlives the stream */
+	mapping = ecalloc(1, sizeof(php_svm_mapping));
+	if (!php_svm_binary_map(stream, offset, mapping)) {
+		efree(mapping);
+		return -1;
+	}
+	if (!php_svm_binary_open(mapping, model_ptr)) {
+		return -1;
+	}
+
+	*mapping_ptr = mapping;
+	return 1;
+}
+/* }}} */
+
+/* {{{ void php_svm_binary_free(struct svm_model *model, php_svm_mapping *mapping)
+Release a model opened by php_svm_binary_load along with its mapping. libsvm can't free these models, as their
+arrays belong to the mapping.
+*/
+void php_svm_binary_free(struct svm_model *model, php_svm_mapping *mapping)
+{
+	pefree(model->SV, mapping->persistent);
+	pefree(model->sv_coef, mapping->persistent);
+	pefree(model, mapping->persistent);
+	php_svm_binary_unmap(mapping);
+}
+/* }}} */
+
+/* {{{ php_svm_mapping *php_svm_binary_preload(const char *filename, struct svm_model **model_ptr)
+Open a binary model file at startup, before streams can be used, into persistent memory. The file is mapped
+read only where possible, so every process forked from this one shares its pages, and read in otherwise. Returns
+the mapping, to be released with php_svm_binary_free at shutdown, or NULL if the file doesn't hold a binary model.
+*/
+php_svm_mapping *php_svm_binary_preload(const char *filename, struct svm_model **model_ptr)
+{
+	php_svm_mapping *mapping;
+	smart_str buf = {0};
+	char chunk[8192];
+	size_t n;
+	FILE *fp;
+
+	fp = VCWD_FOPEN(filename, "rb");
+	if (!fp) {
+		return NULL;
+	}
+
+	mapping = pecalloc(1, sizeof(php_svm_mapping), 1);
+	mapping->persistent = 1;
+
+#ifdef HAVE_MMAP
+	{
+		struct stat sb;
+
+		if (fstat(fileno(fp), &sb) == 0 && sb.st_size > 0) {
+			void *base = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+
+			if (base != MAP_FAILED) {
+				mapping->base = base;
+				mapping->size = (size_t)sb.st_size;
+				mapping->mapped = 1;
+			}
+		}
+	}
+#endif
+
+	if (!mapping->mapped) {
+		while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+			smart_str_appendl_ex(&buf, chunk, n, 1);
+		}
+		if (!buf.s) {
+			fclose(fp);
+			pefree(mapping, 1);
+			return NULL;
+		}
+		smart_str_0(&buf);
+		mapping->contents = buf.s;
+		mapping->base = ZSTR_VAL(buf.s);
+		mapping->size = ZSTR_LEN(buf.s);
+	}
+	fclose(fp);
+
+	if (!php_svm_binary_open(mapping, model_ptr)) {
+		return NULL;
+	}
+	return mapping;
+}
+/* }}} */
+
+/* ---- END LOAD FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,320 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+/*
+ * Per model cache of prediction results, keyed by the svm nodes of the input row. Entries live in a chained
+ * hash table and on a doubly linked list in order of use; when the entry count or memory budget is exceeded,
+ * entries are dropped from the least recently used end. Each entry is a single allocation holding the
+ * results and a copy of its key. The table starts small and doubles as entries are added, as long as the larger
+ * table still fits the memory budget, so a large max_entries costs nothing until the entries exist.
+ */
+
+/* Buckets of a new table, and the most it grows to */
+#define PHP_SVM_CACHE_FIRST_BUCKETS 16
+#define PHP_SVM_CACHE_MAX_BUCKETS   (1 << 24)
+
+/* ---- START HASH FUNCS ---- */
+
+/* {{{ static zend_ulong php_svm_cache_hash(const struct svm_node *x, int *nodes)
+Hash the index and value bits of every node up to the terminator, and count them.
+*/
+static zend_ulong php_svm_cache_hash(const struct svm_node *x, int *nodes)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	int n;
+
+	for (n = 0; x[n].index != -1; n++) {
+		uint64_t v;
+
+		memcpy(&v, &x[n].value, sizeof(v));
+		h = (h ^ (uint32_t)x[n].index) * 0x100000001B3ULL;
+		h = (h ^ v) * 0x100000001B3ULL;
+		h ^= h >> 29;
+	}
+	*nodes = n;
+	return (zend_ulong)h;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_cache_same(const struct svm_node *a, const struct svm_node *b, int nodes)
+Whether two rows of the same length have the same nodes. Values are compared bit for bit.
+*/
+static zend_bool php_svm_cache_same(const struct svm_node *a, const struct svm_node *b, int nodes)
+{
+	int n;
+
+	for (n = 0; n < nodes; n++) {
+		if (a[n].index != b[n].index || memcmp(&a[n].value, &b[n].value, sizeof(double)) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+/* }}} */
+
+/* ---- END HASH FUNCS ---- */
+
+/* ---- START LIST FUNCS ---- */
+
+static void php_svm_cache_unlink(php_svm_cache *cache, php_svm_cache_entry *entry)
+{
+	if (entry->lru_prev) {
+		entry->lru_prev->lru_next = entry->lru_next;
+	} else {
+		cache->head = entry->lru_next;
+	}
+	if (entry->lru_next) {
+		entry->lru_next->lru_prev = entry->lru_prev;
+	} else {
+		cache->tail = entry->lru_prev;
+	}
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void php_svm_cache_push(php_svm_cache *cache, php_svm_cache_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->head;
+	if (cache->head) {
+		cache->head->lru_prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+	cache->head = entry;
+}
+
+/* {{{ static void php_svm_cache_evict(php_svm_cache *cache, php_svm_cache_entry *entry)
+Remove an entry from the table and the list and free it.
+*/
+static void php_svm_cache_evict(php_svm_cache *cache, php_svm_cache_entry *entry)
+{
+	php_svm_cache_entry **slot = &cache->buckets[entry->hash & (cache->nr_buckets - 1)];
+
+	while (*slot != entry) {
+		slot = &(*slot)->hash_next;
+	}
+	*slot = entry->hash_next;
+
+	php_svm_cache_unlink(cache, entry);
+	cache->entries--;
+	cache->memory -= entry->size;
+	efree(entry);
+}
+/* }}} */
+
+/* {{{ static void php_svm_cache_grow(php_svm_cache *cache, size_t size)
+Double the table if the larger one fits the memory budget along with the entries and a new one of the given
+size. Otherwise the chains just get longer.
+*/
+static void php_svm_cache_grow(php_svm_cache *cache, size_t size)
+{
+	int nr_buckets = cache->nr_buckets * 2;
+	size_t grown = (size_t)cache->nr_buckets * sizeof(php_svm_cache_entry *);
+	php_svm_cache_entry **buckets, *entry;
+
+	if (nr_buckets > PHP_SVM_CACHE_MAX_BUCKETS || (cache->max_memory && cache->memory + grown + size > cache->max_memory)) {
+		return;
+	}
+
+	buckets = ecalloc(nr_buckets, sizeof(php_svm_cache_entry *));
+	for (entry = cache->head; entry; entry = entry->lru_next) {
+		php_svm_cache_entry **slot = &buckets[entry->hash & (nr_buckets - 1)];
+
+		entry->hash_next = *slot;
+		*slot = entry;
+	}
+	efree(cache->buckets);
+	cache->buckets = buckets;
+	cache->nr_buckets = nr_buckets;
+	cache->memory += grown;
+}
+/* }}} */
+
+/* ---- END LIST FUNCS ---- */
+
+/* ---- START CACHE FUNCS ---- */
+
+/* {{{ void php_svm_cache_configure(php_svm_cache *cache, int max_entries, size_t max_memory)
+Set the budget, dropping whatever is cached. max_entries 0 turns the cache off, max_memory 0 leaves memory
+unbounded. The hit and miss counts are left to the caller.
+*/
+void php_svm_cache_configure(php_svm_cache *cache, int max_entries, size_t max_memory)
+{
+	php_svm_cache_free(cache);
+
+	cache->max_entries = max_entries;
+	cache->max_memory = max_memory;
+	if (max_entries > 0) {
+		cache->nr_buckets = PHP_SVM_CACHE_FIRST_BUCKETS;
+		cache->buckets = ecalloc(cache->nr_buckets, sizeof(php_svm_cache_entry *));
+		cache->memory = cache->nr_buckets * sizeof(php_svm_cache_entry *);
+	}
+}
+/* }}} */
+
+/* {{{ void php_svm_cache_clear(php_svm_cache *cache)
+Drop every entry, keeping the budget. Called whenever the model of the object changes.
+*/
+void php_svm_cache_clear(php_svm_cache *cache)
+{
+	if (cache->max_entries > 0) {
+		php_svm_cache_configure(cache, cache->max_entries, cache->max_memory);
+	}
+}
+/* }}} */
+
+/* {{{ void php_svm_cache_free(php_svm_cache *cache)
+Release the entries and the table, leaving the cache off.
+*/
+void php_svm_cache_free(php_svm_cache *cache)
+{
+	php_svm_cache_entry *entry = cache->head, *next;
+
+	while (entry) {
+		next = entry->lru_next;
+		efree(entry);
+		entry = next;
+	}
+	if (cache->buckets) {
+		efree(cache->buckets);
+	}
+	cache->head = cache->tail = NULL;
+	cache->buckets = NULL;
+	cache->nr_buckets = 0;
+	cache->entries = 0;
+	cache->memory = 0;
+	cache->max_entries = 0;
+	cache->max_memory = 0;
+}
+/* }}} */
+
+/* {{{ php_svm_cache_entry *php_svm_cache_find(php_svm_cache *cache, const struct svm_node *x, int flags)
+Look up the results for a row, counting a hit only if the entry has all of the given PHP_SVM_CACHE_* results.
+A hit becomes the most recently used entry.
+*/
+php_svm_cache_entry *php_svm_cache_find(php_svm_cache *cache, const struct svm_node *x, int flags)
+{
+	php_svm_cache_entry *entry;
+	zend_ulong hash;
+	int nodes;
+
+	if (cache->max_entries <= 0) {
+		return NULL;
+	}
+
+	hash = php_svm_cache_hash(x, &nodes);
+	for (entry = cache->buckets[hash & (cache->nr_buckets - 1)]; entry; entry = entry->hash_next) {
+		if (entry->hash == hash && entry->nodes == nodes && php_svm_cache_same(entry->x, x, nodes)) {
+			break;
+		}
+	}
+
+	if (!entry || (entry->flags & flags) != flags) {
+		cache->misses++;
+		return NULL;
+	}
+
+	cache->hits++;
+	if (entry != cache->head) {
+		php_svm_cache_unlink(cache, entry);
+		php_svm_cache_push(cache, entry);
+	}
+	return entry;
+}
+/* }}} */
+
+/* {{{ php_svm_cache_entry *php_svm_cache_store(php_svm_cache *cache, const struct svm_node *x, int nr_dec, int nr_class)
+Return the entry for a row, creating it if there is none, so the caller can fill in the results it has and set
+their flag. Creating an entry evicts least recently used ones until the new one fits the budget. Returns NULL
+when the cache is off or the entry alone is over the memory budget.
+*/
+php_svm_cache_entry *php_svm_cache_store(php_svm_cache *cache, const struct svm_node *x, int nr_dec, int nr_class)
+{
+	php_svm_cache_entry *entry, **slot;
+	zend_ulong hash;
+	size_t size;
+	int nodes;
+
+	if (cache->max_entries <= 0) {
+		return NULL;
+	}
+
+	hash = php_svm_cache_hash(x, &nodes);
+	slot = &cache->buckets[hash & (cache->nr_buckets - 1)];
+	for (entry = *slot; entry; entry = entry->hash_next) {
+		if (entry->hash == hash && entry->nodes == nodes && php_svm_cache_same(entry->x, x, nodes)) {
+			return entry;
+		}
+	}
+
+	size = sizeof(php_svm_cache_entry) + (size_t)(nr_dec + nr_class) * sizeof(double) + (size_t)(nodes + 1) * sizeof(struct svm_node);
+	/* The table itself counts against the budget, so this entry could never fit */
+	if (cache->max_memory && cache->nr_buckets * sizeof(php_svm_cache_entry *) + size > cache->max_memory) {
+		return NULL;
+	}
+	while (cache->tail && (cache->entries >= cache->max_entries || (cache->max_memory && cache->memory + size > cache->max_memory))) {
+		php_svm_cache_evict(cache, cache->tail);
+	}
+	/* About one entry per bucket */
+	if (cache->entries >= cache->nr_buckets) {
+		php_svm_cache_grow(cache, size);
+		slot = &cache->buckets[hash & (cache->nr_buckets - 1)];
+	}
+
+	entry = emalloc(size);
+	memset(entry, 0, sizeof(php_svm_cache_entry));
+	entry->hash = hash;
+	entry->size = size;
+	entry->nodes = nodes;
+	entry->dec_values = (double *)(entry + 1);
+	entry->prob_estimates = entry->dec_values + nr_dec;
+	entry->x = (struct svm_node *)(entry->prob_estimates + nr_class);
+	memcpy(entry->x, x, (size_t)(nodes + 1) * sizeof(struct svm_node));
+
+	entry->hash_next = *slot;
+	*slot = entry;
+	php_svm_cache_push(cache, entry);
+	cache->entries++;
+	cache->memory += size;
+	return entry;
+}
+/* }}} */
+
+/* ---- END CACHE FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
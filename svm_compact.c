@@ -0,0 +1,966 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+#include <math.h>
+
+/*
+ * Reduced precision storage for the SVs of a model. libsvm keeps every SV value as an svm_node, an int index
+ * padded next to a double, so 16 bytes a value. Here values are floats, either in a dense matrix for densely
+ * filled models or as CSR rows of int indexes and float values, 4 or 8 bytes a value, and the coefficients can
+ * be floats too. Kernels still accumulate in double. The model the storage belongs to keeps everything but its
+ * SVs, so model->SV is NULL and model->sv_coef is NULL with float coefficients.
+ *
+ * int8 storage goes a step further, 1 or 5 bytes a value. Every value is rounded to a multiple of a scale
+ * factor, chosen so the largest magnitude maps to 127. The dense layout has a factor per feature, so features
+ * of different ranges keep their precision, and CSR rows one per SV, as the features of sparse models are too
+ * many to give each its own. With the dense layout the input row is quantized as well, to 16 bits in units of
+ * the feature scales, so the dot products run on integer multiply-adds.
+ */
+
+static const char *php_svm_compact_magic = "php_svm_compact 1";
+
+/* ---- START STORAGE FUNCS ---- */
+
+/* {{{ static php_svm_compact *php_svm_compact_new(int l, size_t nnz)
+Empty CSR storage for l SVs with room for nnz values.
+*/
+static php_svm_compact *php_svm_compact_new(int l, size_t nnz)
+{
+	php_svm_compact *compact = ecalloc(1, sizeof(php_svm_compact));
+
+	compact->storage = PHP_SVM_STORAGE_FLOAT32;
+	compact->l = l;
+	compact->row = ecalloc((size_t)l + 1, sizeof(int));
+	compact->index = safe_emalloc(nnz > 0 ? nnz : 1, sizeof(int), 0);
+	compact->value = safe_emalloc(nnz > 0 ? nnz : 1, sizeof(float), 0);
+	return compact;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_compact_measure(php_svm_compact *compact)
+Set the dimension of filled in CSR rows. Returns whether every index fits the dense layout.
+*/
+static zend_bool php_svm_compact_measure(php_svm_compact *compact)
+{
+	int k, dim = 0, dense = 1;
+	size_t nnz = compact->row[compact->l];
+
+	for (k = 0; k < (int)nnz; k++) {
+		if (compact->index[k] < 0 || compact->index[k] >= PHP_SVM_DENSE_MAX_DIM) {
+			dense = 0;
+		}
+		if (compact->index[k] >= dim) {
+			dim = compact->index[k] + 1;
+		}
+	}
+	compact->dim = dim;
+	return dense;
+}
+/* }}} */
+
+/* {{{ static void php_svm_compact_densify(php_svm_compact *compact, int align)
+Replace the CSR rows by a dense matrix of compact->dim features, padded to a multiple of align.
+*/
+static void php_svm_compact_densify(php_svm_compact *compact, int align)
+{
+	int i, k;
+	int stride = (compact->dim + align - 1) / align * align;
+	float *value = ecalloc((size_t)compact->l * stride, sizeof(float));
+
+	for (i = 0; i < compact->l; i++) {
+		for (k = compact->row[i]; k < compact->row[i + 1]; k++) {
+			value[(size_t)i * stride + compact->index[k]] = compact->value[k];
+		}
+	}
+
+	efree(compact->row);
+	efree(compact->index);
+	efree(compact->value);
+	compact->row = NULL;
+	compact->index = NULL;
+	compact->value = value;
+	compact->stride = stride;
+}
+/* }}} */
+
+/* {{{ static void php_svm_compact_norms(php_svm_compact *compact)
+Cache the squared norm of every SV, as stored.
+*/
+static void php_svm_compact_norms(php_svm_compact *compact)
+{
+	int i;
+	size_t k, n;
+
+	if (!compact->sv_sq) {
+		compact->sv_sq = safe_emalloc(compact->l > 0 ? compact->l : 1, sizeof(double), 0);
+	}
+	for (i = 0; i < compact->l; i++) {
+		double sum = 0, v;
+
+		n = compact->stride ? (size_t)compact->dim : (size_t)compact->row[i + 1];
+		for (k = compact->stride ? 0 : (size_t)compact->row[i]; k < n; k++) {
+			v = php_svm_compact_value(compact, i, k);
+			sum += v * v;
+		}
+		compact->sv_sq[i] = sum;
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_compact_finish(php_svm_compact *compact, const struct svm_parameter *param, int align)
+Once the CSR rows are filled in, switch to the dense layout when the SVs are mostly filled in over a modest number
+of features, using the same rule as the dense matrix of the predictor, and cache the SV norms RBF needs otherwise.
+*/
+static void php_svm_compact_finish(php_svm_compact *compact, const struct svm_parameter *param, int align)
+{
+	size_t nnz = compact->row[compact->l];
+
+	if (php_svm_compact_measure(compact) && compact->dim > 0 && nnz >= PHP_SVM_DENSE_MIN_FILL * compact->l * compact->dim) {
+		php_svm_compact_densify(compact, align);
+		return;
+	}
+
+	if (param->kernel_type == RBF) {
+		php_svm_compact_norms(compact);
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_compact_pack_int8(php_svm_compact *compact, const struct svm_parameter *param, double *scale)
+Switch float storage holding whole multiples of the scale factors, in either layout, to int8. Takes over the
+factors. RBF works from the SV norms in both layouts, as the int8 kernels only compute dot products.
+*/
+static void php_svm_compact_pack_int8(php_svm_compact *compact, const struct svm_parameter *param, double *scale)
+{
+	size_t k, n = compact->stride ? (size_t)compact->l * compact->stride : (size_t)compact->row[compact->l];
+
+	compact->qvalue = safe_emalloc(n > 0 ? n : 1, sizeof(int8_t), 0);
+	for (k = 0; k < n; k++) {
+		compact->qvalue[k] = (int8_t)compact->value[k];
+	}
+	efree(compact->value);
+	compact->value = NULL;
+	compact->scale = scale;
+	compact->storage = PHP_SVM_STORAGE_INT8;
+
+	if (param->kernel_type == RBF) {
+		php_svm_compact_norms(compact);
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_compact_quantize(php_svm_compact *compact, const struct svm_parameter *param)
+Round float storage to int8, with a scale factor per feature for the dense layout and per SV for CSR rows.
+*/
+static void php_svm_compact_quantize(php_svm_compact *compact, const struct svm_parameter *param)
+{
+	int i, k;
+	double *scale;
+
+	if (compact->stride) {
+		scale = ecalloc(compact->stride, sizeof(double));
+		for (i = 0; i < compact->l; i++) {
+			const float *sv = compact->value + (size_t)i * compact->stride;
+
+			for (k = 0; k < compact->dim; k++) {
+				scale[k] = MAX(scale[k], fabs(sv[k]));
+			}
+		}
+		for (k = 0; k < compact->dim; k++) {
+			scale[k] /= 127;
+		}
+		for (i = 0; i < compact->l; i++) {
+			float *sv = compact->value + (size_t)i * compact->stride;
+
+			for (k = 0; k < compact->dim; k++) {
+				sv[k] = scale[k] > 0 ? (float)floor(sv[k] / scale[k] + 0.5) : 0;
+			}
+		}
+	} else {
+		scale = safe_emalloc(compact->l > 0 ? compact->l : 1, sizeof(double), 0);
+		for (i = 0; i < compact->l; i++) {
+			double max = 0;
+
+			for (k = compact->row[i]; k < compact->row[i + 1]; k++) {
+				max = MAX(max, fabs(compact->value[k]));
+			}
+			scale[i] = max / 127;
+			for (k = compact->row[i]; k < compact->row[i + 1]; k++) {
+				compact->value[k] = scale[i] > 0 ? (float)floor(compact->value[k] / scale[i] + 0.5) : 0;
+			}
+		}
+	}
+
+	php_svm_compact_pack_int8(compact, param, scale);
+}
+/* }}} */
+
+/* {{{ static struct svm_model *php_svm_compact_carrier(const struct svm_parameter *param, int nr_class, int l)
+An svm_model with room for everything but the SVs, which stay NULL, and the coefficients. Allocated with malloc,
+as libsvm frees it.
+*/
+static struct svm_model *php_svm_compact_carrier(const struct svm_parameter *param, int nr_class, int l)
+{
+	struct svm_model *r = calloc(1, sizeof(struct svm_model));
+	int nr_dec = (param->svm_type == C_SVC || param->svm_type == NU_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+
+	r->param.svm_type = param->svm_type;
+	r->param.kernel_type = param->kernel_type;
+	r->param.degree = param->degree;
+	r->param.gamma = param->gamma;
+	r->param.coef0 = param->coef0;
+	r->nr_class = nr_class;
+	r->l = l;
+	r->free_sv = 1;
+	r->rho = calloc(nr_dec, sizeof(double));
+	if (param->svm_type == C_SVC || param->svm_type == NU_SVC) {
+		r->label = calloc(nr_class, sizeof(int));
+		r->nSV = calloc(nr_class, sizeof(int));
+	}
+	return r;
+}
+/* }}} */
+
+/* {{{ struct svm_model *php_svm_compact_fit(const struct svm_model *model, int storage, zend_bool float_coef, php_svm_compact **compact_ptr)
+Copy the SVs of a model into float or int8 storage, and the coefficients into floats when float_coef is set. Returns
+the carrier model, which shares nothing with the original.
+*/
+struct svm_model *php_svm_compact_fit(const struct svm_model *model, int storage, zend_bool float_coef, php_svm_compact **compact_ptr)
+{
+	php_svm_compact *compact;
+	struct svm_model *r;
+	const struct svm_node *n;
+	size_t nnz = 0;
+	int i, j, k;
+	int l = model->l, nr_class = model->nr_class;
+	int nr_dec = (model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+
+	for (i = 0; i < l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			nnz++;
+		}
+	}
+
+	compact = php_svm_compact_new(l, nnz);
+	for (i = 0, k = 0; i < l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++, k++) {
+			compact->index[k] = n->index;
+			compact->value[k] = (float)n->value;
+		}
+		compact->row[i + 1] = k;
+	}
+	if (storage == PHP_SVM_STORAGE_INT8) {
+		php_svm_compact_finish(compact, &model->param, PHP_SVM_DENSE_I8_ALIGN);
+		php_svm_compact_quantize(compact, &model->param);
+	} else {
+		php_svm_compact_finish(compact, &model->param, PHP_SVM_DENSE_ALIGN);
+	}
+
+	r = php_svm_compact_carrier(&model->param, nr_class, l);
+	memcpy(r->rho, model->rho, nr_dec * sizeof(double));
+	if (r->label && model->label) {
+		memcpy(r->label, model->label, nr_class * sizeof(int));
+	}
+	if (r->nSV && model->nSV) {
+		memcpy(r->nSV, model->nSV, nr_class * sizeof(int));
+	}
+	if (model->probA) {
+		r->probA = malloc(nr_dec * sizeof(double));
+		memcpy(r->probA, model->probA, nr_dec * sizeof(double));
+	}
+	if (model->probB) {
+		r->probB = malloc(nr_dec * sizeof(double));
+		memcpy(r->probB, model->probB, nr_dec * sizeof(double));
+	}
+
+	if (float_coef) {
+		compact->coef = safe_emalloc((size_t)(nr_class - 1) * (l > 0 ? l : 1), sizeof(float), 0);
+		for (j = 0; j < nr_class - 1; j++) {
+			for (i = 0; i < l; i++) {
+				compact->coef[(size_t)j * l + i] = (float)model->sv_coef[j][i];
+			}
+		}
+	} else {
+		r->sv_coef = malloc((nr_class - 1) * sizeof(double *));
+		for (j = 0; j < nr_class - 1; j++) {
+			r->sv_coef[j] = malloc((l > 0 ? l : 1) * sizeof(double));
+			memcpy(r->sv_coef[j], model->sv_coef[j], l * sizeof(double));
+		}
+	}
+
+	*compact_ptr = compact;
+	return r;
+}
+/* }}} */
+
+/* {{{ size_t php_svm_compact_memory(const php_svm_compact *compact, const struct svm_model *model)
+Bytes held by the storage of a model.
+*/
+size_t php_svm_compact_memory(const php_svm_compact *compact, const struct svm_model *model)
+{
+	size_t bytes = sizeof(php_svm_compact);
+	size_t size = compact->storage == PHP_SVM_STORAGE_INT8 ? sizeof(int8_t) : sizeof(float);
+
+	if (compact->stride) {
+		bytes += (size_t)compact->l * compact->stride * size;
+	} else {
+		bytes += ((size_t)compact->l + 1) * sizeof(int);
+		bytes += (size_t)compact->row[compact->l] * (sizeof(int) + size);
+	}
+	if (compact->scale) {
+		bytes += (size_t)(compact->stride ? compact->stride : compact->l) * sizeof(double);
+	}
+	if (compact->sv_sq) {
+		bytes += (size_t)compact->l * sizeof(double);
+	}
+	if (compact->coef) {
+		bytes += (size_t)(model->nr_class - 1) * compact->l * sizeof(float);
+	}
+	return bytes;
+}
+/* }}} */
+
+/* {{{ void php_svm_compact_free(php_svm_compact *compact)
+Release the storage.
+*/
+void php_svm_compact_free(php_svm_compact *compact)
+{
+	if (compact->row) {
+		efree(compact->row);
+		efree(compact->index);
+	}
+	if (compact->value) {
+		efree(compact->value);
+	}
+	if (compact->qvalue) {
+		efree(compact->qvalue);
+	}
+	if (compact->scale) {
+		efree(compact->scale);
+	}
+	if (compact->coef) {
+		efree(compact->coef);
+	}
+	if (compact->sv_sq) {
+		efree(compact->sv_sq);
+	}
+	efree(compact);
+}
+/* }}} */
+
+/* ---- END STORAGE FUNCS ---- */
+
+/* ---- START KERNEL FUNCS ---- */
+
+/* {{{ static double php_svm_compact_dot(const struct svm_node *x, const int *index, const float *value, int n)
+Dot product of an index ordered row with one CSR row of n values.
+*/
+static zend_always_inline double php_svm_compact_dot(const struct svm_node *x, const int *index, const float *value, int n)
+{
+	double sum = 0;
+	int k = 0;
+
+	while (x->index != -1 && k < n) {
+		if (x->index == index[k]) {
+			sum += x->value * value[k];
+			++x;
+			++k;
+		} else if (x->index > index[k]) {
+			++k;
+		} else {
+			++x;
+		}
+	}
+	return sum;
+}
+/* }}} */
+
+/* {{{ static double php_svm_compact_dot_i8(const struct svm_node *x, const int *index, const int8_t *value, int n)
+php_svm_compact_dot for a CSR row of int8 values, before scaling.
+*/
+static zend_always_inline double php_svm_compact_dot_i8(const struct svm_node *x, const int *index, const int8_t *value, int n)
+{
+	double sum = 0;
+	int k = 0;
+
+	while (x->index != -1 && k < n) {
+		if (x->index == index[k]) {
+			sum += x->value * value[k];
+			++x;
+			++k;
+		} else if (x->index > index[k]) {
+			++k;
+		} else {
+			++x;
+		}
+	}
+	return sum;
+}
+/* }}} */
+
+/* {{{ static double php_svm_compact_kernel(const struct svm_parameter *param, double dot, double x_sq, double sv_sq)
+Kernel value from the dot product of a row with an SV, and for RBF their squared norms.
+*/
+static zend_always_inline double php_svm_compact_kernel(const struct svm_parameter *param, double dot, double x_sq, double sv_sq)
+{
+	switch (param->kernel_type) {
+		case LINEAR:
+			return dot;
+		case POLY:
+			return php_svm_powi(param->gamma * dot + param->coef0, param->degree);
+		case RBF:
+			return exp(-param->gamma * (x_sq + sv_sq - 2 * dot));
+		case SIGMOID:
+			return tanh(param->gamma * dot + param->coef0);
+	}
+	return 0;
+}
+/* }}} */
+
+/* {{{ static void php_svm_compact_kernels_int8(const struct svm_model *model, const php_svm_compact *compact, const struct svm_node *x, const double *xd, double x_sq, int s0, int s1, double *kvalue)
+php_svm_compact_kernels for int8 storage. With the dense layout the row is brought to the units of the feature
+scales and quantized to 16 bits against its largest value, which loses far less than the int8 SVs do, and each
+dot product is a single integer sum.
+*/
+static void php_svm_compact_kernels_int8(const struct svm_model *model, const php_svm_compact *compact, const struct svm_node *x, const double *xd, double x_sq, int s0, int s1, double *kvalue)
+{
+	const struct svm_parameter *param = &model->param;
+	int i, k;
+
+	if (compact->stride) {
+		php_svm_dense_i8_func dot = php_svm_simd_impl.dot_i8;
+		int16_t xq[PHP_SVM_DENSE_MAX_DIM];
+		int stride = compact->stride;
+		const int8_t *sv = compact->qvalue + (size_t)s0 * stride;
+		double max = 0, unit;
+
+		for (k = 0; k < stride; k++) {
+			x_sq += xd[k] * xd[k];
+			max = MAX(max, fabs(xd[k] * compact->scale[k]));
+		}
+		unit = max / 32767;
+		for (k = 0; k < stride; k++) {
+			xq[k] = unit > 0 ? (int16_t)floor(xd[k] * compact->scale[k] / unit + 0.5) : 0;
+		}
+
+		for (i = s0; i < s1; i++, sv += stride) {
+			kvalue[i] = php_svm_compact_kernel(param, unit * (double)dot(xq, sv, stride), x_sq, compact->sv_sq ? compact->sv_sq[i] : 0);
+		}
+		return;
+	}
+
+	for (i = s0; i < s1; i++) {
+		k = compact->row[i];
+		kvalue[i] = php_svm_compact_kernel(param,
+			compact->scale[i] * php_svm_compact_dot_i8(x, compact->index + k, compact->qvalue + k, compact->row[i + 1] - k),
+			x_sq, compact->sv_sq ? compact->sv_sq[i] : 0);
+	}
+}
+/* }}} */
+
+/* {{{ void php_svm_compact_kernels(const struct svm_model *model, const php_svm_compact *compact, const struct svm_node *x, const double *xd, double x_sq, int s0, int s1, double *kvalue)
+Kernel values of a row against SVs s0 to s1-1. With the dense layout xd is the row scattered to the stride of
+the matrix and x_sq the squared norm of its features outside the matrix; with CSR rows x_sq is the squared norm
+of the whole row, needed for RBF only.
+*/
+void php_svm_compact_kernels(const struct svm_model *model, const php_svm_compact *compact, const struct svm_node *x, const double *xd, double x_sq, int s0, int s1, double *kvalue)
+{
+	const struct svm_parameter *param = &model->param;
+	int i;
+
+	if (compact->storage == PHP_SVM_STORAGE_INT8) {
+		php_svm_compact_kernels_int8(model, compact, x, xd, x_sq, s0, s1, kvalue);
+		return;
+	}
+
+	if (compact->stride) {
+		php_svm_dense_f32_func dot = php_svm_simd_impl.dot_f32;
+		int stride = compact->stride;
+		const float *sv = compact->value + (size_t)s0 * stride;
+
+		switch (param->kernel_type) {
+			case LINEAR:
+				for (i = s0; i < s1; i++, sv += stride) {
+					kvalue[i] = dot(xd, sv, stride);
+				}
+				break;
+			case POLY:
+				for (i = s0; i < s1; i++, sv += stride) {
+					kvalue[i] = php_svm_powi(param->gamma * dot(xd, sv, stride) + param->coef0, param->degree);
+				}
+				break;
+			case RBF:
+			{
+				php_svm_dense_f32_func dist = php_svm_simd_impl.dist_f32;
+
+				for (i = s0; i < s1; i++, sv += stride) {
+					kvalue[i] = exp(-param->gamma * (dist(xd, sv, stride) + x_sq));
+				}
+				break;
+			}
+			case SIGMOID:
+				for (i = s0; i < s1; i++, sv += stride) {
+					kvalue[i] = tanh(param->gamma * dot(xd, sv, stride) + param->coef0);
+				}
+				break;
+		}
+		return;
+	}
+
+	for (i = s0; i < s1; i++) {
+		int k = compact->row[i];
+
+		kvalue[i] = php_svm_compact_kernel(param, php_svm_compact_dot(x, compact->index + k, compact->value + k, compact->row[i + 1] - k),
+			x_sq, compact->sv_sq ? compact->sv_sq[i] : 0);
+	}
+}
+/* }}} */
+
+/* ---- END KERNEL FUNCS ---- */
+
+/* ---- START FILE FUNCS ---- */
+
+/* {{{ zend_bool php_svm_compact_save(php_stream *stream, const struct svm_model *model, const php_svm_compact *compact)
+Write a model with float or int8 storage. The layout follows libsvm's model files, under a header of its own so
+the values are read back as stored. Floats are written with 9 significant digits, enough to read back the same
+float, and int8 values as the integers they are, with the scale factors in the header.
+*/
+zend_bool php_svm_compact_save(php_stream *stream, const struct svm_model *model, const php_svm_compact *compact)
+{
+	const struct svm_parameter *param = &model->param;
+	int nr_class = model->nr_class;
+	int nr_dec = (param->svm_type == C_SVC || param->svm_type == NU_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+	int i, j, k;
+
+	php_stream_printf(stream, "%s\n", php_svm_compact_magic);
+	php_stream_printf(stream, "storage %s\n", compact->storage == PHP_SVM_STORAGE_INT8 ? "int8" : "float32");
+	php_stream_printf(stream, "svm_type %s\n", php_svm_svm_type_names[param->svm_type]);
+	php_stream_printf(stream, "kernel_type %s\n", php_svm_kernel_type_names[param->kernel_type]);
+	if (param->kernel_type == POLY) {
+		php_stream_printf(stream, "degree %d\n", param->degree);
+	}
+	if (param->kernel_type == POLY || param->kernel_type == RBF || param->kernel_type == SIGMOID) {
+		php_stream_printf(stream, "gamma %.17H\n", param->gamma);
+	}
+	if (param->kernel_type == POLY || param->kernel_type == SIGMOID) {
+		php_stream_printf(stream, "coef0 %.17H\n", param->coef0);
+	}
+	php_stream_printf(stream, "nr_class %d\n", nr_class);
+	php_stream_printf(stream, "total_sv %d\n", compact->l);
+	php_svm_write_values(stream, "rho", model->rho, nr_dec);
+	if (model->label) {
+		php_stream_printf(stream, "label");
+		for (i = 0; i < nr_class; i++) {
+			php_stream_printf(stream, " %d", model->label[i]);
+		}
+		php_stream_write(stream, "\n", 1);
+	}
+	if (model->probA) {
+		php_svm_write_values(stream, "probA", model->probA, nr_dec);
+	}
+	if (model->probB) {
+		php_svm_write_values(stream, "probB", model->probB, nr_dec);
+	}
+	if (model->nSV) {
+		php_stream_printf(stream, "nr_sv");
+		for (i = 0; i < nr_class; i++) {
+			php_stream_printf(stream, " %d", model->nSV[i]);
+		}
+		php_stream_write(stream, "\n", 1);
+	}
+	php_stream_printf(stream, "coef %s\n", compact->coef ? "float32" : "float64");
+	if (compact->storage == PHP_SVM_STORAGE_INT8 && compact->stride) {
+		php_stream_printf(stream, "dim %d\n", compact->dim);
+		php_svm_write_values(stream, "feature_scale", compact->scale, compact->dim);
+	} else if (compact->storage == PHP_SVM_STORAGE_INT8) {
+		php_svm_write_values(stream, "sv_scale", compact->scale, compact->l);
+	}
+	php_stream_printf(stream, "SV\n");
+
+	for (i = 0; i < compact->l; i++) {
+		for (j = 0; j < nr_class - 1; j++) {
+			if (compact->coef) {
+				php_stream_printf(stream, "%.9H ", (double)compact->coef[(size_t)j * compact->l + i]);
+			} else {
+				php_stream_printf(stream, "%.17H ", model->sv_coef[j][i]);
+			}
+		}
+		if (compact->storage == PHP_SVM_STORAGE_INT8 && compact->stride) {
+			const int8_t *sv = compact->qvalue + (size_t)i * compact->stride;
+
+			for (k = 0; k < compact->dim; k++) {
+				if (sv[k] != 0) {
+					php_stream_printf(stream, "%d:%d ", k, (int)sv[k]);
+				}
+			}
+		} else if (compact->storage == PHP_SVM_STORAGE_INT8) {
+			for (k = compact->row[i]; k < compact->row[i + 1]; k++) {
+				php_stream_printf(stream, "%d:%d ", compact->index[k], (int)compact->qvalue[k]);
+			}
+		} else if (compact->stride) {
+			const float *sv = compact->value + (size_t)i * compact->stride;
+
+			for (k = 0; k < compact->dim; k++) {
+				if (sv[k] != 0) {
+					php_stream_printf(stream, "%d:%.9H ", k, (double)sv[k]);
+				}
+			}
+		} else {
+			for (k = compact->row[i]; k < compact->row[i + 1]; k++) {
+				php_stream_printf(stream, "%d:%.9H ", compact->index[k], (double)compact->value[k]);
+			}
+		}
+		php_stream_write(stream, "\n", 1);
+	}
+
+	return 1;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_compact_read_sv(php_svm_compact *compact, struct svm_model *model, int i, const char *p, size_t *cap)
+Parse the line of SV i into the coefficients and the CSR rows, growing the rows as needed.
+*/
+static zend_bool php_svm_compact_read_sv(php_svm_compact *compact, struct svm_model *model, int i, const char *p, size_t *cap)
+{
+	int j, k = compact->row[i];
+	const char *end;
+	char *iend;
+
+	for (j = 0; j < model->nr_class - 1; j++) {
+		double coef = zend_strtod(p, &end);
+
+		if (end == p) {
+			return 0;
+		}
+		if (compact->coef) {
+			compact->coef[(size_t)j * compact->l + i] = (float)coef;
+		} else {
+			model->sv_coef[j][i] = coef;
+		}
+		p = end;
+	}
+
+	for (;;) {
+		long index;
+
+		while (*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if (!*p) {
+			break;
+		}
+
+		index = strtol(p, &iend, 10);
+		if (iend == p || *iend != ':' || index < INT_MIN || index > INT_MAX) {
+			return 0;
+		}
+		p = iend + 1;
+
+		if ((size_t)k == *cap) {
+			*cap *= 2;
+			compact->index = safe_erealloc(compact->index, *cap, sizeof(int), 0);
+			compact->value = safe_erealloc(compact->value, *cap, sizeof(float), 0);
+		}
+		compact->index[k] = (int)index;
+		compact->value[k] = (float)zend_strtod(p, &end);
+		if (end == p) {
+			return 0;
+		}
+		p = end;
+		k++;
+	}
+
+	compact->row[i + 1] = k;
+	return 1;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_compact_check_int8(const php_svm_compact *compact, int dim)
+Whether the CSR rows read from an int8 file hold whole numbers in the int8 range, and for the dense layout, when
+dim is not -1, only features below dim.
+*/
+static zend_bool php_svm_compact_check_int8(const php_svm_compact *compact, int dim)
+{
+	size_t k, nnz = compact->row[compact->l];
+
+	for (k = 0; k < nnz; k++) {
+		float v = compact->value[k];
+
+		if (v < -127 || v > 127 || v != floorf(v)) {
+			return 0;
+		}
+		if (dim != -1 && (compact->index[k] < 0 || compact->index[k] >= dim)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+/* }}} */
+
+/* {{{ int php_svm_compact_load(php_stream *stream, struct svm_model **model_ptr, php_svm_compact **compact_ptr)
+Read a model saved by php_svm_compact_save. Returns 1 on success, 0 if the stream doesn't hold a float or int8
+storage model, so the caller can try other formats, and -1 if it holds one that can't be read.
+*/
+int php_svm_compact_load(php_stream *stream, struct svm_model **model_ptr, php_svm_compact **compact_ptr)
+{
+	char *line;
+	struct svm_parameter param;
+	int nr_class = 0, l = 0, nr_dec = 0, storage = 0, float_coef = -1, dim = -1, i, j, ok = 0;
+	double *rho = NULL, *probA = NULL, *probB = NULL, *scale = NULL;
+	zend_bool feature_scale = 0;
+	int *label = NULL, *nr_sv = NULL;
+	size_t cap;
+	struct svm_model *model = NULL;
+	php_svm_compact *compact = NULL;
+
+	line = php_svm_get_line(stream);
+	if (!line || strcmp(line, php_svm_compact_magic) != 0) {
+		if (line) {
+			efree(line);
+		}
+		return 0;
+	}
+	efree(line);
+
+	memset(&param, 0, sizeof(param));
+	param.svm_type = -1;
+	param.kernel_type = -1;
+
+	while ((line = php_svm_get_line(stream)) != NULL) {
+		char *arg = strchr(line, ' ');
+
+		if (arg) {
+			*arg++ = '\0';
+		}
+
+		if (!strcmp(line, "SV")) {
+			efree(line);
+			break;
+		} else if (!arg) {
+			efree(line);
+			goto done;
+		} else if (!strcmp(line, "storage")) {
+			storage = !strcmp(arg, "float32") ? PHP_SVM_STORAGE_FLOAT32 : (!strcmp(arg, "int8") ? PHP_SVM_STORAGE_INT8 : 0);
+		} else if (!strcmp(line, "svm_type")) {
+			param.svm_type = php_svm_find_name(php_svm_svm_type_names, arg);
+		} else if (!strcmp(line, "kernel_type")) {
+			param.kernel_type = php_svm_find_name(php_svm_kernel_type_names, arg);
+		} else if (!strcmp(line, "degree")) {
+			param.degree = atoi(arg);
+		} else if (!strcmp(line, "gamma")) {
+			param.gamma = zend_strtod(arg, NULL);
+		} else if (!strcmp(line, "coef0")) {
+			param.coef0 = zend_strtod(arg, NULL);
+		} else if (!strcmp(line, "nr_class") && !rho) {
+			nr_class = atoi(arg);
+			nr_dec = (param.svm_type == C_SVC || param.svm_type == NU_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+			if (nr_class < 2 || nr_dec < 1) {
+				efree(line);
+				goto done;
+			}
+			rho = ecalloc(nr_dec, sizeof(double));
+		} else if (!strcmp(line, "total_sv")) {
+			l = atoi(arg);
+		} else if (!strcmp(line, "rho") && rho) {
+			php_svm_read_values(arg, rho, nr_dec);
+		} else if (!strcmp(line, "label") && rho && !label) {
+			char *p = arg;
+
+			label = ecalloc(nr_class, sizeof(int));
+			for (i = 0; i < nr_class; i++) {
+				label[i] = (int)strtol(p, &p, 10);
+			}
+		} else if (!strcmp(line, "probA") && rho && !probA) {
+			probA = ecalloc(nr_dec, sizeof(double));
+			php_svm_read_values(arg, probA, nr_dec);
+		} else if (!strcmp(line, "probB") && rho && !probB) {
+			probB = ecalloc(nr_dec, sizeof(double));
+			php_svm_read_values(arg, probB, nr_dec);
+		} else if (!strcmp(line, "nr_sv") && rho && !nr_sv) {
+			char *p = arg;
+
+			nr_sv = ecalloc(nr_class, sizeof(int));
+			for (i = 0; i < nr_class; i++) {
+				nr_sv[i] = (int)strtol(p, &p, 10);
+			}
+		} else if (!strcmp(line, "coef")) {
+			float_coef = !strcmp(arg, "float32") ? 1 : (!strcmp(arg, "float64") ? 0 : -1);
+		} else if (!strcmp(line, "dim")) {
+			dim = atoi(arg);
+		} else if (!strcmp(line, "feature_scale") && dim > 0 && dim <= PHP_SVM_DENSE_MAX_DIM && !scale) {
+			/* Padded to the stride of the matrix, as the kernels run over whole rows */
+			scale = ecalloc((dim + PHP_SVM_DENSE_I8_ALIGN - 1) / PHP_SVM_DENSE_I8_ALIGN * PHP_SVM_DENSE_I8_ALIGN, sizeof(double));
+			feature_scale = 1;
+			if (php_svm_read_values(arg, scale, dim) != dim) {
+				efree(line);
+				goto done;
+			}
+		} else if (!strcmp(line, "sv_scale") && l > 0 && !scale) {
+			scale = safe_emalloc(l, sizeof(double), 0);
+			if (php_svm_read_values(arg, scale, l) != l) {
+				efree(line);
+				goto done;
+			}
+		}
+		efree(line);
+	}
+
+	if (!storage || param.svm_type < 0 || param.kernel_type < 0 ||
+		param.kernel_type == PRECOMPUTED || !rho || l <= 0 || float_coef < 0) {
+		goto done;
+	}
+	if (storage == PHP_SVM_STORAGE_INT8 && !scale) {
+		goto done;
+	}
+	if (param.svm_type == C_SVC || param.svm_type == NU_SVC) {
+		int total = 0;
+
+		if (!nr_sv) {
+			goto done;
+		}
+		for (i = 0; i < nr_class; i++) {
+			if (nr_sv[i] < 0) {
+				goto done;
+			}
+			total += nr_sv[i];
+		}
+		if (total != l) {
+			goto done;
+		}
+	}
+
+	model = php_svm_compact_carrier(&param, nr_class, l);
+	memcpy(model->rho, rho, nr_dec * sizeof(double));
+	if (model->label && label) {
+		memcpy(model->label, label, nr_class * sizeof(int));
+	}
+	if (model->nSV) {
+		memcpy(model->nSV, nr_sv, nr_class * sizeof(int));
+	}
+	if (probA) {
+		model->probA = malloc(nr_dec * sizeof(double));
+		memcpy(model->probA, probA, nr_dec * sizeof(double));
+	}
+	if (probB) {
+		model->probB = malloc(nr_dec * sizeof(double));
+		memcpy(model->probB, probB, nr_dec * sizeof(double));
+	}
+
+	cap = (size_t)l * 4;
+	compact = php_svm_compact_new(l, cap);
+	if (float_coef) {
+		compact->coef = safe_emalloc((size_t)(nr_class - 1) * l, sizeof(float), 0);
+	} else {
+		model->sv_coef = malloc((nr_class - 1) * sizeof(double *));
+		for (j = 0; j < nr_class - 1; j++) {
+			model->sv_coef[j] = malloc(l * sizeof(double));
+		}
+	}
+
+	for (i = 0; i < l; i++) {
+		line = php_svm_get_line(stream);
+		if (!line) {
+			goto done;
+		}
+		if (!php_svm_compact_read_sv(compact, model, i, line, &cap)) {
+			efree(line);
+			goto done;
+		}
+		efree(line);
+	}
+
+	if (storage == PHP_SVM_STORAGE_INT8) {
+		/* The layout the model was quantized in, as the scale factors only fit that one */
+		if (!php_svm_compact_check_int8(compact, feature_scale ? dim : -1)) {
+			goto done;
+		}
+		if (feature_scale) {
+			compact->dim = dim;
+			php_svm_compact_densify(compact, PHP_SVM_DENSE_I8_ALIGN);
+		} else {
+			php_svm_compact_measure(compact);
+		}
+		php_svm_compact_pack_int8(compact, &model->param, scale);
+		scale = NULL;
+	} else {
+		php_svm_compact_finish(compact, &model->param, PHP_SVM_DENSE_ALIGN);
+	}
+	ok = 1;
+
+done:
+	if (rho) {
+		efree(rho);
+	}
+	if (label) {
+		efree(label);
+	}
+	if (nr_sv) {
+		efree(nr_sv);
+	}
+	if (probA) {
+		efree(probA);
+	}
+	if (probB) {
+		efree(probB);
+	}
+	if (scale) {
+		efree(scale);
+	}
+	if (!ok) {
+		if (compact) {
+			php_svm_compact_free(compact);
+		}
+		if (model) {
+#if LIBSVM_VERSION >= 300
+			svm_free_and_destroy_model(&model);
+#else
+			svm_destroy_model(model);
+#endif
+		}
+		return -1;
+	}
+
+	*model_ptr = model;
+	*compact_ptr = compact;
+	return 1;
+}
+/* }}} */
+
+/* ---- END FILE FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
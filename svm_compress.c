@@ -0,0 +1,524 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+#include <math.h>
+
+#ifndef TRUE
+#       define TRUE 1
+#       define FALSE 0
+#endif
+
+/*
+ * Reduced-set compression. A subset of the SVs is picked by pivoted Cholesky factorisation of their kernel
+ * matrix, K ~ L^T L, choosing at each step the SV with the largest residual norm in feature space weighted by
+ * its coefficients. The coefficients and rho of each decision function are then refit by least squares so
+ * that, using only the kept SVs of its two classes, it reproduces the original decision values at every
+ * original SV. The factor holds the kernel values needed for that, so the refit evaluates no kernels.
+ *
+ * The resulting model is an ordinary svm_model, allocated with malloc like one from svm_load_model, so that
+ * it can be saved with svm_save_model and released with svm_free_and_destroy_model.
+ */
+
+/* ---- START FACTOR FUNCS ---- */
+
+typedef struct _php_svm_factor {
+	int l;
+	int m;          /* pivots so far */
+	int cap;        /* rows allocated */
+	double *L;      /* cap x l, row k holds the factor of pivot k for every SV */
+	double *d;      /* residual diagonal */
+	double *w;      /* squared coefficient norm of each SV */
+	char *taken;    /* whether each SV is a pivot */
+	double tol;
+} php_svm_factor;
+
+/* {{{ static void php_svm_factor_init(php_svm_factor *f, const struct svm_model *model)
+Start an empty factorisation of the kernel matrix of the SVs of model.
+*/
+static void php_svm_factor_init(php_svm_factor *f, const struct svm_model *model)
+{
+	int i, j;
+	double max_d = 0;
+
+	f->l = model->l;
+	f->m = 0;
+	f->cap = 0;
+	f->L = NULL;
+	f->d = safe_emalloc(model->l, sizeof(double), 0);
+	f->w = ecalloc(model->l, sizeof(double));
+	f->taken = ecalloc(model->l, 1);
+
+	for (i = 0; i < model->l; i++) {
+		f->d[i] = php_svm_kernel(model->SV[i], model->SV[i], &model->param);
+		if (f->d[i] > max_d) {
+			max_d = f->d[i];
+		}
+		for (j = 0; j < model->nr_class - 1; j++) {
+			f->w[i] += model->sv_coef[j][i] * model->sv_coef[j][i];
+		}
+	}
+	/* Below this the remaining SVs are already spanned by the pivots */
+	f->tol = 1e-12 * max_d;
+}
+/* }}} */
+
+/* {{{ static void php_svm_factor_free(php_svm_factor *f)
+Release everything php_svm_factor_init and php_svm_factor_grow allocated.
+*/
+static void php_svm_factor_free(php_svm_factor *f)
+{
+	if (f->L) {
+		efree(f->L);
+	}
+	efree(f->d);
+	efree(f->w);
+	efree(f->taken);
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_factor_grow(php_svm_factor *f, const struct svm_model *model, int m)
+Add pivots until there are m of them. Returns FALSE if the SVs ran out of rank first. The factor takes m * l
+doubles, so it is only grown as far as needed.
+*/
+static zend_bool php_svm_factor_grow(php_svm_factor *f, const struct svm_model *model, int m)
+{
+	int i, t;
+
+	if (m > f->cap) {
+		f->cap = m;
+		f->L = safe_erealloc(f->L, m, f->l * sizeof(double), 0);
+	}
+
+	while (f->m < m) {
+		int p = -1;
+		double best = 0, dp;
+		double *row = f->L + (size_t)f->m * f->l;
+
+		for (i = 0; i < f->l; i++) {
+			if (!f->taken[i] && f->d[i] > f->tol && f->d[i] * f->w[i] > best) {
+				best = f->d[i] * f->w[i];
+				p = i;
+			}
+		}
+		if (p < 0) {
+			return FALSE;
+		}
+
+		for (i = 0; i < f->l; i++) {
+			row[i] = php_svm_kernel(model->SV[p], model->SV[i], &model->param);
+		}
+		for (t = 0; t < f->m; t++) {
+			const double *prev = f->L + (size_t)t * f->l;
+			double lp = prev[p];
+
+			for (i = 0; i < f->l; i++) {
+				row[i] -= lp * prev[i];
+			}
+		}
+		dp = sqrt(f->d[p]);
+		for (i = 0; i < f->l; i++) {
+			row[i] /= dp;
+			f->d[i] -= row[i] * row[i];
+		}
+
+		f->taken[p] = 1;
+		f->d[p] = 0;
+		f->m++;
+	}
+	return TRUE;
+}
+/* }}} */
+
+/* ---- END FACTOR FUNCS ---- */
+
+/* ---- START MODEL FUNCS ---- */
+
+/* {{{ static int php_svm_sv_class(const struct svm_model *model, int i)
+Class index of SV i, 0 for the single function models.
+*/
+static int php_svm_sv_class(const struct svm_model *model, int i)
+{
+	int c, end = 0;
+
+	if (!model->nSV) {
+		return 0;
+	}
+	for (c = 0; c < model->nr_class; c++) {
+		end += model->nSV[c];
+		if (i < end) {
+			return c;
+		}
+	}
+	return model->nr_class - 1;
+}
+/* }}} */
+
+/* {{{ zend_bool php_svm_cholesky(double *G, int n)
+Cholesky factorisation in place of a symmetric positive definite n x n matrix, leaving the factor in the lower
+triangle. Returns FALSE if G turns out not to be positive definite.
+*/
+zend_bool php_svm_cholesky(double *G, int n)
+{
+	int i, j, k;
+
+	for (j = 0; j < n; j++) {
+		double *gj = G + (size_t)j * n;
+		double s = gj[j];
+
+		for (k = 0; k < j; k++) {
+			s -= gj[k] * gj[k];
+		}
+		if (s <= 0) {
+			return FALSE;
+		}
+		gj[j] = sqrt(s);
+		for (i = j + 1; i < n; i++) {
+			double *gi = G + (size_t)i * n;
+
+			s = gi[j];
+			for (k = 0; k < j; k++) {
+				s -= gi[k] * gj[k];
+			}
+			gi[j] = s / gj[j];
+		}
+	}
+	return TRUE;
+}
+/* }}} */
+
+/* {{{ void php_svm_cholesky_solve(const double *L, double *b, int n)
+Solve G x = b given the factor from php_svm_cholesky. The solution replaces b.
+*/
+void php_svm_cholesky_solve(const double *L, double *b, int n)
+{
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		const double *li = L + (size_t)i * n;
+		double s = b[i];
+
+		for (k = 0; k < i; k++) {
+			s -= li[k] * b[k];
+		}
+		b[i] = s / li[i];
+	}
+	for (i = n - 1; i >= 0; i--) {
+		double s = b[i];
+
+		for (k = i + 1; k < n; k++) {
+			s -= L[(size_t)k * n + i] * b[k];
+		}
+		b[i] = s / L[(size_t)i * n + i];
+	}
+}
+/* }}} */
+
+/* {{{ static struct svm_model *php_svm_compress_build(const struct svm_model *model, const php_svm_factor *f, const double *y)
+Build the reduced model on the current pivots of f: copy the kept SVs in their original order, so they stay
+grouped by class, and refit every decision function to the values y from php_svm_decision_values.
+*/
+static struct svm_model *php_svm_compress_build(const struct svm_model *model, const php_svm_factor *f, const double *y)
+{
+	int nr_class = model->nr_class;
+	int nr_dec = (model->nSV) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+	int l = model->l, m = f->m;
+	int i, j, k, c, p, s, nodes = 0;
+	int t, u, *keep, *cls, *z;
+	double *W, *Lsum, *Ly, *A, *AW, *G, *b, *kbar;
+	struct svm_model *r;
+	struct svm_node *space;
+
+	keep = safe_emalloc(m, sizeof(int), 0);
+	cls = safe_emalloc(l, sizeof(int), 0);
+	for (i = 0, k = 0; i < l; i++) {
+		cls[i] = php_svm_sv_class(model, i);
+		if (f->taken[i]) {
+			keep[k++] = i;
+		}
+	}
+
+	/* malloc rather than emalloc, libsvm frees the model */
+	r = calloc(1, sizeof(struct svm_model));
+	r->param = model->param;
+	r->param.nr_weight = 0;
+	r->param.weight_label = NULL;
+	r->param.weight = NULL;
+	r->nr_class = nr_class;
+	r->l = m;
+	r->free_sv = 1;
+
+	for (k = 0; k < m; k++) {
+		const struct svm_node *n = model->SV[keep[k]];
+		do {
+			nodes++;
+		} while ((n++)->index != -1);
+	}
+	r->SV = malloc(m * sizeof(struct svm_node *));
+	space = malloc(nodes * sizeof(struct svm_node));
+	for (k = 0; k < m; k++) {
+		const struct svm_node *n = model->SV[keep[k]];
+		r->SV[k] = space;
+		do {
+			*space++ = *n;
+		} while ((n++)->index != -1);
+	}
+
+	r->sv_coef = malloc((nr_class - 1) * sizeof(double *));
+	for (j = 0; j < nr_class - 1; j++) {
+		r->sv_coef[j] = calloc(m, sizeof(double));
+	}
+	r->rho = malloc(nr_dec * sizeof(double));
+	memcpy(r->rho, model->rho, nr_dec * sizeof(double));
+
+	if (model->label) {
+		r->label = malloc(nr_class * sizeof(int));
+		memcpy(r->label, model->label, nr_class * sizeof(int));
+	}
+	if (model->nSV) {
+		r->nSV = calloc(nr_class, sizeof(int));
+		for (k = 0; k < m; k++) {
+			r->nSV[cls[keep[k]]]++;
+		}
+	}
+	if (model->probA) {
+		r->probA = malloc(nr_dec * sizeof(double));
+		memcpy(r->probA, model->probA, nr_dec * sizeof(double));
+	}
+	if (model->probB) {
+		r->probB = malloc(nr_dec * sizeof(double));
+		memcpy(r->probB, model->probB, nr_dec * sizeof(double));
+	}
+#if LIBSVM_VERSION >= 317
+	if (model->sv_indices) {
+		r->sv_indices = malloc(m * sizeof(int));
+		for (k = 0; k < m; k++) {
+			r->sv_indices[k] = model->sv_indices[keep[k]];
+		}
+	}
+#endif
+
+	/* Fit each decision function on the original SVs: minimise sum_s (K(x_s, Z) beta + c - y_s)^2 over the
+	   kept SVs Z of its two classes and an intercept c, where y_s is the original value without rho. The factor
+	   gives K(x_s, z) = sum_t L[t][s] L[t][z] exactly for every pivot z, so no kernel needs evaluating. */
+	W = safe_emalloc(m, m * sizeof(double), 0);
+	Lsum = ecalloc(m, sizeof(double));
+	for (t = 0; t < m; t++) {
+		const double *lt = f->L + (size_t)t * l;
+
+		for (u = 0; u <= t; u++) {
+			const double *lu = f->L + (size_t)u * l;
+			double g = 0;
+
+			for (s = 0; s < l; s++) {
+				g += lt[s] * lu[s];
+			}
+			W[t * m + u] = W[u * m + t] = g;
+		}
+		for (s = 0; s < l; s++) {
+			Lsum[t] += lt[s];
+		}
+	}
+
+	/* Row k of A is the factor of kept SV k, AW = A W, and kbar[k] the mean of K(x_s, kept SV k) */
+	A = safe_emalloc(m, m * sizeof(double), 0);
+	AW = safe_emalloc(m, m * sizeof(double), 0);
+	kbar = ecalloc(m, sizeof(double));
+	for (k = 0; k < m; k++) {
+		double *ak = A + (size_t)k * m;
+
+		for (t = 0; t < m; t++) {
+			ak[t] = f->L[(size_t)t * l + keep[k]];
+			kbar[k] += ak[t] * Lsum[t];
+		}
+		kbar[k] /= l;
+		for (t = 0; t < m; t++) {
+			const double *wt = W + (size_t)t * m;
+			double g = 0;
+
+			for (c = 0; c < m; c++) {
+				g += ak[c] * wt[c];
+			}
+			AW[(size_t)k * m + t] = g;
+		}
+	}
+
+	Ly = safe_emalloc(m, sizeof(double), 0);
+	G = safe_emalloc(m, m * sizeof(double), 0);
+	b = safe_emalloc(m, sizeof(double), 0);
+	z = safe_emalloc(m, sizeof(int), 0);
+
+	p = 0;
+	for (i = 0; i < (model->nSV ? nr_class : 1); i++) {
+		for (j = i + 1; j < (model->nSV ? nr_class : 2); j++, p++) {
+			int nz = 0;
+			double ybar = 0, ridge = 0, c0;
+
+			for (t = 0; t < m; t++) {
+				const double *lt = f->L + (size_t)t * l;
+				double sum = 0;
+
+				for (s = 0; s < l; s++) {
+					sum += lt[s] * y[(size_t)s * nr_dec + p];
+				}
+				Ly[t] = sum;
+			}
+			for (s = 0; s < l; s++) {
+				ybar += y[(size_t)s * nr_dec + p];
+			}
+			ybar /= l;
+
+			for (k = 0; k < m; k++) {
+				if (!model->nSV || cls[keep[k]] == i || cls[keep[k]] == j) {
+					z[nz++] = k;
+				}
+			}
+			if (nz == 0) {
+				continue;
+			}
+
+			for (u = 0; u < nz; u++) {
+				const double *au = A + (size_t)z[u] * m;
+				const double *awu = AW + (size_t)z[u] * m;
+
+				for (c = 0; c <= u; c++) {
+					const double *ac = A + (size_t)z[c] * m;
+					double g = 0;
+
+					for (t = 0; t < m; t++) {
+						g += awu[t] * ac[t];
+					}
+					/* centred, which takes care of the intercept */
+					g -= l * kbar[z[u]] * kbar[z[c]];
+					G[u * nz + c] = G[c * nz + u] = g;
+				}
+				ridge = MAX(ridge, G[u * nz + u]);
+				b[u] = -l * kbar[z[u]] * ybar;
+				for (t = 0; t < m; t++) {
+					b[u] += au[t] * Ly[t];
+				}
+			}
+			for (u = 0; u < nz; u++) {
+				G[u * nz + u] += 1e-10 * ridge;
+			}
+
+			if (php_svm_cholesky(G, nz)) {
+				php_svm_cholesky_solve(G, b, nz);
+				c0 = ybar;
+				for (u = 0; u < nz; u++) {
+					int row = !model->nSV ? 0 : (cls[keep[z[u]]] == i ? j - 1 : i);
+					r->sv_coef[row][z[u]] = b[u];
+					c0 -= kbar[z[u]] * b[u];
+				}
+				r->rho[p] = model->rho[p] - c0;
+			}
+		}
+	}
+
+	efree(z);
+	efree(kbar);
+	efree(b);
+	efree(G);
+	efree(AW);
+	efree(A);
+	efree(Ly);
+	efree(Lsum);
+	efree(W);
+	efree(cls);
+	efree(keep);
+	return r;
+}
+/* }}} */
+
+/* ---- END MODEL FUNCS ---- */
+
+/* {{{ struct svm_model *php_svm_compress(const struct svm_model *model, int target, double max_error, struct svm_node **x, int rows, php_svm_compress_report *report)
+Build a model with fewer SVs approximating model. With a target, keep exactly that many SVs (fewer if the SVs
+span a smaller space). Otherwise grow the kept set until the largest decision value drift over the rows is at
+most max_error, stopping at half the SVs. Drift is measured on the given rows, or on the SVs when there are none.
+*/
+struct svm_model *php_svm_compress(const struct svm_model *model, int target, double max_error, struct svm_node **x, int rows, php_svm_compress_report *report)
+{
+	php_svm_factor f;
+	php_svm_predictor pred, pr;
+	struct svm_model *r = NULL;
+	double *y;
+	int m, cap;
+
+	if (rows == 0) {
+		x = model->SV;
+		rows = model->l;
+	}
+
+	cap = (target > 0) ? MIN(target, model->l) : MAX(model->l / 2, 1);
+	php_svm_factor_init(&f, model);
+	php_svm_predictor_init(&pred, model);
+	y = php_svm_decision_values(model, model->SV, model->l);
+
+	m = (target > 0) ? cap : MIN(PHP_SVM_COMPRESS_START, cap);
+	for (;;) {
+		zend_bool more = php_svm_factor_grow(&f, model, m);
+
+		if (r) {
+#if LIBSVM_VERSION >= 300
+			svm_free_and_destroy_model(&r);
+#else
+			svm_destroy_model(r);
+#endif
+		}
+		r = php_svm_compress_build(model, &f, y);
+		php_svm_predictor_init(&pr, r);
+		php_svm_drift(model, &pred, r, &pr, x, rows, &report->drift);
+		php_svm_predictor_free(&pr);
+
+		if (target > 0 || !more || f.m >= cap || report->drift.max_drift <= max_error) {
+			break;
+		}
+		m = MIN(cap, (int)(f.m * PHP_SVM_COMPRESS_GROWTH) + 1);
+	}
+
+	report->original_svs = model->l;
+	report->svs = r->l;
+
+	efree(y);
+	php_svm_predictor_free(&pred);
+	php_svm_factor_free(&f);
+	return r;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
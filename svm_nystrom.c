@@ -0,0 +1,665 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+#include <math.h>
+
+#ifndef TRUE
+#       define TRUE 1
+#       define FALSE 0
+#endif
+
+/*
+ * Low-rank training. Instead of solving the kernel dual over every row, a sample S of landmark rows is drawn
+ * and each row is mapped to phi(x) = L^-1 k_S(x), where K_SS = L L^T, so that phi(x).phi(y) is the Nystrom
+ * approximation of K(x, y). A linear SVM is then trained on phi by dual coordinate descent, which costs
+ * O(rows * rank) per pass with no kernel cache. The weights w map back to coefficients L^-T w on the landmarks,
+ * so the result is an ordinary svm_model with the landmarks as its SVs, predicting, saving and loading like
+ * one from svm_train.
+ *
+ * As with svm_train, classification is one-against-one: landmarks are drawn from every class in proportion to
+ * its size, and the function for classes i and j uses the landmarks of those two classes only, which keeps
+ * the model in libsvm's layout. Regression uses all the landmarks.
+ */
+
+/* ---- START SAMPLING FUNCS ---- */
+
+/* {{{ static uint64_t php_svm_nystrom_next(uint64_t *state)
+splitmix64. Sampling is seeded with a constant, so training the same data twice gives the same model.
+*/
+static uint64_t php_svm_nystrom_next(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	*state += 0x9E3779B97F4A7C15ULL;
+	return php_svm_mix64(x);
+}
+/* }}} */
+
+/* {{{ static void php_svm_nystrom_shuffle(uint64_t *state, int *v, int n, int k)
+Partial Fisher-Yates: leaves a uniform sample of k of the n values in v[0..k).
+*/
+static void php_svm_nystrom_shuffle(uint64_t *state, int *v, int n, int k)
+{
+	int i;
+
+	for (i = 0; i < k && i < n - 1; i++) {
+		int j = i + (int)(php_svm_nystrom_next(state) % (uint64_t)(n - i));
+		int t = v[i];
+
+		v[i] = v[j];
+		v[j] = t;
+	}
+}
+/* }}} */
+
+/* ---- END SAMPLING FUNCS ---- */
+
+/* ---- START FEATURE FUNCS ---- */
+
+typedef struct _php_svm_nystrom_map {
+	int r;
+	const struct svm_node **landmarks;
+	double *L;  /* r x r, Cholesky factor of the landmark kernel matrix */
+} php_svm_nystrom_map;
+
+/* {{{ static zend_bool php_svm_nystrom_map_init(php_svm_nystrom_map *map, const struct svm_node **landmarks, int r, const struct svm_parameter *param)
+Factor the kernel matrix of the landmarks. Duplicate or nearly dependent landmarks make it singular, so a small
+jitter is added to the diagonal, raised until the factorisation succeeds.
+*/
+static zend_bool php_svm_nystrom_map_init(php_svm_nystrom_map *map, const struct svm_node **landmarks, int r, const struct svm_parameter *param)
+{
+	double *K, trace = 0, scale, jitter;
+	int i, j;
+
+	K = safe_emalloc(r, r * sizeof(double), 0);
+	for (i = 0; i < r; i++) {
+		for (j = 0; j <= i; j++) {
+			K[(size_t)i * r + j] = K[(size_t)j * r + i] = php_svm_kernel(landmarks[i], landmarks[j], param);
+		}
+		trace += K[(size_t)i * r + i];
+	}
+
+	map->r = r;
+	map->landmarks = landmarks;
+	map->L = safe_emalloc(r, r * sizeof(double), 0);
+
+	scale = trace > 0 ? trace / r : 1;
+	for (jitter = PHP_SVM_APPROX_JITTER * scale; jitter < scale; jitter *= 100) {
+		memcpy(map->L, K, (size_t)r * r * sizeof(double));
+		for (i = 0; i < r; i++) {
+			map->L[(size_t)i * r + i] += jitter;
+		}
+		if (php_svm_cholesky(map->L, r)) {
+			efree(K);
+			return TRUE;
+		}
+	}
+
+	efree(K);
+	efree(map->L);
+	map->L = NULL;
+	return FALSE;
+}
+/* }}} */
+
+/* {{{ static void php_svm_nystrom_features(const php_svm_nystrom_map *map, const struct svm_node *x, const struct svm_parameter *param, double *phi)
+phi = L^-1 k_S(x), followed by a constant 1 for the intercept.
+*/
+static void php_svm_nystrom_features(const php_svm_nystrom_map *map, const struct svm_node *x, const struct svm_parameter *param, double *phi)
+{
+	int i, k, r = map->r;
+
+	for (i = 0; i < r; i++) {
+		const double *li = map->L + (size_t)i * r;
+		double s = php_svm_kernel(x, map->landmarks[i], param);
+
+		for (k = 0; k < i; k++) {
+			s -= li[k] * phi[k];
+		}
+		phi[i] = s / li[i];
+	}
+	phi[r] = 1;
+}
+/* }}} */
+
+/* {{{ static void php_svm_nystrom_coefficients(const php_svm_nystrom_map *map, double *w)
+Turn weights on phi into coefficients on the landmarks in place, alpha = L^-T w.
+*/
+static void php_svm_nystrom_coefficients(const php_svm_nystrom_map *map, double *w)
+{
+	int i, k, r = map->r;
+
+	for (i = r - 1; i >= 0; i--) {
+		double s = w[i];
+
+		for (k = i + 1; k < r; k++) {
+			s -= map->L[(size_t)k * r + i] * w[k];
+		}
+		w[i] = s / map->L[(size_t)i * r + i];
+	}
+}
+/* }}} */
+
+/* ---- END FEATURE FUNCS ---- */
+
+/* ---- START SOLVER FUNCS ---- */
+
+static zend_always_inline double php_svm_nystrom_dot(const double *a, const double *b, int n)
+{
+	double s = 0;
+	int k;
+
+	for (k = 0; k < n; k++) {
+		s += a[k] * b[k];
+	}
+	return s;
+}
+
+static zend_always_inline void php_svm_nystrom_axpy(double a, const double *x, double *y, int n)
+{
+	int k;
+
+	for (k = 0; k < n; k++) {
+		y[k] += a * x[k];
+	}
+}
+
+/* {{{ static void php_svm_nystrom_solve_svc(const double *phi, int n, int dim, const signed char *y, double Cp, double Cn, const struct svm_parameter *param, uint64_t *state, double *w)
+Hinge loss linear SVM over the n rows of phi, each dim wide, by dual coordinate descent with shrinking as in
+liblinear. Stops when the projected gradients of a pass span less than param->eps.
+*/
+static void php_svm_nystrom_solve_svc(const double *phi, int n, int dim, const signed char *y, double Cp, double Cn, const struct svm_parameter *param, uint64_t *state, double *w)
+{
+	double *alpha = ecalloc(n, sizeof(double));
+	double *QD = safe_emalloc(n, sizeof(double), 0);
+	int *index = safe_emalloc(n, sizeof(int), 0);
+	double PGmax_old = HUGE_VAL, PGmin_old = -HUGE_VAL;
+	int i, s, iter, active_size = n;
+
+	memset(w, 0, dim * sizeof(double));
+	for (i = 0; i < n; i++) {
+		const double *xi = phi + (size_t)i * dim;
+
+		QD[i] = php_svm_nystrom_dot(xi, xi, dim);
+		index[i] = i;
+	}
+
+	for (iter = 0; iter < PHP_SVM_APPROX_MAX_ITER; iter++) {
+		double PGmax_new = -HUGE_VAL, PGmin_new = HUGE_VAL;
+
+		php_svm_nystrom_shuffle(state, index, active_size, active_size);
+
+		for (s = 0; s < active_size; s++) {
+			const double *xi;
+			double G, PG = 0, C;
+
+			i = index[s];
+			xi = phi + (size_t)i * dim;
+			C = y[i] > 0 ? Cp : Cn;
+			G = y[i] * php_svm_nystrom_dot(w, xi, dim) - 1;
+
+			if (alpha[i] == 0) {
+				if (G > PGmax_old && param->shrinking) {
+					index[s--] = index[--active_size];
+					index[active_size] = i;
+					continue;
+				} else if (G < 0) {
+					PG = G;
+				}
+			} else if (alpha[i] == C) {
+				if (G < PGmin_old && param->shrinking) {
+					index[s--] = index[--active_size];
+					index[active_size] = i;
+					continue;
+				} else if (G > 0) {
+					PG = G;
+				}
+			} else {
+				PG = G;
+			}
+
+			PGmax_new = MAX(PGmax_new, PG);
+			PGmin_new = MIN(PGmin_new, PG);
+
+			if (fabs(PG) > 1e-12) {
+				double alpha_old = alpha[i];
+
+				alpha[i] = MIN(MAX(alpha[i] - G / QD[i], 0.0), C);
+				php_svm_nystrom_axpy((alpha[i] - alpha_old) * y[i], xi, w, dim);
+			}
+		}
+
+		if (PGmax_new - PGmin_new <= param->eps) {
+			if (active_size == n) {
+				break;
+			}
+			/* Converged on the shrunk problem, check once more with everything */
+			active_size = n;
+			PGmax_old = HUGE_VAL;
+			PGmin_old = -HUGE_VAL;
+			continue;
+		}
+		PGmax_old = PGmax_new > 0 ? PGmax_new : HUGE_VAL;
+		PGmin_old = PGmin_new < 0 ? PGmin_new : -HUGE_VAL;
+	}
+
+	efree(index);
+	efree(QD);
+	efree(alpha);
+}
+/* }}} */
+
+/* {{{ static void php_svm_nystrom_solve_svr(const double *phi, int n, int dim, const double *y, const struct svm_parameter *param, uint64_t *state, double *w)
+epsilon-insensitive linear regression over the n rows of phi by dual coordinate descent, as liblinear does it
+for L1 loss. Stops when no coefficient violates its optimality condition by more than param->eps.
+*/
+static void php_svm_nystrom_solve_svr(const double *phi, int n, int dim, const double *y, const struct svm_parameter *param, uint64_t *state, double *w)
+{
+	double *beta = ecalloc(n, sizeof(double));
+	double *QD = safe_emalloc(n, sizeof(double), 0);
+	int *index = safe_emalloc(n, sizeof(int), 0);
+	double C = param->C, p = param->p;
+	int i, s, iter;
+
+	memset(w, 0, dim * sizeof(double));
+	for (i = 0; i < n; i++) {
+		const double *xi = phi + (size_t)i * dim;
+
+		QD[i] = php_svm_nystrom_dot(xi, xi, dim);
+		index[i] = i;
+	}
+
+	for (iter = 0; iter < PHP_SVM_APPROX_MAX_ITER; iter++) {
+		double violation_max = 0;
+
+		php_svm_nystrom_shuffle(state, index, n, n);
+
+		for (s = 0; s < n; s++) {
+			const double *xi;
+			double G, Gp, Gn, H, violation, d, beta_old;
+
+			i = index[s];
+			xi = phi + (size_t)i * dim;
+			H = QD[i];
+			G = php_svm_nystrom_dot(w, xi, dim) - y[i];
+			Gp = G + p;
+			Gn = G - p;
+
+			if (beta[i] == 0) {
+				violation = Gp < 0 ? -Gp : (Gn > 0 ? Gn : 0);
+			} else if (beta[i] >= C) {
+				violation = Gp > 0 ? Gp : 0;
+			} else if (beta[i] <= -C) {
+				violation = Gn < 0 ? -Gn : 0;
+			} else if (beta[i] > 0) {
+				violation = fabs(Gp);
+			} else {
+				violation = fabs(Gn);
+			}
+			violation_max = MAX(violation_max, violation);
+			if (violation <= 1e-12) {
+				continue;
+			}
+
+			/* Newton step on the piecewise quadratic, then clip to the box */
+			if (Gp < H * beta[i]) {
+				d = -Gp / H;
+			} else if (Gn > H * beta[i]) {
+				d = -Gn / H;
+			} else {
+				d = -beta[i];
+			}
+			beta_old = beta[i];
+			beta[i] = MIN(MAX(beta[i] + d, -C), C);
+			php_svm_nystrom_axpy(beta[i] - beta_old, xi, w, dim);
+		}
+
+		if (violation_max <= param->eps) {
+			break;
+		}
+	}
+
+	efree(index);
+	efree(QD);
+	efree(beta);
+}
+/* }}} */
+
+/* ---- END SOLVER FUNCS ---- */
+
+/* ---- START TRAIN FUNCS ---- */
+
+/* {{{ const char *php_svm_nystrom_check(const struct svm_problem *prob, const struct svm_parameter *param)
+What svm_check_parameter doesn't cover for low-rank training. Returns NULL if it can go ahead.
+*/
+const char *php_svm_nystrom_check(const struct svm_problem *prob, const struct svm_parameter *param)
+{
+	if (param->svm_type != C_SVC && param->svm_type != EPSILON_SVR) {
+		return "Low-rank training only supports C_SVC and EPSILON_SVR";
+	}
+	if (param->kernel_type == PRECOMPUTED) {
+		return "Low-rank training doesn't support precomputed kernels";
+	}
+	if (param->probability) {
+		return "Low-rank training doesn't support probability estimates";
+	}
+	if (prob->l < 2) {
+		return "Low-rank training needs at least two rows";
+	}
+	return NULL;
+}
+/* }}} */
+
+/* {{{ static struct svm_model *php_svm_nystrom_model(const struct svm_problem *prob, const struct svm_parameter *param, const int *landmarks, int m, int nr_class)
+An svm_model with copies of the landmark rows as its SVs and zero coefficients. Allocated with malloc, as
+libsvm frees it.
+*/
+static struct svm_model *php_svm_nystrom_model(const struct svm_problem *prob, const struct svm_parameter *param, const int *landmarks, int m, int nr_class)
+{
+	struct svm_model *r = calloc(1, sizeof(struct svm_model));
+	struct svm_node *space;
+	int j, k, nodes = 0;
+	int nr_dec = (param->svm_type == C_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+
+	r->param = *param;
+	r->param.nr_weight = 0;
+	r->param.weight_label = NULL;
+	r->param.weight = NULL;
+	r->nr_class = nr_class;
+	r->l = m;
+	r->free_sv = 1;
+
+	for (k = 0; k < m; k++) {
+		const struct svm_node *n = prob->x[landmarks[k]];
+		do {
+			nodes++;
+		} while ((n++)->index != -1);
+	}
+	r->SV = malloc(m * sizeof(struct svm_node *));
+	space = malloc(nodes * sizeof(struct svm_node));
+	for (k = 0; k < m; k++) {
+		const struct svm_node *n = prob->x[landmarks[k]];
+		r->SV[k] = space;
+		do {
+			*space++ = *n;
+		} while ((n++)->index != -1);
+	}
+
+	r->sv_coef = malloc((nr_class - 1) * sizeof(double *));
+	for (j = 0; j < nr_class - 1; j++) {
+		r->sv_coef[j] = calloc(m, sizeof(double));
+	}
+	r->rho = calloc(nr_dec, sizeof(double));
+
+#if LIBSVM_VERSION >= 317
+	r->sv_indices = malloc(m * sizeof(int));
+	for (k = 0; k < m; k++) {
+		r->sv_indices[k] = landmarks[k] + 1;
+	}
+#endif
+	return r;
+}
+/* }}} */
+
+/* {{{ static void php_svm_nystrom_fit(const php_svm_nystrom_map *map, const struct svm_problem *prob, const struct svm_parameter *param, const int *rows, int n, int n_pos, double Cp, double Cn, uint64_t *state, double *w)
+Map the rows and solve for one decision function, leaving the landmark coefficients in w[0..r) and the
+intercept in w[r]. For classification the first n_pos rows are the positive class.
+*/
+static void php_svm_nystrom_fit(const php_svm_nystrom_map *map, const struct svm_problem *prob, const struct svm_parameter *param, const int *rows, int n, int n_pos, double Cp, double Cn, uint64_t *state, double *w)
+{
+	int i, dim = map->r + 1;
+	double *phi = safe_emalloc(n, dim * sizeof(double), 0);
+
+	for (i = 0; i < n; i++) {
+		php_svm_nystrom_features(map, prob->x[rows[i]], param, phi + (size_t)i * dim);
+	}
+
+	if (param->svm_type == C_SVC) {
+		signed char *y = safe_emalloc(n, 1, 0);
+
+		for (i = 0; i < n; i++) {
+			y[i] = i < n_pos ? 1 : -1;
+		}
+		php_svm_nystrom_solve_svc(phi, n, dim, y, Cp, Cn, param, state, w);
+		efree(y);
+	} else {
+		double *y = safe_emalloc(n, sizeof(double), 0);
+
+		for (i = 0; i < n; i++) {
+			y[i] = prob->y[rows[i]];
+		}
+		php_svm_nystrom_solve_svr(phi, n, dim, y, param, state, w);
+		efree(y);
+	}
+
+	php_svm_nystrom_coefficients(map, w);
+	efree(phi);
+}
+/* }}} */
+
+/* {{{ static double php_svm_nystrom_weighted_C(const struct svm_parameter *param, int label)
+C for a class, scaled by its entry in the class weights if it has one.
+*/
+static double php_svm_nystrom_weighted_C(const struct svm_parameter *param, int label)
+{
+	int i;
+
+	for (i = 0; i < param->nr_weight; i++) {
+		if (param->weight_label[i] == label) {
+			return param->C * param->weight[i];
+		}
+	}
+	return param->C;
+}
+/* }}} */
+
+/* {{{ struct svm_model *php_svm_nystrom_train(const struct svm_problem *prob, const struct svm_parameter *param, int rank)
+Train with at most rank landmarks. Returns NULL if the landmark kernel matrix can't be factored, which only
+happens with kernels that aren't positive definite.
+*/
+struct svm_model *php_svm_nystrom_train(const struct svm_problem *prob, const struct svm_parameter *param, int rank)
+{
+	uint64_t state = 0;
+	int l = prob->l, m = MIN(rank, l);
+	int i, j, c, k, p, nr_class = 2;
+	int *label = NULL, *count = NULL, *start = NULL, *rows, *landmarks, *lm_count = NULL, *lm_start = NULL;
+	const struct svm_node **lm_nodes;
+	php_svm_nystrom_map map;
+	struct svm_model *r;
+	double *w;
+	zend_bool ok = TRUE;
+
+	rows = safe_emalloc(l, sizeof(int), 0);
+	landmarks = safe_emalloc(m + 1, sizeof(int), 0);
+
+	if (param->svm_type == EPSILON_SVR) {
+		for (i = 0; i < l; i++) {
+			rows[i] = i;
+		}
+		php_svm_nystrom_shuffle(&state, rows, l, m);
+		memcpy(landmarks, rows, m * sizeof(int));
+
+		r = php_svm_nystrom_model(prob, param, landmarks, m, 2);
+		lm_nodes = safe_emalloc(m, sizeof(struct svm_node *), 0);
+		memcpy(lm_nodes, r->SV, m * sizeof(struct svm_node *));
+
+		w = safe_emalloc(m + 1, sizeof(double), 0);
+		if (php_svm_nystrom_map_init(&map, lm_nodes, m, param)) {
+			php_svm_nystrom_fit(&map, prob, param, rows, l, 0, 0, 0, &state, w);
+			memcpy(r->sv_coef[0], w, m * sizeof(double));
+			r->rho[0] = -w[m];
+			efree(map.L);
+		} else {
+			ok = FALSE;
+		}
+		efree(w);
+		efree(lm_nodes);
+		goto done;
+	}
+
+	/* Group the rows by class, with labels in order of first appearance as svm_train has them */
+	label = safe_emalloc(l, sizeof(int), 0);
+	count = ecalloc(l, sizeof(int));
+	nr_class = 0;
+	for (i = 0; i < l; i++) {
+		int y = (int)prob->y[i];
+
+		for (c = 0; c < nr_class && label[c] != y; c++);
+		if (c == nr_class) {
+			label[nr_class++] = y;
+		}
+		count[c]++;
+	}
+	if (nr_class == 2 && label[0] == -1 && label[1] == 1) {
+		label[0] = 1;
+		label[1] = -1;
+		c = count[0];
+		count[0] = count[1];
+		count[1] = c;
+	}
+	if (nr_class < 2) {
+		efree(label);
+		efree(count);
+		efree(landmarks);
+		efree(rows);
+		return NULL;
+	}
+
+	start = safe_emalloc(nr_class, sizeof(int), 0);
+	start[0] = 0;
+	for (c = 1; c < nr_class; c++) {
+		start[c] = start[c - 1] + count[c - 1];
+	}
+	lm_count = safe_emalloc(nr_class, sizeof(int), 0);
+	lm_start = safe_emalloc(nr_class, sizeof(int), 0);
+	{
+		int *next = safe_emalloc(nr_class, sizeof(int), 0);
+
+		memcpy(next, start, nr_class * sizeof(int));
+		for (i = 0; i < l; i++) {
+			int y = (int)prob->y[i];
+
+			for (c = 0; label[c] != y; c++);
+			rows[next[c]++] = i;
+		}
+		efree(next);
+	}
+
+	/* Landmarks in proportion to the class sizes, at least one for every class */
+	for (c = 0, k = 0; c < nr_class; c++) {
+		lm_count[c] = MIN(MAX((int)((double)m * count[c] / l + 0.5), 1), count[c]);
+		lm_start[c] = k;
+		php_svm_nystrom_shuffle(&state, rows + start[c], count[c], lm_count[c]);
+		k += lm_count[c];
+	}
+	m = k;
+	landmarks = safe_erealloc(landmarks, m, sizeof(int), 0);
+	for (c = 0; c < nr_class; c++) {
+		memcpy(landmarks + lm_start[c], rows + start[c], lm_count[c] * sizeof(int));
+	}
+
+	r = php_svm_nystrom_model(prob, param, landmarks, m, nr_class);
+	r->label = malloc(nr_class * sizeof(int));
+	memcpy(r->label, label, nr_class * sizeof(int));
+	r->nSV = malloc(nr_class * sizeof(int));
+	memcpy(r->nSV, lm_count, nr_class * sizeof(int));
+
+	lm_nodes = safe_emalloc(m, sizeof(struct svm_node *), 0);
+	w = safe_emalloc(m + 1, sizeof(double), 0);
+	{
+		int *pair_rows = safe_emalloc(l, sizeof(int), 0);
+
+		p = 0;
+		for (i = 0; i < nr_class && ok; i++) {
+			for (j = i + 1; j < nr_class && ok; j++, p++) {
+				int ri = lm_count[i], rj = lm_count[j];
+
+				memcpy(lm_nodes, r->SV + lm_start[i], ri * sizeof(struct svm_node *));
+				memcpy(lm_nodes + ri, r->SV + lm_start[j], rj * sizeof(struct svm_node *));
+				if (!php_svm_nystrom_map_init(&map, lm_nodes, ri + rj, param)) {
+					ok = FALSE;
+					break;
+				}
+
+				memcpy(pair_rows, rows + start[i], count[i] * sizeof(int));
+				memcpy(pair_rows + count[i], rows + start[j], count[j] * sizeof(int));
+				php_svm_nystrom_fit(&map, prob, param, pair_rows, count[i] + count[j], count[i],
+					php_svm_nystrom_weighted_C(param, label[i]), php_svm_nystrom_weighted_C(param, label[j]), &state, w);
+
+				/* Same layout as svm_train: class i SVs hold the pair's coefficients in row j - 1, class j SVs in row i */
+				for (k = 0; k < ri; k++) {
+					r->sv_coef[j - 1][lm_start[i] + k] = w[k];
+				}
+				for (k = 0; k < rj; k++) {
+					r->sv_coef[i][lm_start[j] + k] = w[ri + k];
+				}
+				r->rho[p] = -w[ri + rj];
+				efree(map.L);
+			}
+		}
+		efree(pair_rows);
+	}
+	efree(w);
+	efree(lm_nodes);
+
+done:
+	if (label) {
+		efree(label);
+		efree(count);
+		efree(start);
+		efree(lm_count);
+		efree(lm_start);
+	}
+	efree(landmarks);
+	efree(rows);
+
+	if (!ok) {
+#if LIBSVM_VERSION >= 300
+		svm_free_and_destroy_model(&r);
+#else
+		svm_destroy_model(r);
+#endif
+		return NULL;
+	}
+	return r;
+}
+/* }}} */
+
+/* ---- END TRAIN FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
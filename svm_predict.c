@@ -0,0 +1,1249 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+#include <math.h>
+
+/* ---- START KERNEL FUNCS ---- */
+
+/* {{{ static double php_svm_dot(const struct svm_node *px, const struct svm_node *py)
+Sparse dot product of two index ordered node lists.
+*/
+static zend_always_inline double php_svm_dot(const struct svm_node *px, const struct svm_node *py)
+{
+	double sum = 0;
+
+	while (px->index != -1 && py->index != -1) {
+		if (px->index == py->index) {
+			sum += px->value * py->value;
+			++px;
+			++py;
+		} else if (px->index > py->index) {
+			++py;
+		} else {
+			++px;
+		}
+	}
+	return sum;
+}
+/* }}} */
+
+/* {{{ double php_svm_kernel(const struct svm_node *x, const struct svm_node *y, const struct svm_parameter *param)
+Single kernel evaluation between an input row and a support vector. This mirrors libsvm's Kernel::k_function,
+which is not part of the public API, so that results are bit for bit identical to svm_predict.
+*/
+double php_svm_kernel(const struct svm_node *x, const struct svm_node *y, const struct svm_parameter *param)
+{
+	switch (param->kernel_type) {
+		case LINEAR:
+			return php_svm_dot(x, y);
+		case POLY:
+			return php_svm_powi(param->gamma * php_svm_dot(x, y) + param->coef0, param->degree);
+		case RBF:
+		{
+			double sum = 0;
+
+			while (x->index != -1 && y->index != -1) {
+				if (x->index == y->index) {
+					double d = x->value - y->value;
+					sum += d * d;
+					++x;
+					++y;
+				} else if (x->index > y->index) {
+					sum += y->value * y->value;
+					++y;
+				} else {
+					sum += x->value * x->value;
+					++x;
+				}
+			}
+
+			while (x->index != -1) {
+				sum += x->value * x->value;
+				++x;
+			}
+
+			while (y->index != -1) {
+				sum += y->value * y->value;
+				++y;
+			}
+
+			return exp(-param->gamma * sum);
+		}
+		case SIGMOID:
+			return tanh(param->gamma * php_svm_dot(x, y) + param->coef0);
+		case PRECOMPUTED: /* x: test row, y: SV */
+			return x[(int)(y->value)].value;
+		default:
+			return 0;
+	}
+}
+/* }}} */
+
+/* ---- END KERNEL FUNCS ---- */
+
+/* ---- START DECISION FUNCS ---- */
+
+#define PHP_SVM_IS_SINGLE_FUNCTION(model) \
+	((model)->param.svm_type == ONE_CLASS || \
+	 (model)->param.svm_type == EPSILON_SVR || \
+	 (model)->param.svm_type == NU_SVR)
+
+/* {{{ static double php_svm_vote(const struct svm_model *model, const double *dec_values, int *vote)
+Turn the decision values of one row into the predicted label, the same way svm_predict_values does.
+*/
+static double php_svm_vote(const struct svm_model *model, const double *dec_values, int *vote)
+{
+	int i, j, p;
+	int nr_class = model->nr_class;
+	int vote_max_idx = 0;
+
+	if (PHP_SVM_IS_SINGLE_FUNCTION(model)) {
+		if (model->param.svm_type == ONE_CLASS) {
+			return (dec_values[0] > 0) ? 1 : -1;
+		}
+		return dec_values[0];
+	}
+
+	for (i = 0; i < nr_class; i++) {
+		vote[i] = 0;
+	}
+
+	p = 0;
+	for (i = 0; i < nr_class; i++) {
+		for (j = i + 1; j < nr_class; j++) {
+			if (dec_values[p] > 0) {
+				++vote[i];
+			} else {
+				++vote[j];
+			}
+			p++;
+		}
+	}
+
+	for (i = 1; i < nr_class; i++) {
+		if (vote[i] > vote[vote_max_idx]) {
+			vote_max_idx = i;
+		}
+	}
+	return model->label[vote_max_idx];
+}
+/* }}} */
+
+/* {{{ static double php_svm_decide(const struct svm_model *model, const float *coef32, const double *kvalue, const int *start, int *vote, double *dec_values)
+Turn the kernel values of one row against every SV into decision values and a label. Accumulation order
+is the same as svm_predict_values. coef32 holds the coefficients of a model with float storage that has no
+model->sv_coef, laid out the same way, and is NULL otherwise.
+*/
+static double php_svm_decide(const struct svm_model *model, const float *coef32, const double *kvalue, const int *start, int *vote, double *dec_values)
+{
+	int i, j, k, p;
+
+	if (PHP_SVM_IS_SINGLE_FUNCTION(model)) {
+		double sum = 0;
+
+		if (coef32) {
+			for (i = 0; i < model->l; i++) {
+				sum += coef32[i] * kvalue[i];
+			}
+		} else {
+			const double *sv_coef = model->sv_coef[0];
+
+			for (i = 0; i < model->l; i++) {
+				sum += sv_coef[i] * kvalue[i];
+			}
+		}
+		dec_values[0] = sum - model->rho[0];
+	} else {
+		int nr_class = model->nr_class;
+
+		p = 0;
+		for (i = 0; i < nr_class; i++) {
+			for (j = i + 1; j < nr_class; j++) {
+				double sum = 0;
+				int si = start[i];
+				int sj = start[j];
+				int ci = model->nSV[i];
+				int cj = model->nSV[j];
+
+				if (coef32) {
+					const float *coef1 = coef32 + (size_t)(j - 1) * model->l;
+					const float *coef2 = coef32 + (size_t)i * model->l;
+
+					for (k = 0; k < ci; k++) {
+						sum += coef1[si + k] * kvalue[si + k];
+					}
+					for (k = 0; k < cj; k++) {
+						sum += coef2[sj + k] * kvalue[sj + k];
+					}
+				} else {
+					const double *coef1 = model->sv_coef[j - 1];
+					const double *coef2 = model->sv_coef[i];
+
+					for (k = 0; k < ci; k++) {
+						sum += coef1[si + k] * kvalue[si + k];
+					}
+					for (k = 0; k < cj; k++) {
+						sum += coef2[sj + k] * kvalue[sj + k];
+					}
+				}
+				dec_values[p] = sum - model->rho[p];
+				p++;
+			}
+		}
+	}
+
+	return php_svm_vote(model, dec_values, vote);
+}
+/* }}} */
+
+/* {{{ static double php_svm_decide_linear(const struct svm_model *model, const php_svm_predictor *pred, const struct svm_node *x, int *vote, double *dec_values)
+Decision values for a linear model from the collapsed weight vectors: one pass over the nonzeros of x,
+independent of the number of SVs.
+*/
+static double php_svm_decide_linear(const struct svm_model *model, const php_svm_predictor *pred, const struct svm_node *x, int *vote, double *dec_values)
+{
+	int p;
+	int nr_dec = pred->nr_dec;
+
+	for (p = 0; p < nr_dec; p++) {
+		dec_values[p] = 0;
+	}
+
+	for (; x->index != -1; ++x) {
+		const double *w;
+
+		if (x->index < 0 || x->index >= pred->linear_dim) {
+			/* No SV has this feature */
+			continue;
+		}
+		w = pred->linear_w + (size_t)x->index * nr_dec;
+		for (p = 0; p < nr_dec; p++) {
+			dec_values[p] += w[p] * x->value;
+		}
+	}
+
+	for (p = 0; p < nr_dec; p++) {
+		dec_values[p] -= model->rho[p];
+	}
+
+	return php_svm_vote(model, dec_values, vote);
+}
+/* }}} */
+
+/* {{{ static void php_svm_dense_row(const php_svm_predictor *pred, const struct svm_node *x, double *xd, double *outside_sq)
+Scatter a sparse row into a dense vector matching the layout of the dense SV matrix. Features outside the matrix
+can't contribute to a dot product, but do add to the RBF distance, so their squared norm is returned separately.
+*/
+static void php_svm_dense_row(const php_svm_predictor *pred, const struct svm_node *x, double *xd, double *outside_sq)
+{
+	memset(xd, 0, pred->dense_stride * sizeof(double));
+	*outside_sq = 0;
+
+	for (; x->index != -1; ++x) {
+		if (x->index >= 0 && x->index < pred->dense_dim) {
+			xd[x->index] = x->value;
+		} else {
+			*outside_sq += x->value * x->value;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_dense_kernels(const struct svm_model *model, const php_svm_predictor *pred, const double *xd, double outside_sq, int s0, int s1, double *kvalue)
+Kernel values of a dense row against SVs s0 to s1-1 of the dense matrix, using the SIMD kernels picked at startup.
+*/
+static void php_svm_dense_kernels(const struct svm_model *model, const php_svm_predictor *pred, const double *xd, double outside_sq, int s0, int s1, double *kvalue)
+{
+	const struct svm_parameter *param = &model->param;
+	php_svm_dense_func dot = php_svm_simd_impl.dot;
+	int stride = pred->dense_stride;
+	const double *sv = pred->dense_sv + (size_t)s0 * stride;
+	int i;
+
+	switch (param->kernel_type) {
+		case LINEAR:
+			for (i = s0; i < s1; i++, sv += stride) {
+				kvalue[i] = dot(xd, sv, stride);
+			}
+			break;
+		case POLY:
+			for (i = s0; i < s1; i++, sv += stride) {
+				kvalue[i] = php_svm_powi(param->gamma * dot(xd, sv, stride) + param->coef0, param->degree);
+			}
+			break;
+		case RBF:
+		{
+			php_svm_dense_func dist = php_svm_simd_impl.dist;
+
+			for (i = s0; i < s1; i++, sv += stride) {
+				kvalue[i] = exp(-param->gamma * (dist(xd, sv, stride) + outside_sq));
+			}
+			break;
+		}
+		case SIGMOID:
+			for (i = s0; i < s1; i++, sv += stride) {
+				kvalue[i] = tanh(param->gamma * dot(xd, sv, stride) + param->coef0);
+			}
+			break;
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_sparse_kernels(const struct svm_model *model, const php_svm_predictor *pred, const struct svm_node *x, double x_sq, int s0, int s1, double *kvalue)
+Kernel values of a sparse row against SVs s0 to s1-1. With the cached SV norms, RBF only needs a dot product per
+SV, exp(-gamma * (|x|^2 + |sv|^2 - 2 * x.sv)), the same expansion libsvm uses for its training kernel.
+*/
+static void php_svm_sparse_kernels(const struct svm_model *model, const php_svm_predictor *pred, const struct svm_node *x, double x_sq, int s0, int s1, double *kvalue)
+{
+	int i;
+
+	if (pred->sv_sq) {
+		double gamma = model->param.gamma;
+
+		for (i = s0; i < s1; i++) {
+			kvalue[i] = exp(-gamma * (x_sq + pred->sv_sq[i] - 2 * php_svm_dot(x, model->SV[i])));
+		}
+		return;
+	}
+
+	for (i = s0; i < s1; i++) {
+		kvalue[i] = php_svm_kernel(x, model->SV[i], &model->param);
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_postings_kernels(const struct svm_model *model, const php_svm_predictor *pred, const struct svm_node *x, double x_sq, double *kvalue)
+Kernel values of a sparse row against every SV through the postings index. Only the postings of the features
+of x are walked, accumulating x.sv for each SV that shares one; SVs sharing none keep a dot product of zero and
+their kernel follows in closed form, which for RBF is exp(-gamma * (|x|^2 + |sv|^2)).
+*/
+static void php_svm_postings_kernels(const struct svm_model *model, const php_svm_predictor *pred, const struct svm_node *x, double x_sq, double *kvalue)
+{
+	const struct svm_parameter *param = &model->param;
+	int i, l = model->l;
+
+	memset(kvalue, 0, l * sizeof(double));
+
+	for (; x->index != -1; ++x) {
+		int p, end;
+
+		if (x->index < 0 || x->index >= pred->post_dim) {
+			continue;
+		}
+		end = pred->post_start[x->index + 1];
+		for (p = pred->post_start[x->index]; p < end; p++) {
+			kvalue[pred->post_sv[p]] += pred->post_value[p] * x->value;
+		}
+	}
+
+	switch (param->kernel_type) {
+		case POLY:
+			for (i = 0; i < l; i++) {
+				kvalue[i] = php_svm_powi(param->gamma * kvalue[i] + param->coef0, param->degree);
+			}
+			break;
+		case RBF:
+			for (i = 0; i < l; i++) {
+				kvalue[i] = exp(-param->gamma * (x_sq + pred->sv_sq[i] - 2 * kvalue[i]));
+			}
+			break;
+		case SIGMOID:
+			for (i = 0; i < l; i++) {
+				kvalue[i] = tanh(param->gamma * kvalue[i] + param->coef0);
+			}
+			break;
+		default: /* LINEAR, the dot product is the kernel */
+			break;
+	}
+}
+/* }}} */
+
+/* {{{ void php_svm_predict_batch(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, struct svm_node **x, int rows, double *labels, double *values)
+Predict a label for each of the rows, and when values isn't NULL keep the decision values of row r in
+values[r * nr_dec ...]. Kernels are evaluated in tiles of PHP_SVM_BATCH_ROWS input rows against
+PHP_SVM_BATCH_SV support vectors, so that every SV in a tile is reused by all the rows of the tile while it is
+still in cache, rather than streaming the whole SV set through once per row.
+*/
+void php_svm_predict_batch(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, struct svm_node **x, int rows, double *labels, double *values)
+{
+	int l = model->l;
+	int r0, r1, s0, s1, r;
+	const float *coef32 = pred->compact ? pred->compact->coef : NULL;
+	double *kvalue;
+	double *xd = NULL, outside_sq[PHP_SVM_BATCH_ROWS], x_sq[PHP_SVM_BATCH_ROWS];
+
+	if (rows <= 0) {
+		return;
+	}
+
+	/* Nothing to gain from tiling these: they never walk the SVs row by row */
+	if (pred->linear_w || pred->rff || pred->post_start) {
+		for (r = 0; r < rows; r++) {
+			labels[r] = php_svm_predict_values(model, pred, scratch, x[r]);
+			if (values) {
+				memcpy(values + (size_t)r * pred->nr_dec, scratch->dec_values, pred->nr_dec * sizeof(double));
+			}
+		}
+		return;
+	}
+
+	/* A tile needs more room than the single row scratch buffers have */
+	kvalue = safe_emalloc(PHP_SVM_BATCH_ROWS, (l > 0 ? l : 1) * sizeof(double), 0);
+
+	if (pred->dense_sv || (pred->compact && pred->compact->stride)) {
+		xd = safe_emalloc(PHP_SVM_BATCH_ROWS, pred->dense_stride * sizeof(double), 0);
+	}
+
+	for (r0 = 0; r0 < rows; r0 = r1) {
+		r1 = MIN(r0 + PHP_SVM_BATCH_ROWS, rows);
+
+		if (xd) {
+			for (r = r0; r < r1; r++) {
+				php_svm_dense_row(pred, x[r], xd + (size_t)(r - r0) * pred->dense_stride, &outside_sq[r - r0]);
+			}
+		} else if (pred->sv_sq || (pred->compact && pred->compact->sv_sq)) {
+			for (r = r0; r < r1; r++) {
+				x_sq[r - r0] = php_svm_dot(x[r], x[r]);
+			}
+		}
+
+		for (s0 = 0; s0 < l; s0 = s1) {
+			s1 = MIN(s0 + PHP_SVM_BATCH_SV, l);
+
+			for (r = r0; r < r1; r++) {
+				double *kv = kvalue + (size_t)(r - r0) * l;
+
+				if (pred->compact) {
+					php_svm_compact_kernels(model, pred->compact, x[r], xd ? xd + (size_t)(r - r0) * pred->dense_stride : NULL,
+						xd ? outside_sq[r - r0] : (pred->compact->sv_sq ? x_sq[r - r0] : 0), s0, s1, kv);
+				} else if (xd) {
+					php_svm_dense_kernels(model, pred, xd + (size_t)(r - r0) * pred->dense_stride, outside_sq[r - r0], s0, s1, kv);
+				} else {
+					php_svm_sparse_kernels(model, pred, x[r], x_sq[r - r0], s0, s1, kv);
+				}
+			}
+		}
+
+		for (r = r0; r < r1; r++) {
+			labels[r] = php_svm_decide(model, coef32, kvalue + (size_t)(r - r0) * l, pred->sv_start, scratch->vote, scratch->dec_values);
+			if (values) {
+				memcpy(values + (size_t)r * pred->nr_dec, scratch->dec_values, pred->nr_dec * sizeof(double));
+			}
+		}
+	}
+
+	if (xd) {
+		efree(xd);
+	}
+	efree(kvalue);
+}
+/* }}} */
+
+/* {{{ double php_svm_predict_values(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, const struct svm_node *x)
+Single row equivalent of svm_predict_values, using the random feature map, the float or int8 storage, the collapsed
+weights, the dense SV matrix or the cached SV norms when the model has them. Works entirely in the scratch buffers and leaves the decision values in
+scratch->dec_values.
+*/
+double php_svm_predict_values(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, const struct svm_node *x)
+{
+	double outside_sq;
+
+	if (pred->rff) {
+		php_svm_rff_decision_values(pred->rff, model, x, scratch->rff_z, scratch->rff_col, scratch->dec_values);
+		return php_svm_vote(model, scratch->dec_values, scratch->vote);
+	}
+
+	if (pred->linear_w) {
+		return php_svm_decide_linear(model, pred, x, scratch->vote, scratch->dec_values);
+	}
+
+	if (pred->compact) {
+		if (pred->compact->stride) {
+			php_svm_dense_row(pred, x, scratch->xd, &outside_sq);
+		} else {
+			outside_sq = pred->compact->sv_sq ? php_svm_dot(x, x) : 0;
+		}
+		php_svm_compact_kernels(model, pred->compact, x, scratch->xd, outside_sq, 0, model->l, scratch->kvalue);
+		return php_svm_decide(model, pred->compact->coef, scratch->kvalue, pred->sv_start, scratch->vote, scratch->dec_values);
+	}
+
+	if (pred->dense_sv) {
+		php_svm_dense_row(pred, x, scratch->xd, &outside_sq);
+		php_svm_dense_kernels(model, pred, scratch->xd, outside_sq, 0, model->l, scratch->kvalue);
+	} else if (pred->post_start) {
+		php_svm_postings_kernels(model, pred, x, pred->sv_sq ? php_svm_dot(x, x) : 0, scratch->kvalue);
+	} else {
+		php_svm_sparse_kernels(model, pred, x, pred->sv_sq ? php_svm_dot(x, x) : 0, 0, model->l, scratch->kvalue);
+	}
+
+	return php_svm_decide(model, NULL, scratch->kvalue, pred->sv_start, scratch->vote, scratch->dec_values);
+}
+/* }}} */
+
+/* {{{ double *php_svm_decision_values(const struct svm_model *model, struct svm_node **x, int rows)
+Decision values of model for each row without rho, that is sum(coef * K(sv, x)), laid out as y[r * nr_dec + p].
+The caller frees the result.
+*/
+double *php_svm_decision_values(const struct svm_model *model, struct svm_node **x, int rows)
+{
+	php_svm_predictor pred;
+	php_svm_scratch scratch;
+	int r, p;
+	double *y;
+
+	php_svm_predictor_init(&pred, model);
+	php_svm_scratch_init(&scratch, model, &pred);
+	y = safe_emalloc(rows > 0 ? rows : 1, pred.nr_dec * sizeof(double), 0);
+
+	for (r = 0; r < rows; r++) {
+		php_svm_predict_values(model, &pred, &scratch, x[r]);
+		for (p = 0; p < pred.nr_dec; p++) {
+			y[(size_t)r * pred.nr_dec + p] = scratch.dec_values[p] + model->rho[p];
+		}
+	}
+
+	php_svm_scratch_free(&scratch);
+	php_svm_predictor_free(&pred);
+	return y;
+}
+/* }}} */
+
+/* {{{ size_t php_svm_model_memory(const struct svm_model *model, const php_svm_predictor *pred)
+Bytes a model needs to predict: its SVs and coefficients, in whichever storage they are, and everything derived
+from them. Fixed size parts such as rho and the labels are left out.
+*/
+size_t php_svm_model_memory(const struct svm_model *model, const php_svm_predictor *pred)
+{
+	size_t bytes = 0;
+	int i;
+
+	if (model->SV) {
+		const struct svm_node *n;
+
+		bytes += (size_t)model->l * sizeof(struct svm_node *);
+		for (i = 0; i < model->l; i++) {
+			for (n = model->SV[i]; n->index != -1; n++) {
+				bytes += sizeof(struct svm_node);
+			}
+			bytes += sizeof(struct svm_node);
+		}
+	}
+	if (model->sv_coef) {
+		bytes += (size_t)(model->nr_class - 1) * (sizeof(double *) + (size_t)model->l * sizeof(double));
+	}
+
+	if (pred->linear_w) {
+		bytes += (size_t)pred->linear_dim * pred->nr_dec * sizeof(double);
+	}
+	if (pred->dense_sv) {
+		bytes += (size_t)model->l * pred->dense_stride * sizeof(double);
+	}
+	if (pred->sv_sq) {
+		bytes += (size_t)model->l * sizeof(double);
+	}
+	if (pred->post_start) {
+		bytes += ((size_t)pred->post_dim + 1) * sizeof(int);
+		bytes += (size_t)pred->post_start[pred->post_dim] * (sizeof(int) + sizeof(double));
+	}
+	if (pred->compact) {
+		bytes += php_svm_compact_memory(pred->compact, model);
+	}
+	return bytes;
+}
+/* }}} */
+
+/* {{{ void php_svm_drift(const struct svm_model *a, const php_svm_predictor *pa, const struct svm_model *b, const php_svm_predictor *pb, struct svm_node **x, int rows, php_svm_drift_report *report)
+Compare the decision values and labels of two models with the same decision functions over the rows, to
+report how closely an approximated model b follows the original a.
+*/
+void php_svm_drift(const struct svm_model *a, const php_svm_predictor *pa, const struct svm_model *b, const php_svm_predictor *pb, struct svm_node **x, int rows, php_svm_drift_report *report)
+{
+	php_svm_scratch sa, sb;
+	int i, p, same = 0;
+	double sum = 0;
+
+	php_svm_scratch_init(&sa, a, pa);
+	php_svm_scratch_init(&sb, b, pb);
+
+	report->max_drift = 0;
+	for (i = 0; i < rows; i++) {
+		double la = php_svm_predict_values(a, pa, &sa, x[i]);
+		double lb = php_svm_predict_values(b, pb, &sb, x[i]);
+
+		for (p = 0; p < pa->nr_dec; p++) {
+			double drift = fabs(sb.dec_values[p] - sa.dec_values[p]);
+
+			sum += drift;
+			if (drift > report->max_drift) {
+				report->max_drift = drift;
+			}
+		}
+		if (la == lb) {
+			same++;
+		}
+	}
+	report->mean_drift = rows ? sum / ((double)rows * pa->nr_dec) : 0;
+	report->label_agreement = rows ? (double)same / rows : 1;
+
+	php_svm_scratch_free(&sb);
+	php_svm_scratch_free(&sa);
+}
+/* }}} */
+
+/* ---- END DECISION FUNCS ---- */
+
+/* ---- START PROBABILITY FUNCS ---- */
+
+/* {{{ static double php_svm_sigmoid_predict(double decision_value, double A, double B)
+Platt scaling of one decision value, as in libsvm.
+*/
+static double php_svm_sigmoid_predict(double decision_value, double A, double B)
+{
+	double fApB = decision_value * A + B;
+
+	/* 1-p used later; avoid catastrophic cancellation */
+	if (fApB >= 0) {
+		return exp(-fApB) / (1.0 + exp(-fApB));
+	}
+	return 1.0 / (1 + exp(fApB));
+}
+/* }}} */
+
+/* {{{ static void php_svm_multiclass_probability(int k, double **r, double *p, double **Q, double *Qp)
+Method 2 from the multiclass_prob paper by Wu, Lin, and Weng, ported from libsvm where it is not exported.
+Q and Qp are working memory of k x k and k doubles.
+*/
+static void php_svm_multiclass_probability(int k, double **r, double *p, double **Q, double *Qp)
+{
+	int t, j;
+	int iter = 0, max_iter = MAX(100, k);
+	double pQp, eps = 0.005 / k;
+
+	for (t = 0; t < k; t++) {
+		p[t] = 1.0 / k;  /* Valid if k = 1 */
+		Q[t][t] = 0;
+		for (j = 0; j < t; j++) {
+			Q[t][t] += r[j][t] * r[j][t];
+			Q[t][j] = Q[j][t];
+		}
+		for (j = t + 1; j < k; j++) {
+			Q[t][t] += r[j][t] * r[j][t];
+			Q[t][j] = -r[j][t] * r[t][j];
+		}
+	}
+	for (iter = 0; iter < max_iter; iter++) {
+		double max_error = 0;
+
+		/* stopping condition, recalculate QP,pQP for numerical accuracy */
+		pQp = 0;
+		for (t = 0; t < k; t++) {
+			Qp[t] = 0;
+			for (j = 0; j < k; j++) {
+				Qp[t] += Q[t][j] * p[j];
+			}
+			pQp += p[t] * Qp[t];
+		}
+		for (t = 0; t < k; t++) {
+			double error = fabs(Qp[t] - pQp);
+			if (error > max_error) {
+				max_error = error;
+			}
+		}
+		if (max_error < eps) {
+			break;
+		}
+
+		for (t = 0; t < k; t++) {
+			double diff = (-Qp[t] + pQp) / Q[t][t];
+			p[t] += diff;
+			pQp = (pQp + diff * (diff * Q[t][t] + 2 * Qp[t])) / (1 + diff) / (1 + diff);
+			for (j = 0; j < k; j++) {
+				Qp[j] = (Qp[j] + diff * Q[t][j]) / (1 + diff);
+				p[j] /= (1 + diff);
+			}
+		}
+	}
+}
+/* }}} */
+
+/* {{{ double php_svm_predict_probability(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, const struct svm_node *x)
+Equivalent of svm_predict_probability, built on php_svm_predict_values so that it benefits from the same
+shortcuts as predict(). The estimates are left in scratch->prob_estimates; they stay zero for models without
+probability information.
+*/
+double php_svm_predict_probability(const struct svm_model *model, const php_svm_predictor *pred, php_svm_scratch *scratch, const struct svm_node *x)
+{
+	int i, j, k;
+	int nr_class = model->nr_class;
+	double min_prob = 1e-7;
+	double *dec_values = scratch->dec_values;
+	double **pairwise_prob = scratch->pairwise_prob;
+	double *prob_estimates = scratch->prob_estimates;
+	int prob_max_idx = 0;
+
+	if (!((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
+		model->probA != NULL && model->probB != NULL)) {
+		return php_svm_predict_values(model, pred, scratch, x);
+	}
+
+	php_svm_predict_values(model, pred, scratch, x);
+
+	k = 0;
+	for (i = 0; i < nr_class; i++) {
+		for (j = i + 1; j < nr_class; j++) {
+			pairwise_prob[i][j] = MIN(MAX(php_svm_sigmoid_predict(dec_values[k], model->probA[k], model->probB[k]), min_prob), 1 - min_prob);
+			pairwise_prob[j][i] = 1 - pairwise_prob[i][j];
+			k++;
+		}
+	}
+	if (nr_class == 2) {
+		prob_estimates[0] = pairwise_prob[0][1];
+		prob_estimates[1] = pairwise_prob[1][0];
+	} else {
+		php_svm_multiclass_probability(nr_class, pairwise_prob, prob_estimates, scratch->Q, scratch->Qp);
+	}
+
+	for (i = 1; i < nr_class; i++) {
+		if (prob_estimates[i] > prob_estimates[prob_max_idx]) {
+			prob_max_idx = i;
+		}
+	}
+
+	return model->label[prob_max_idx];
+}
+/* }}} */
+
+/* ---- END PROBABILITY FUNCS ---- */
+
+/* ---- START PREDICTOR FUNCS ---- */
+
+/* {{{ static void php_svm_predictor_init_linear(php_svm_predictor *pred, const struct svm_model *model)
+Collapse a linear model into one dense weight vector per decision function, w = sum(coef * SV). The weights are
+laid out feature-major so that a single pass over the nonzeros of an input updates every decision function.
+They are only built when they take no more memory than the SVs themselves, so very wide multiclass models keep
+the SV path.
+*/
+static void php_svm_predictor_init_linear(php_svm_predictor *pred, const struct svm_model *model)
+{
+	int i, j, k, p;
+	int dim = 0;
+	size_t nnz = 0;
+	int nr_dec = pred->nr_dec;
+	const struct svm_node *n;
+	double *w;
+
+	for (i = 0; i < model->l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			if (n->index < 0) {
+				/* Can't index a dense vector with this */
+				return;
+			}
+			if (n->index >= dim) {
+				dim = n->index + 1;
+			}
+			nnz++;
+		}
+	}
+
+	if (dim == 0 || (size_t)dim * nr_dec > MAX(nnz * 2, PHP_SVM_LINEAR_MIN_WEIGHTS)) {
+		return;
+	}
+
+	w = ecalloc((size_t)dim * nr_dec, sizeof(double));
+
+	if (PHP_SVM_IS_SINGLE_FUNCTION(model)) {
+		for (i = 0; i < model->l; i++) {
+			double coef = model->sv_coef[0][i];
+			for (n = model->SV[i]; n->index != -1; n++) {
+				w[n->index] += coef * n->value;
+			}
+		}
+	} else {
+		int nr_class = model->nr_class;
+		int start_i = 0;
+
+		p = 0;
+		for (i = 0; i < nr_class; i++) {
+			int start_j = start_i + model->nSV[i];
+
+			for (j = i + 1; j < nr_class; j++) {
+				const double *coef1 = model->sv_coef[j - 1];
+				const double *coef2 = model->sv_coef[i];
+
+				for (k = start_i; k < start_i + model->nSV[i]; k++) {
+					for (n = model->SV[k]; n->index != -1; n++) {
+						w[(size_t)n->index * nr_dec + p] += coef1[k] * n->value;
+					}
+				}
+				for (k = start_j; k < start_j + model->nSV[j]; k++) {
+					for (n = model->SV[k]; n->index != -1; n++) {
+						w[(size_t)n->index * nr_dec + p] += coef2[k] * n->value;
+					}
+				}
+				start_j += model->nSV[j];
+				p++;
+			}
+			start_i += model->nSV[i];
+		}
+	}
+
+	pred->linear_w = w;
+	pred->linear_dim = dim;
+}
+/* }}} */
+
+/* {{{ static void php_svm_predictor_init_dense(php_svm_predictor *pred, const struct svm_model *model)
+Copy the SVs into a contiguous row-major matrix when they are mostly filled in over a modest number of features,
+which is the common case for scaled numeric data. Each row is padded with zeros to a multiple of
+PHP_SVM_DENSE_ALIGN doubles so the SIMD kernels never need a scalar tail.
+*/
+static void php_svm_predictor_init_dense(php_svm_predictor *pred, const struct svm_model *model)
+{
+	int i, dim = 0, stride;
+	size_t nnz = 0;
+	const struct svm_node *n;
+	double *sv;
+
+	if (model->l == 0) {
+		return;
+	}
+
+	for (i = 0; i < model->l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			if (n->index < 0 || n->index >= PHP_SVM_DENSE_MAX_DIM) {
+				return;
+			}
+			if (n->index >= dim) {
+				dim = n->index + 1;
+			}
+			nnz++;
+		}
+	}
+
+	if (dim == 0 || nnz < PHP_SVM_DENSE_MIN_FILL * model->l * dim) {
+		return;
+	}
+
+	stride = (dim + PHP_SVM_DENSE_ALIGN - 1) / PHP_SVM_DENSE_ALIGN * PHP_SVM_DENSE_ALIGN;
+	sv = ecalloc((size_t)model->l * stride, sizeof(double));
+
+	for (i = 0; i < model->l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			sv[(size_t)i * stride + n->index] = n->value;
+		}
+	}
+
+	pred->dense_sv = sv;
+	pred->dense_dim = dim;
+	pred->dense_stride = stride;
+}
+/* }}} */
+
+/* {{{ void php_svm_predictor_init(php_svm_predictor *pred, const struct svm_model *model)
+Precompute whatever makes prediction cheaper for this model. Called once a model has been trained or loaded.
+*/
+void php_svm_predictor_init(php_svm_predictor *pred, const struct svm_model *model)
+{
+	memset(pred, 0, sizeof(php_svm_predictor));
+
+	pred->nr_dec = PHP_SVM_IS_SINGLE_FUNCTION(model) ? 1 : (int)((int64_t)model->nr_class * (model->nr_class - 1) / 2);
+
+	if (model->nSV) {
+		int i;
+
+		pred->sv_start = safe_emalloc(model->nr_class, sizeof(int), 0);
+		pred->sv_start[0] = 0;
+		for (i = 1; i < model->nr_class; i++) {
+			pred->sv_start[i] = pred->sv_start[i - 1] + model->nSV[i - 1];
+		}
+	}
+
+	/* Models with float or int8 storage have no SVs here, see php_svm_predictor_init_compact */
+	if (!model->SV) {
+		return;
+	}
+
+	if (model->param.kernel_type == LINEAR) {
+		php_svm_predictor_init_linear(pred, model);
+	}
+
+	if (!pred->linear_w && model->param.kernel_type != PRECOMPUTED) {
+		php_svm_predictor_init_dense(pred, model);
+	}
+
+	/* Sparse RBF models: cache |sv|^2 so each kernel costs one dot product */
+	if (!pred->dense_sv && model->param.kernel_type == RBF && model->l > 0) {
+		int i;
+
+		pred->sv_sq = safe_emalloc(model->l, sizeof(double), 0);
+		for (i = 0; i < model->l; i++) {
+			pred->sv_sq[i] = php_svm_dot(model->SV[i], model->SV[i]);
+		}
+	}
+}
+/* }}} */
+
+/* {{{ void php_svm_predictor_init_index(php_svm_predictor *pred, const struct svm_model *model, int mode)
+Build the postings index for a model that predicts through sparse kernels, with PHP_SVM_INDEX_ON or in auto
+mode when the SVs are sparse enough for it to pay off. Each row then costs the postings of its own features
+plus one closed form kernel per SV, rather than a merge walk against every SV. The table of features is as
+long as the largest feature index, so models with hashed or otherwise scattered indexes keep the merge walk.
+*/
+void php_svm_predictor_init_index(php_svm_predictor *pred, const struct svm_model *model, int mode)
+{
+	int i, *next;
+	size_t nnz = 0, dim = 0;
+	const struct svm_node *n;
+
+	if (mode == PHP_SVM_INDEX_OFF || pred->linear_w || pred->dense_sv || pred->rff || !model->SV ||
+		model->param.kernel_type == PRECOMPUTED || model->l == 0) {
+		return;
+	}
+
+	for (i = 0; i < model->l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			if (n->index < 0) {
+				return;
+			}
+			if ((size_t)n->index >= dim) {
+				dim = (size_t)n->index + 1;
+			}
+			nnz++;
+		}
+	}
+
+	if (dim > INT_MAX || dim > MAX(nnz * PHP_SVM_INDEX_DIM_PER_NODE, PHP_SVM_INDEX_MIN_DIM)) {
+		return;
+	}
+	if (mode == PHP_SVM_INDEX_AUTO && nnz > PHP_SVM_INDEX_MAX_FILL * model->l * dim) {
+		return;
+	}
+
+	pred->post_dim = (int)dim;
+	pred->post_start = ecalloc((size_t)dim + 1, sizeof(int));
+	pred->post_sv = safe_emalloc(nnz > 0 ? nnz : 1, sizeof(int), 0);
+	pred->post_value = safe_emalloc(nnz > 0 ? nnz : 1, sizeof(double), 0);
+
+	for (i = 0; i < model->l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			pred->post_start[n->index + 1]++;
+		}
+	}
+	for (i = 0; i < (int)dim; i++) {
+		pred->post_start[i + 1] += pred->post_start[i];
+	}
+
+	next = safe_emalloc(dim > 0 ? dim : 1, sizeof(int), 0);
+	memcpy(next, pred->post_start, dim * sizeof(int));
+	for (i = 0; i < model->l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			int p = next[n->index]++;
+
+			pred->post_sv[p] = i;
+			pred->post_value[p] = n->value;
+		}
+	}
+	efree(next);
+}
+/* }}} */
+
+/* {{{ static void php_svm_predictor_init_linear_compact(php_svm_predictor *pred, const struct svm_model *model, const php_svm_compact *compact)
+php_svm_predictor_init_linear for a model with float or int8 storage. Each SV adds coef * SV to every decision function it
+takes part in: for the pair of classes a < b, SVs of class a carry their coefficient in row b - 1 and SVs of
+class b in row a.
+*/
+static void php_svm_predictor_init_linear_compact(php_svm_predictor *pred, const struct svm_model *model, const php_svm_compact *compact)
+{
+	int i, k, o, c = 0;
+	int l = compact->l, dim = compact->dim, nr_dec = pred->nr_dec, nr_class = model->nr_class;
+	size_t nnz = compact->stride ? (size_t)l * dim : (size_t)compact->row[l];
+	double *w;
+
+	if (!compact->stride) {
+		for (k = 0; k < (int)nnz; k++) {
+			if (compact->index[k] < 0) {
+				return;
+			}
+		}
+	}
+
+	if (dim == 0 || (size_t)dim * nr_dec > MAX(nnz * 2, PHP_SVM_LINEAR_MIN_WEIGHTS)) {
+		return;
+	}
+
+	w = ecalloc((size_t)dim * nr_dec, sizeof(double));
+
+	for (i = 0; i < l; i++) {
+		/* class of SV i */
+		while (!PHP_SVM_IS_SINGLE_FUNCTION(model) && i >= pred->sv_start[c] + model->nSV[c]) {
+			c++;
+		}
+
+		for (o = 0; o < (PHP_SVM_IS_SINGLE_FUNCTION(model) ? 1 : nr_class); o++) {
+			int row, p;
+			double coef;
+
+			if (PHP_SVM_IS_SINGLE_FUNCTION(model)) {
+				row = 0;
+				p = 0;
+			} else if (o == c) {
+				continue;
+			} else {
+				int a = MIN(c, o), b = MAX(c, o);
+
+				row = (c < o) ? o - 1 : o;
+				p = a * nr_class - a * (a + 1) / 2 + (b - a - 1);
+			}
+			coef = compact->coef ? compact->coef[(size_t)row * l + i] : model->sv_coef[row][i];
+
+			if (compact->stride) {
+				for (k = 0; k < dim; k++) {
+					w[(size_t)k * nr_dec + p] += coef * php_svm_compact_value(compact, i, k);
+				}
+			} else {
+				for (k = compact->row[i]; k < compact->row[i + 1]; k++) {
+					w[(size_t)compact->index[k] * nr_dec + p] += coef * php_svm_compact_value(compact, i, k);
+				}
+			}
+		}
+	}
+
+	pred->linear_w = w;
+	pred->linear_dim = dim;
+}
+/* }}} */
+
+/* {{{ void php_svm_predictor_init_compact(php_svm_predictor *pred, const struct svm_model *model, const php_svm_compact *compact)
+Predict through the float or int8 storage of a model, which is kept by the model object. Linear models are collapsed
+into weights as usual, and the dense layout scatters input rows the same way the dense SV matrix does.
+*/
+void php_svm_predictor_init_compact(php_svm_predictor *pred, const struct svm_model *model, const php_svm_compact *compact)
+{
+	pred->compact = compact;
+	if (!compact) {
+		return;
+	}
+
+	if (model->param.kernel_type == LINEAR) {
+		php_svm_predictor_init_linear_compact(pred, model, compact);
+	}
+
+	if (!pred->linear_w && compact->stride) {
+		pred->dense_dim = compact->dim;
+		pred->dense_stride = compact->stride;
+	}
+}
+/* }}} */
+
+/* {{{ static void *php_svm_persist_array(void *array, size_t count, size_t size)
+Copy a per request array into persistent memory and release the original.
+*/
+static void *php_svm_persist_array(void *array, size_t count, size_t size)
+{
+	void *copy;
+
+	if (!array) {
+		return NULL;
+	}
+	copy = safe_pemalloc(count > 0 ? count : 1, size, 0, 1);
+	memcpy(copy, array, count * size);
+	efree(array);
+	return copy;
+}
+/* }}} */
+
+/* {{{ void php_svm_predictor_persist(php_svm_predictor *pred, const struct svm_model *model)
+Move the arrays of a predictor built at startup or for the model store into persistent memory, so that it outlives
+the request.
+php_svm_predictor_free releases them as such.
+*/
+void php_svm_predictor_persist(php_svm_predictor *pred, const struct svm_model *model)
+{
+	size_t nnz = pred->post_start ? (size_t)pred->post_start[pred->post_dim] : 0;
+
+	pred->linear_w = php_svm_persist_array(pred->linear_w, (size_t)pred->linear_dim * pred->nr_dec, sizeof(double));
+	pred->dense_sv = php_svm_persist_array(pred->dense_sv, (size_t)model->l * pred->dense_stride, sizeof(double));
+	pred->sv_sq = php_svm_persist_array(pred->sv_sq, model->l, sizeof(double));
+	pred->sv_start = php_svm_persist_array(pred->sv_start, model->nr_class, sizeof(int));
+	pred->post_sv = php_svm_persist_array(pred->post_sv, nnz, sizeof(int));
+	pred->post_value = php_svm_persist_array(pred->post_value, nnz, sizeof(double));
+	pred->post_start = php_svm_persist_array(pred->post_start, (size_t)pred->post_dim + 1, sizeof(int));
+	pred->persistent = 1;
+}
+/* }}} */
+
+/* {{{ size_t php_svm_predictor_memory(const php_svm_predictor *pred, const struct svm_model *model)
+Bytes held by the arrays of a predictor, the ones php_svm_predictor_persist moves.
+*/
+size_t php_svm_predictor_memory(const php_svm_predictor *pred, const struct svm_model *model)
+{
+	size_t nnz = pred->post_start ? (size_t)pred->post_start[pred->post_dim] : 0;
+	size_t memory = 0;
+
+	if (pred->linear_w) {
+		memory += (size_t)pred->linear_dim * pred->nr_dec * sizeof(double);
+	}
+	if (pred->dense_sv) {
+		memory += (size_t)model->l * pred->dense_stride * sizeof(double);
+	}
+	if (pred->sv_sq) {
+		memory += (size_t)model->l * sizeof(double);
+	}
+	if (pred->sv_start) {
+		memory += (size_t)model->nr_class * sizeof(int);
+	}
+	if (pred->post_start) {
+		memory += nnz * (sizeof(int) + sizeof(double)) + ((size_t)pred->post_dim + 1) * sizeof(int);
+	}
+	return memory;
+}
+/* }}} */
+
+/* {{{ void php_svm_predictor_free(php_svm_predictor *pred)
+Release everything php_svm_predictor_init allocated.
+*/
+void php_svm_predictor_free(php_svm_predictor *pred)
+{
+	zend_bool persistent = pred->persistent;
+
+	if (pred->linear_w) {
+		pefree(pred->linear_w, persistent);
+	}
+	if (pred->dense_sv) {
+		pefree(pred->dense_sv, persistent);
+	}
+	if (pred->sv_sq) {
+		pefree(pred->sv_sq, persistent);
+	}
+	if (pred->sv_start) {
+		pefree(pred->sv_start, persistent);
+	}
+	if (pred->post_start) {
+		pefree(pred->post_start, persistent);
+		pefree(pred->post_sv, persistent);
+		pefree(pred->post_value, persistent);
+	}
+	memset(pred, 0, sizeof(php_svm_predictor));
+}
+/* }}} */
+
+/* {{{ void php_svm_scratch_init(php_svm_scratch *scratch, const struct svm_model *model, const php_svm_predictor *pred)
+Size the per object prediction buffers for a model. The input row buffer starts large enough for any row that only
+uses the features the dense matrix covers and is grown by php_svm_scratch_row after that.
+*/
+void php_svm_scratch_init(php_svm_scratch *scratch, const struct svm_model *model, const php_svm_predictor *pred)
+{
+	int i;
+	int nr_class = model->nr_class;
+
+	memset(scratch, 0, sizeof(php_svm_scratch));
+
+	scratch->x_size = MAX(pred->dense_dim + 1, 64);
+	scratch->x = safe_emalloc(scratch->x_size, sizeof(struct svm_node), 0);
+
+	scratch->kvalue = safe_emalloc(model->l > 0 ? model->l : 1, sizeof(double), 0);
+	scratch->dec_values = safe_emalloc(pred->nr_dec, sizeof(double), 0);
+	scratch->vote = safe_emalloc(nr_class, sizeof(int), 0);
+	if (pred->dense_sv || (pred->compact && pred->compact->stride)) {
+		scratch->xd = safe_emalloc(pred->dense_stride, sizeof(double), 0);
+	}
+	if (pred->rff) {
+		scratch->rff_z = safe_emalloc(pred->rff->dimension, sizeof(double), 0);
+		scratch->rff_col = safe_emalloc(pred->rff->dimension, sizeof(double), 0);
+	}
+
+	scratch->prob_estimates = ecalloc(nr_class, sizeof(double));
+	scratch->Qp = safe_emalloc(nr_class, sizeof(double), 0);
+	scratch->pairwise_prob = safe_emalloc(nr_class, sizeof(double *), 0);
+	scratch->Q = safe_emalloc(nr_class, sizeof(double *), 0);
+	scratch->pairwise_prob[0] = safe_emalloc(nr_class, nr_class * sizeof(double), 0);
+	scratch->Q[0] = safe_emalloc(nr_class, nr_class * sizeof(double), 0);
+	for (i = 1; i < nr_class; i++) {
+		scratch->pairwise_prob[i] = scratch->pairwise_prob[0] + (size_t)i * nr_class;
+		scratch->Q[i] = scratch->Q[0] + (size_t)i * nr_class;
+	}
+}
+/* }}} */
+
+/* {{{ void php_svm_scratch_free(php_svm_scratch *scratch)
+Release everything php_svm_scratch_init allocated.
+*/
+void php_svm_scratch_free(php_svm_scratch *scratch)
+{
+	if (scratch->x) {
+		efree(scratch->x);
+	}
+	if (scratch->kvalue) {
+		efree(scratch->kvalue);
+		efree(scratch->dec_values);
+		efree(scratch->vote);
+		efree(scratch->prob_estimates);
+		efree(scratch->Qp);
+		efree(scratch->pairwise_prob[0]);
+		efree(scratch->pairwise_prob);
+		efree(scratch->Q[0]);
+		efree(scratch->Q);
+	}
+	if (scratch->xd) {
+		efree(scratch->xd);
+	}
+	if (scratch->rff_z) {
+		efree(scratch->rff_z);
+		efree(scratch->rff_col);
+	}
+	memset(scratch, 0, sizeof(php_svm_scratch));
+}
+/* }}} */
+
+/* {{{ struct svm_node *php_svm_scratch_row(php_svm_scratch *scratch, int nodes)
+Return the input row buffer with room for at least nodes nodes. It grows geometrically, so a stream of rows of
+similar width stops reallocating almost immediately.
+*/
+struct svm_node *php_svm_scratch_row(php_svm_scratch *scratch, int nodes)
+{
+	if (nodes > scratch->x_size) {
+		scratch->x_size = MAX(nodes, scratch->x_size * 2);
+		scratch->x = safe_erealloc(scratch->x, scratch->x_size, sizeof(struct svm_node), 0);
+	}
+	return scratch->x;
+}
+/* }}} */
+
+/* ---- END PREDICTOR FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,569 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#	define M_PI 3.14159265358979323846
+#endif
+
+/*
+ * Random Fourier feature approximation of RBF models. exp(-gamma |x - y|^2) is the expectation of
+ * 2 cos(w.x + b) cos(w.y + b) over w ~ N(0, 2 gamma I) and b ~ U[0, 2 pi], so with D samples of (w, b) each
+ * decision function becomes a linear function of the D features z(x) = sqrt(2 / D) cos(w.x + b), and
+ * prediction costs O(D * nnz) whatever the number of SVs.
+ *
+ * The frequencies are not stored: every w[index][d] and b[d] is derived from the seed by hashing, so any
+ * feature index gets the same frequencies on every platform, and a saved model only needs its weights.
+ * Frequencies for the features the SVs use are cached in memory.
+ */
+
+static const char *php_svm_rff_magic = "php_svm_rff 1";
+
+/* ---- START FEATURE FUNCS ---- */
+
+/* {{{ static double php_svm_rff_uniform(zend_long seed, int64_t stream, int d)
+Uniform number in (0, 1) for position d of the given stream.
+*/
+static double php_svm_rff_uniform(zend_long seed, int64_t stream, int d)
+{
+	uint64_t h = php_svm_mix64((uint64_t)seed ^ php_svm_mix64(php_svm_mix64((uint64_t)stream) + (uint64_t)d));
+
+	return ((double)(h >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+/* }}} */
+
+/* {{{ static void php_svm_rff_column(const php_svm_rff *rff, int index, double *col)
+Frequencies of feature index for all D features, from a Box-Muller transform of two hashed streams.
+*/
+static void php_svm_rff_column(const php_svm_rff *rff, int index, double *col)
+{
+	int d;
+	double sigma = sqrt(2 * rff->gamma);
+
+	for (d = 0; d < rff->dimension; d++) {
+		double u1 = php_svm_rff_uniform(rff->seed, 2 * (int64_t)index + 1, d);
+		double u2 = php_svm_rff_uniform(rff->seed, 2 * (int64_t)index + 2, d);
+
+		col[d] = sigma * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_rff_features(const php_svm_rff *rff, const struct svm_node *x, double *z, double *col)
+The D random features of x. col is room for D doubles, used for features without cached frequencies.
+*/
+static void php_svm_rff_features(const php_svm_rff *rff, const struct svm_node *x, double *z, double *col)
+{
+	int d, D = rff->dimension;
+	double scale = sqrt(2.0 / D);
+
+	memcpy(z, rff->offset, D * sizeof(double));
+
+	for (; x->index != -1; ++x) {
+		const double *w;
+
+		if (x->value == 0) {
+			continue;
+		}
+		if (x->index >= 0 && x->index < rff->omega_dim) {
+			w = rff->omega + (size_t)x->index * D;
+		} else {
+			php_svm_rff_column(rff, x->index, col);
+			w = col;
+		}
+		for (d = 0; d < D; d++) {
+			z[d] += w[d] * x->value;
+		}
+	}
+
+	for (d = 0; d < D; d++) {
+		z[d] = scale * cos(z[d]);
+	}
+}
+/* }}} */
+
+/* {{{ void php_svm_rff_decision_values(const php_svm_rff *rff, const struct svm_model *model, const struct svm_node *x, double *z, double *col, double *dec_values)
+Decision values of x, with z and col room for D doubles each.
+*/
+void php_svm_rff_decision_values(const php_svm_rff *rff, const struct svm_model *model, const struct svm_node *x, double *z, double *col, double *dec_values)
+{
+	int p, d, D = rff->dimension;
+
+	php_svm_rff_features(rff, x, z, col);
+
+	for (p = 0; p < rff->nr_dec; p++) {
+		const double *w = rff->w + (size_t)p * D;
+		double sum = 0;
+
+		for (d = 0; d < D; d++) {
+			sum += w[d] * z[d];
+		}
+		dec_values[p] = sum - model->rho[p];
+	}
+}
+/* }}} */
+
+/* {{{ static php_svm_rff *php_svm_rff_new(double gamma, int dimension, zend_long seed, int nr_dec, int omega_dim)
+Allocate a feature map with zero weights, caching the frequencies of features below omega_dim.
+*/
+static php_svm_rff *php_svm_rff_new(double gamma, int dimension, zend_long seed, int nr_dec, int omega_dim)
+{
+	php_svm_rff *rff = ecalloc(1, sizeof(php_svm_rff));
+	int d, i;
+
+	rff->dimension = dimension;
+	rff->seed = seed;
+	rff->gamma = gamma;
+	rff->nr_dec = nr_dec;
+	rff->w = ecalloc((size_t)nr_dec * dimension, sizeof(double));
+
+	rff->offset = safe_emalloc(dimension, sizeof(double), 0);
+	for (d = 0; d < dimension; d++) {
+		rff->offset[d] = 2 * M_PI * php_svm_rff_uniform(seed, 0, d);
+	}
+
+	/* Very wide sparse models generate the frequencies of the remaining features on the fly */
+	rff->omega_dim = MIN(MAX(omega_dim, 0), PHP_SVM_RFF_MAX_CACHE / dimension);
+	if (rff->omega_dim > 0) {
+		rff->omega = safe_emalloc(rff->omega_dim, dimension * sizeof(double), 0);
+		for (i = 0; i < rff->omega_dim; i++) {
+			php_svm_rff_column(rff, i, rff->omega + (size_t)i * dimension);
+		}
+	}
+	return rff;
+}
+/* }}} */
+
+/* {{{ void php_svm_rff_free(php_svm_rff *rff)
+Release a feature map and its weights.
+*/
+void php_svm_rff_free(php_svm_rff *rff)
+{
+	efree(rff->w);
+	efree(rff->offset);
+	if (rff->omega) {
+		efree(rff->omega);
+	}
+	efree(rff);
+}
+/* }}} */
+
+/* ---- END FEATURE FUNCS ---- */
+
+/* ---- START MODEL FUNCS ---- */
+
+/* {{{ static struct svm_model *php_svm_rff_carrier(int svm_type, double gamma, int nr_class)
+An svm_model with no SVs holding everything but the decision functions: type, gamma, labels, rho and the
+probability parameters. It keeps the info methods and predict_probability working for random feature models.
+Allocated with malloc, as libsvm frees it.
+*/
+static struct svm_model *php_svm_rff_carrier(int svm_type, double gamma, int nr_class)
+{
+	struct svm_model *r = calloc(1, sizeof(struct svm_model));
+	int nr_dec = (svm_type == C_SVC || svm_type == NU_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+
+	r->param.svm_type = svm_type;
+	r->param.kernel_type = RBF;
+	r->param.gamma = gamma;
+	r->nr_class = nr_class;
+	r->l = 0;
+	r->free_sv = 1;
+	r->sv_coef = calloc(nr_class - 1, sizeof(double *));
+	r->rho = calloc(nr_dec, sizeof(double));
+	if (svm_type == C_SVC || svm_type == NU_SVC) {
+		r->label = calloc(nr_class, sizeof(int));
+		r->nSV = calloc(nr_class, sizeof(int));
+	}
+	return r;
+}
+/* }}} */
+
+/* {{{ struct svm_model *php_svm_rff_fit(const struct svm_model *model, int dimension, zend_long seed, php_svm_rff **rff_ptr)
+Fit a random feature map of the given dimension to an RBF model. The weights start from the Monte Carlo
+estimate sum(coef * z(sv)) and are then refit by ridge regression, shrinking towards that estimate, against the
+exact decision values at the SVs, along with an intercept folded into rho. Returns the carrier model.
+*/
+struct svm_model *php_svm_rff_fit(const struct svm_model *model, int dimension, zend_long seed, php_svm_rff **rff_ptr)
+{
+	int D = dimension, l = model->l, nr_class = model->nr_class;
+	int i, j, k, d, e, p, dim = 0;
+	int nr_dec = (model->nSV) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+	double *G, *zy, *zsum, *ysum, *w0, *z, *col, *y, *b;
+	double trace = 0, lambda;
+	const struct svm_node *n;
+	struct svm_model *r;
+	php_svm_rff *rff;
+	int *start;
+
+	for (i = 0; i < l; i++) {
+		for (n = model->SV[i]; n->index != -1; n++) {
+			if (n->index >= dim) {
+				dim = n->index + 1;
+			}
+		}
+	}
+	rff = php_svm_rff_new(model->param.gamma, D, seed, nr_dec, dim);
+
+	y = php_svm_decision_values(model, model->SV, l);
+	G = ecalloc((size_t)D * D, sizeof(double));
+	zy = ecalloc((size_t)nr_dec * D, sizeof(double));
+	w0 = ecalloc((size_t)nr_dec * D, sizeof(double));
+	zsum = ecalloc(D, sizeof(double));
+	ysum = ecalloc(nr_dec, sizeof(double));
+	z = safe_emalloc(D, sizeof(double), 0);
+	col = safe_emalloc(D, sizeof(double), 0);
+	b = safe_emalloc(D, sizeof(double), 0);
+	start = ecalloc(nr_class, sizeof(int));
+	if (model->nSV) {
+		for (i = 1; i < nr_class; i++) {
+			start[i] = start[i - 1] + model->nSV[i - 1];
+		}
+	}
+
+	/* Accumulate Z'Z, Z'y and the Monte Carlo weights one SV at a time, so Z is never held in memory */
+	for (k = 0, i = 0; k < l; k++) {
+		const double *yk = y + (size_t)k * nr_dec;
+
+		php_svm_rff_features(rff, model->SV[k], z, col);
+
+		for (d = 0; d < D; d++) {
+			double *g = G + (size_t)d * D;
+
+			for (e = 0; e <= d; e++) {
+				g[e] += z[d] * z[e];
+			}
+			zsum[d] += z[d];
+		}
+		for (p = 0; p < nr_dec; p++) {
+			double *row = zy + (size_t)p * D;
+
+			for (d = 0; d < D; d++) {
+				row[d] += z[d] * yk[p];
+			}
+			ysum[p] += yk[p];
+		}
+
+		if (!model->nSV) {
+			for (d = 0; d < D; d++) {
+				w0[d] += model->sv_coef[0][k] * z[d];
+			}
+			continue;
+		}
+
+		/* SV k belongs to class i and has one coefficient in each of the functions of class i */
+		while (i + 1 < nr_class && k >= start[i + 1]) {
+			i++;
+		}
+		for (j = 0; j < nr_class; j++) {
+			double coef;
+			double *row;
+
+			if (j == i) {
+				continue;
+			}
+			if (i < j) {
+				p = i * nr_class - i * (i + 1) / 2 + (j - i - 1);
+				coef = model->sv_coef[j - 1][k];
+			} else {
+				p = j * nr_class - j * (j + 1) / 2 + (i - j - 1);
+				coef = model->sv_coef[j][k];
+			}
+			row = w0 + (size_t)p * D;
+			for (d = 0; d < D; d++) {
+				row[d] += coef * z[d];
+			}
+		}
+	}
+
+	/* Centre for the intercept, then add the ridge */
+	for (d = 0; d < D; d++) {
+		for (e = 0; e <= d; e++) {
+			G[(size_t)d * D + e] -= zsum[d] * zsum[e] / l;
+			G[(size_t)e * D + d] = G[(size_t)d * D + e];
+		}
+		trace += G[(size_t)d * D + d];
+	}
+	lambda = PHP_SVM_RFF_RIDGE * trace / D;
+	for (d = 0; d < D; d++) {
+		G[(size_t)d * D + d] += lambda;
+	}
+
+	r = php_svm_rff_carrier(model->param.svm_type, model->param.gamma, nr_class);
+	memcpy(r->rho, model->rho, nr_dec * sizeof(double));
+	if (model->label && r->label) {
+		memcpy(r->label, model->label, nr_class * sizeof(int));
+	}
+	if (model->probA) {
+		r->probA = malloc(nr_dec * sizeof(double));
+		memcpy(r->probA, model->probA, nr_dec * sizeof(double));
+	}
+	if (model->probB) {
+		r->probB = malloc(nr_dec * sizeof(double));
+		memcpy(r->probB, model->probB, nr_dec * sizeof(double));
+	}
+
+	if (php_svm_cholesky(G, D)) {
+		for (p = 0; p < nr_dec; p++) {
+			const double *row = zy + (size_t)p * D;
+			double c = ysum[p] / l;
+
+			for (d = 0; d < D; d++) {
+				b[d] = row[d] - zsum[d] * ysum[p] / l + lambda * w0[(size_t)p * D + d];
+			}
+			php_svm_cholesky_solve(G, b, D);
+			for (d = 0; d < D; d++) {
+				c -= zsum[d] / l * b[d];
+			}
+			memcpy(rff->w + (size_t)p * D, b, D * sizeof(double));
+			r->rho[p] = model->rho[p] - c;
+		}
+	} else {
+		memcpy(rff->w, w0, (size_t)nr_dec * D * sizeof(double));
+	}
+
+	efree(start);
+	efree(b);
+	efree(col);
+	efree(z);
+	efree(ysum);
+	efree(zsum);
+	efree(w0);
+	efree(zy);
+	efree(G);
+	efree(y);
+
+	*rff_ptr = rff;
+	return r;
+}
+/* }}} */
+
+/* ---- END MODEL FUNCS ---- */
+
+/* ---- START FILE FUNCS ---- */
+
+/* {{{ zend_bool php_svm_rff_save(php_stream *stream, const struct svm_model *model, const php_svm_rff *rff)
+Write a random feature model. Only the weights are written, the frequencies are regenerated from the seed.
+*/
+zend_bool php_svm_rff_save(php_stream *stream, const struct svm_model *model, const php_svm_rff *rff)
+{
+	int i;
+	zend_bool ok;
+
+	ok = php_svm_write_line(stream, "%s\n", php_svm_rff_magic) &&
+		php_svm_write_line(stream, "svm_type %s\n", php_svm_svm_type_names[model->param.svm_type]) &&
+		php_svm_write_line(stream, "gamma %.17H\n", rff->gamma) &&
+		php_svm_write_line(stream, "nr_class %d\n", model->nr_class);
+	if (ok && model->label) {
+		ok = php_svm_write_line(stream, "label");
+		for (i = 0; ok && i < model->nr_class; i++) {
+			ok = php_svm_write_line(stream, " %d", model->label[i]);
+		}
+		ok = ok && php_svm_write_line(stream, "\n");
+	}
+	ok = ok && php_svm_write_values(stream, "rho", model->rho, rff->nr_dec);
+	if (ok && model->probA) {
+		ok = php_svm_write_values(stream, "probA", model->probA, rff->nr_dec);
+	}
+	if (ok && model->probB) {
+		ok = php_svm_write_values(stream, "probB", model->probB, rff->nr_dec);
+	}
+	ok = ok && php_svm_write_line(stream, "dimension %d\n", rff->dimension) &&
+		php_svm_write_line(stream, "seed " ZEND_LONG_FMT "\n", rff->seed) &&
+		php_svm_write_line(stream, "features %d\n", rff->omega_dim) &&
+		php_svm_write_line(stream, "w\n");
+	for (i = 0; ok && i < rff->nr_dec; i++) {
+		ok = php_svm_write_values(stream, NULL, rff->w + (size_t)i * rff->dimension, rff->dimension);
+	}
+
+	return ok;
+}
+/* }}} */
+
+/* {{{ int php_svm_rff_load(php_stream *stream, struct svm_model **model_ptr, php_svm_rff **rff_ptr)
+Read a model saved by php_svm_rff_save. Returns 1 on success, 0 if the stream doesn't hold a random feature model,
+so the caller can try other formats, and -1 if it holds one that can't be read.
+*/
+int php_svm_rff_load(php_stream *stream, struct svm_model **model_ptr, php_svm_rff **rff_ptr)
+{
+	char *line;
+	int svm_type = -1, nr_class = 0, dimension = 0, features = 0, nr_dec = 0, i, ok = 0;
+	zend_long seed = 0;
+	double gamma = 0, *rho = NULL, *probA = NULL, *probB = NULL;
+	int *label = NULL;
+	struct svm_model *model = NULL;
+	php_svm_rff *rff = NULL;
+
+	line = php_svm_get_line(stream);
+	if (!line || strcmp(line, php_svm_rff_magic) != 0) {
+		if (line) {
+			efree(line);
+		}
+		return 0;
+	}
+	efree(line);
+
+	while ((line = php_svm_get_line(stream)) != NULL) {
+		char *arg = strchr(line, ' ');
+
+		if (arg) {
+			*arg++ = '\0';
+		}
+
+		if (!strcmp(line, "w")) {
+			efree(line);
+			break;
+		} else if (!arg) {
+			efree(line);
+			goto done;
+		} else if (!strcmp(line, "svm_type")) {
+			/* nr_class sizes the arrays by the type, so the type has to come first and can't change after */
+			if (rho) {
+				efree(line);
+				goto done;
+			}
+			svm_type = php_svm_find_name(php_svm_svm_type_names, arg);
+		} else if (!strcmp(line, "gamma")) {
+			gamma = zend_strtod(arg, NULL);
+		} else if (!strcmp(line, "nr_class") && !rho) {
+			if (svm_type < 0) {
+				efree(line);
+				goto done;
+			}
+			nr_class = atoi(arg);
+			nr_dec = (svm_type == C_SVC || svm_type == NU_SVC) ? (int)((int64_t)nr_class * (nr_class - 1) / 2) : 1;
+			if (nr_class < 2 || nr_dec < 1) {
+				efree(line);
+				goto done;
+			}
+			rho = ecalloc(nr_dec, sizeof(double));
+		} else if (!strcmp(line, "label") && rho && !label) {
+			char *p = arg;
+
+			label = ecalloc(nr_class, sizeof(int));
+			for (i = 0; i < nr_class; i++) {
+				label[i] = (int)strtol(p, &p, 10);
+			}
+		} else if (!strcmp(line, "rho") && rho) {
+			if (php_svm_read_values(arg, rho, nr_dec) != nr_dec) {
+				efree(line);
+				goto done;
+			}
+		} else if (!strcmp(line, "probA") && rho && !probA) {
+			probA = ecalloc(nr_dec, sizeof(double));
+			if (php_svm_read_values(arg, probA, nr_dec) != nr_dec) {
+				efree(line);
+				goto done;
+			}
+		} else if (!strcmp(line, "probB") && rho && !probB) {
+			probB = ecalloc(nr_dec, sizeof(double));
+			if (php_svm_read_values(arg, probB, nr_dec) != nr_dec) {
+				efree(line);
+				goto done;
+			}
+		} else if (!strcmp(line, "dimension")) {
+			dimension = atoi(arg);
+		} else if (!strcmp(line, "seed")) {
+			seed = ZEND_STRTOL(arg, NULL, 10);
+		} else if (!strcmp(line, "features")) {
+			features = atoi(arg);
+		}
+		efree(line);
+	}
+
+	if (svm_type < 0 || !rho || dimension <= 0 || dimension > PHP_SVM_RFF_MAX_DIMENSION || !(gamma > 0)) {
+		goto done;
+	}
+
+	rff = php_svm_rff_new(gamma, dimension, seed, nr_dec, features);
+	for (i = 0; i < nr_dec; i++) {
+		line = php_svm_get_line(stream);
+		if (!line) {
+			goto done;
+		}
+		if (php_svm_read_values(line, rff->w + (size_t)i * dimension, dimension) != dimension) {
+			efree(line);
+			goto done;
+		}
+		efree(line);
+	}
+
+	model = php_svm_rff_carrier(svm_type, gamma, nr_class);
+	memcpy(model->rho, rho, nr_dec * sizeof(double));
+	if (model->label && label) {
+		memcpy(model->label, label, nr_class * sizeof(int));
+	}
+	if (probA) {
+		model->probA = malloc(nr_dec * sizeof(double));
+		memcpy(model->probA, probA, nr_dec * sizeof(double));
+	}
+	if (probB) {
+		model->probB = malloc(nr_dec * sizeof(double));
+		memcpy(model->probB, probB, nr_dec * sizeof(double));
+	}
+	ok = 1;
+
+done:
+	if (rho) {
+		efree(rho);
+	}
+	if (label) {
+		efree(label);
+	}
+	if (probA) {
+		efree(probA);
+	}
+	if (probB) {
+		efree(probB);
+	}
+	if (!ok) {
+		if (rff) {
+			php_svm_rff_free(rff);
+		}
+		return -1;
+	}
+
+	*model_ptr = model;
+	*rff_ptr = rff;
+	return 1;
+}
+/* }}} */
+
+/* ---- END FILE FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,442 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+/*
+ * Dense vector kernels for the support vector matrix built by php_svm_predictor_init. Every function
+ * takes two vectors of n doubles, where n is a multiple of PHP_SVM_DENSE_ALIGN, and returns either their
+ * dot product or their squared euclidean distance. The _f32 variants take the SV as floats, for the dense
+ * layout of svm_compact.c, widening each to double before it is used. The _i8 variant takes the int8 SV of
+ * the same layout against a row quantized to 16 bits, n a multiple of PHP_SVM_DENSE_I8_ALIGN, and returns the
+ * exact integer dot product. The variant is picked once at module startup from what the CPU supports, so a
+ * single build runs everywhere.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define PHP_SVM_HAVE_X86_DISPATCH 1
+# include <immintrin.h>
+# define PHP_SVM_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/* The integer kernels add 32 bit products of at most 127 * 32767 in 32 bit lanes, which can't overflow within
+   a block of this many values whatever the lane count */
+#define PHP_SVM_I8_BLOCK 1024
+
+php_svm_simd php_svm_simd_impl;
+
+/* ---- START SCALAR ---- */
+
+static double php_svm_dense_dot_scalar(const double *a, const double *b, int n)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		s0 += a[k] * b[k];
+		s1 += a[k + 1] * b[k + 1];
+		s2 += a[k + 2] * b[k + 2];
+		s3 += a[k + 3] * b[k + 3];
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+static double php_svm_dense_dist_scalar(const double *a, const double *b, int n)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	double d0, d1, d2, d3;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		d0 = a[k] - b[k];
+		d1 = a[k + 1] - b[k + 1];
+		d2 = a[k + 2] - b[k + 2];
+		d3 = a[k + 3] - b[k + 3];
+		s0 += d0 * d0;
+		s1 += d1 * d1;
+		s2 += d2 * d2;
+		s3 += d3 * d3;
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+static double php_svm_dense_dot_f32_scalar(const double *a, const float *b, int n)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		s0 += a[k] * b[k];
+		s1 += a[k + 1] * b[k + 1];
+		s2 += a[k + 2] * b[k + 2];
+		s3 += a[k + 3] * b[k + 3];
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+static double php_svm_dense_dist_f32_scalar(const double *a, const float *b, int n)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	double d0, d1, d2, d3;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		d0 = a[k] - b[k];
+		d1 = a[k + 1] - b[k + 1];
+		d2 = a[k + 2] - b[k + 2];
+		d3 = a[k + 3] - b[k + 3];
+		s0 += d0 * d0;
+		s1 += d1 * d1;
+		s2 += d2 * d2;
+		s3 += d3 * d3;
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+static int64_t php_svm_dense_dot_i8_scalar(const int16_t *a, const int8_t *b, int n)
+{
+	int64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		s0 += (int32_t)a[k] * b[k];
+		s1 += (int32_t)a[k + 1] * b[k + 1];
+		s2 += (int32_t)a[k + 2] * b[k + 2];
+		s3 += (int32_t)a[k + 3] * b[k + 3];
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+/* ---- END SCALAR ---- */
+
+#ifdef PHP_SVM_HAVE_X86_DISPATCH
+
+/* ---- START SSE2 ---- */
+
+PHP_SVM_TARGET("sse2")
+static double php_svm_dense_dot_sse2(const double *a, const double *b, int n)
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + k), _mm_loadu_pd(b + k)));
+		acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + k + 2), _mm_loadu_pd(b + k + 2)));
+	}
+	acc0 = _mm_add_pd(acc0, acc1);
+	return _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+}
+
+PHP_SVM_TARGET("sse2")
+static double php_svm_dense_dist_sse2(const double *a, const double *b, int n)
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	__m128d d0, d1;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		d0 = _mm_sub_pd(_mm_loadu_pd(a + k), _mm_loadu_pd(b + k));
+		d1 = _mm_sub_pd(_mm_loadu_pd(a + k + 2), _mm_loadu_pd(b + k + 2));
+		acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+		acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+	}
+	acc0 = _mm_add_pd(acc0, acc1);
+	return _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+}
+
+PHP_SVM_TARGET("sse2")
+static double php_svm_dense_dot_f32_sse2(const double *a, const float *b, int n)
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	__m128 v;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		v = _mm_loadu_ps(b + k);
+		acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + k), _mm_cvtps_pd(v)));
+		acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + k + 2), _mm_cvtps_pd(_mm_movehl_ps(v, v))));
+	}
+	acc0 = _mm_add_pd(acc0, acc1);
+	return _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+}
+
+PHP_SVM_TARGET("sse2")
+static double php_svm_dense_dist_f32_sse2(const double *a, const float *b, int n)
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	__m128d d0, d1;
+	__m128 v;
+	int k;
+
+	for (k = 0; k < n; k += 4) {
+		v = _mm_loadu_ps(b + k);
+		d0 = _mm_sub_pd(_mm_loadu_pd(a + k), _mm_cvtps_pd(v));
+		d1 = _mm_sub_pd(_mm_loadu_pd(a + k + 2), _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+		acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+		acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+	}
+	acc0 = _mm_add_pd(acc0, acc1);
+	return _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+}
+
+PHP_SVM_TARGET("sse2")
+static int64_t php_svm_hsum_epi32_sse2(__m128i v)
+{
+	int32_t lane[4];
+
+	_mm_storeu_si128((__m128i *)lane, v);
+	return ((int64_t)lane[0] + lane[1]) + ((int64_t)lane[2] + lane[3]);
+}
+
+PHP_SVM_TARGET("sse2")
+static int64_t php_svm_dense_dot_i8_sse2(const int16_t *a, const int8_t *b, int n)
+{
+	int64_t sum = 0;
+	__m128i acc, v, lo, hi;
+	int k = 0, end;
+
+	while (k < n) {
+		acc = _mm_setzero_si128();
+		end = MIN(k + PHP_SVM_I8_BLOCK, n);
+		for (; k < end; k += 16) {
+			/* Sign extend the bytes to 16 bits by pairing each with itself and shifting the copy out */
+			v = _mm_loadu_si128((const __m128i *)(b + k));
+			lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+			hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a + k)), lo));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a + k + 8)), hi));
+		}
+		sum += php_svm_hsum_epi32_sse2(acc);
+	}
+	return sum;
+}
+
+/* ---- END SSE2 ---- */
+
+/* ---- START AVX2 ---- */
+
+PHP_SVM_TARGET("avx2,fma")
+static double php_svm_hsum_avx(__m256d v)
+{
+	__m128d lo = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+PHP_SVM_TARGET("avx2,fma")
+static double php_svm_dense_dot_avx2(const double *a, const double *b, int n)
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + k), _mm256_loadu_pd(b + k), acc0);
+		acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + k + 4), _mm256_loadu_pd(b + k + 4), acc1);
+	}
+	return php_svm_hsum_avx(_mm256_add_pd(acc0, acc1));
+}
+
+PHP_SVM_TARGET("avx2,fma")
+static double php_svm_dense_dist_avx2(const double *a, const double *b, int n)
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	__m256d d0, d1;
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		d0 = _mm256_sub_pd(_mm256_loadu_pd(a + k), _mm256_loadu_pd(b + k));
+		d1 = _mm256_sub_pd(_mm256_loadu_pd(a + k + 4), _mm256_loadu_pd(b + k + 4));
+		acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+		acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+	}
+	return php_svm_hsum_avx(_mm256_add_pd(acc0, acc1));
+}
+
+PHP_SVM_TARGET("avx2,fma")
+static double php_svm_dense_dot_f32_avx2(const double *a, const float *b, int n)
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + k), _mm256_cvtps_pd(_mm_loadu_ps(b + k)), acc0);
+		acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + k + 4), _mm256_cvtps_pd(_mm_loadu_ps(b + k + 4)), acc1);
+	}
+	return php_svm_hsum_avx(_mm256_add_pd(acc0, acc1));
+}
+
+PHP_SVM_TARGET("avx2,fma")
+static double php_svm_dense_dist_f32_avx2(const double *a, const float *b, int n)
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	__m256d d0, d1;
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		d0 = _mm256_sub_pd(_mm256_loadu_pd(a + k), _mm256_cvtps_pd(_mm_loadu_ps(b + k)));
+		d1 = _mm256_sub_pd(_mm256_loadu_pd(a + k + 4), _mm256_cvtps_pd(_mm_loadu_ps(b + k + 4)));
+		acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+		acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+	}
+	return php_svm_hsum_avx(_mm256_add_pd(acc0, acc1));
+}
+
+PHP_SVM_TARGET("avx2")
+static int64_t php_svm_dense_dot_i8_avx2(const int16_t *a, const int8_t *b, int n)
+{
+	int64_t sum = 0;
+	int32_t lane[8];
+	__m256i acc;
+	int k = 0, end, j;
+
+	while (k < n) {
+		acc = _mm256_setzero_si256();
+		end = MIN(k + PHP_SVM_I8_BLOCK, n);
+		for (; k < end; k += 16) {
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(a + k)),
+				_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b + k)))));
+		}
+		_mm256_storeu_si256((__m256i *)lane, acc);
+		for (j = 0; j < 8; j++) {
+			sum += lane[j];
+		}
+	}
+	return sum;
+}
+
+/* ---- END AVX2 ---- */
+
+/* ---- START AVX-512 ---- */
+
+PHP_SVM_TARGET("avx512f")
+static double php_svm_dense_dot_avx512(const double *a, const double *b, int n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		acc = _mm512_fmadd_pd(_mm512_loadu_pd(a + k), _mm512_loadu_pd(b + k), acc);
+	}
+	return _mm512_reduce_add_pd(acc);
+}
+
+PHP_SVM_TARGET("avx512f")
+static double php_svm_dense_dist_avx512(const double *a, const double *b, int n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	__m512d d;
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		d = _mm512_sub_pd(_mm512_loadu_pd(a + k), _mm512_loadu_pd(b + k));
+		acc = _mm512_fmadd_pd(d, d, acc);
+	}
+	return _mm512_reduce_add_pd(acc);
+}
+
+PHP_SVM_TARGET("avx512f")
+static double php_svm_dense_dot_f32_avx512(const double *a, const float *b, int n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		acc = _mm512_fmadd_pd(_mm512_loadu_pd(a + k), _mm512_cvtps_pd(_mm256_loadu_ps(b + k)), acc);
+	}
+	return _mm512_reduce_add_pd(acc);
+}
+
+PHP_SVM_TARGET("avx512f")
+static double php_svm_dense_dist_f32_avx512(const double *a, const float *b, int n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	__m512d d;
+	int k;
+
+	for (k = 0; k < n; k += 8) {
+		d = _mm512_sub_pd(_mm512_loadu_pd(a + k), _mm512_cvtps_pd(_mm256_loadu_ps(b + k)));
+		acc = _mm512_fmadd_pd(d, d, acc);
+	}
+	return _mm512_reduce_add_pd(acc);
+}
+
+/* ---- END AVX-512 ---- */
+
+#endif /* PHP_SVM_HAVE_X86_DISPATCH */
+
+/* {{{ void php_svm_simd_init(void)
+Pick the widest dense kernels the CPU supports. Called once from MINIT, before any request can predict.
+*/
+void php_svm_simd_init(void)
+{
+	php_svm_simd_impl.name = "scalar";
+	php_svm_simd_impl.dot  = php_svm_dense_dot_scalar;
+	php_svm_simd_impl.dist = php_svm_dense_dist_scalar;
+	php_svm_simd_impl.dot_f32  = php_svm_dense_dot_f32_scalar;
+	php_svm_simd_impl.dist_f32 = php_svm_dense_dist_f32_scalar;
+	php_svm_simd_impl.dot_i8   = php_svm_dense_dot_i8_scalar;
+
+#ifdef PHP_SVM_HAVE_X86_DISPATCH
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f")) {
+		php_svm_simd_impl.name = "avx512f";
+		php_svm_simd_impl.dot  = php_svm_dense_dot_avx512;
+		php_svm_simd_impl.dist = php_svm_dense_dist_avx512;
+		php_svm_simd_impl.dot_f32  = php_svm_dense_dot_f32_avx512;
+		php_svm_simd_impl.dist_f32 = php_svm_dense_dist_f32_avx512;
+		/* Every AVX-512 processor has AVX2, whose 16 bit multiply-adds are enough for int8 */
+		php_svm_simd_impl.dot_i8   = php_svm_dense_dot_i8_avx2;
+	} else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		php_svm_simd_impl.name = "avx2";
+		php_svm_simd_impl.dot  = php_svm_dense_dot_avx2;
+		php_svm_simd_impl.dist = php_svm_dense_dist_avx2;
+		php_svm_simd_impl.dot_f32  = php_svm_dense_dot_f32_avx2;
+		php_svm_simd_impl.dist_f32 = php_svm_dense_dist_f32_avx2;
+		php_svm_simd_impl.dot_i8   = php_svm_dense_dot_i8_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		php_svm_simd_impl.name = "sse2";
+		php_svm_simd_impl.dot  = php_svm_dense_dot_sse2;
+		php_svm_simd_impl.dist = php_svm_dense_dist_sse2;
+		php_svm_simd_impl.dot_f32  = php_svm_dense_dot_f32_sse2;
+		php_svm_simd_impl.dist_f32 = php_svm_dense_dist_f32_sse2;
+		php_svm_simd_impl.dot_i8   = php_svm_dense_dot_i8_sse2;
+	}
+#endif
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,214 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+/*
+ * Models kept across requests by SVMModel::fromCache(). Each worker, or each thread under ZTS, has a store of its
+ * own, so nothing here is shared or locked. Entries hold the model opened from the binary format along with its
+ * prediction state, all in persistent memory, and objects handed out for an entry use both directly. Entries are
+ * reference counted, so one replaced or evicted while objects still use it lives on until the last of them is
+ * freed. A worker holds a handful of models, so entries are found by walking the list, which is kept in order of
+ * use for evicting the least recently used one when the memory budget is exceeded.
+ */
+
+/* ---- START LIST FUNCS ---- */
+
+static void php_svm_store_unlink(php_svm_store *store, php_svm_store_entry *entry)
+{
+	if (entry->lru_prev) {
+		entry->lru_prev->lru_next = entry->lru_next;
+	} else {
+		store->head = entry->lru_next;
+	}
+	if (entry->lru_next) {
+		entry->lru_next->lru_prev = entry->lru_prev;
+	} else {
+		store->tail = entry->lru_prev;
+	}
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void php_svm_store_push(php_svm_store *store, php_svm_store_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = store->head;
+	if (store->head) {
+		store->head->lru_prev = entry;
+	} else {
+		store->tail = entry;
+	}
+	store->head = entry;
+}
+
+/* ---- END LIST FUNCS ---- */
+
+/* ---- START STORE FUNCS ---- */
+
+/* {{{ php_svm_store *php_svm_store_new(void)
+An empty store in persistent memory.
+*/
+php_svm_store *php_svm_store_new(void)
+{
+	return pecalloc(1, sizeof(php_svm_store), 1);
+}
+/* }}} */
+
+/* {{{ php_svm_store_entry *php_svm_store_find(php_svm_store *store, const char *path, size_t path_len)
+The entry for a path, or NULL.
+*/
+php_svm_store_entry *php_svm_store_find(php_svm_store *store, const char *path, size_t path_len)
+{
+	php_svm_store_entry *entry;
+
+	for (entry = store->head; entry; entry = entry->lru_next) {
+		if (ZSTR_LEN(entry->path) == path_len && !memcmp(ZSTR_VAL(entry->path), path, path_len)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+/* }}} */
+
+/* {{{ void php_svm_store_use(php_svm_store *store, php_svm_store_entry *entry)
+Make an entry the most recently used one.
+*/
+void php_svm_store_use(php_svm_store *store, php_svm_store_entry *entry)
+{
+	if (store->head != entry) {
+		php_svm_store_unlink(store, entry);
+		php_svm_store_push(store, entry);
+	}
+}
+/* }}} */
+
+/* {{{ php_svm_store_entry *php_svm_store_entry_new(const char *path, size_t path_len, struct svm_model *model, php_svm_mapping *mapping, const php_svm_predictor *pred, const php_svm_store_stat *stat)
+An entry for a model opened from a persistent mapping and its persistent predictor, which the entry takes over.
+The caller holds the one reference the entry starts with.
+*/
+php_svm_store_entry *php_svm_store_entry_new(const char *path, size_t path_len, struct svm_model *model, php_svm_mapping *mapping, const php_svm_predictor *pred, const php_svm_store_stat *stat)
+{
+	php_svm_store_entry *entry = pecalloc(1, sizeof(php_svm_store_entry), 1);
+
+	entry->path = zend_string_init(path, path_len, 1);
+	entry->model = model;
+	entry->mapping = mapping;
+	entry->predictor = *pred;
+	entry->memory = mapping->size + php_svm_predictor_memory(pred, model);
+	entry->refcount = 1;
+	entry->stat = *stat;
+	return entry;
+}
+/* }}} */
+
+/* {{{ void php_svm_store_release(php_svm_store_entry *entry)
+Drop a reference to an entry, releasing it with the last one.
+*/
+void php_svm_store_release(php_svm_store_entry *entry)
+{
+	if (--entry->refcount > 0) {
+		return;
+	}
+	php_svm_predictor_free(&entry->predictor);
+	php_svm_binary_free(entry->model, entry->mapping);
+	zend_string_release(entry->path);
+	pefree(entry, 1);
+}
+/* }}} */
+
+/* {{{ void php_svm_store_remove(php_svm_store *store, php_svm_store_entry *entry)
+Drop an entry from the store. Objects still using it keep it until they are freed.
+*/
+void php_svm_store_remove(php_svm_store *store, php_svm_store_entry *entry)
+{
+	php_svm_store_unlink(store, entry);
+	store->entries--;
+	store->memory -= entry->memory;
+	php_svm_store_release(entry);
+}
+/* }}} */
+
+/* {{{ void php_svm_store_trim(php_svm_store *store, size_t max_memory)
+Evict the least recently used entries until the models fit in max_memory.
+*/
+void php_svm_store_trim(php_svm_store *store, size_t max_memory)
+{
+	while (store->tail && store->memory > max_memory) {
+		php_svm_store_remove(store, store->tail);
+		store->evictions++;
+	}
+}
+/* }}} */
+
+/* {{{ zend_bool php_svm_store_put(php_svm_store *store, php_svm_store_entry *entry, size_t max_memory)
+Keep an entry for its path, replacing the entry already there. The store takes its own reference. Entries that
+don't fit in max_memory on their own aren't kept, and 0 is returned.
+*/
+zend_bool php_svm_store_put(php_svm_store *store, php_svm_store_entry *entry, size_t max_memory)
+{
+	php_svm_store_entry *old = php_svm_store_find(store, ZSTR_VAL(entry->path), ZSTR_LEN(entry->path));
+
+	if (old) {
+		php_svm_store_remove(store, old);
+	}
+	if (entry->memory > max_memory) {
+		return 0;
+	}
+	php_svm_store_trim(store, max_memory - entry->memory);
+
+	entry->refcount++;
+	php_svm_store_push(store, entry);
+	store->entries++;
+	store->memory += entry->memory;
+	return 1;
+}
+/* }}} */
+
+/* {{{ void php_svm_store_free(php_svm_store *store)
+Release every entry and the store.
+*/
+void php_svm_store_free(php_svm_store *store)
+{
+	while (store->head) {
+		php_svm_store_remove(store, store->head);
+	}
+	pefree(store, 1);
+}
+/* }}} */
+
+/* ---- END STORE FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
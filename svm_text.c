@@ -0,0 +1,953 @@
+/*
+ * LibSVM extension for PHP
+ * Copyright (c) 2011, The php-svm authors
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL IAN BARBER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "php_svm.h"
+#include "php_svm_internal.h"
+
+#include <math.h>
+
+/*
+ * Reader for libsvm's text model format, in place of svm_load_model. libsvm reads the SV section twice, once
+ * to count the nodes and once to parse them with strtok and strtod, and switches the process wide locale to
+ * "C" for the duration. This reads the file once through a large buffer, growing the node array as it goes,
+ * and parses numbers itself: values with up to 19 significant digits and a small exponent are exact products
+ * or quotients of two doubles, and anything longer goes to zend_strtod, so every value comes out as strtod
+ * would give it under the C locale without touching the locale. The model is allocated the way libsvm
+ * allocates it, so svm_free_and_destroy_model releases it.
+ *
+ * The writer in turn replaces svm_save_model, which makes an fprintf call for every number under the same
+ * locale switch. Text is formatted into a large buffer that goes to the stream in few writes. SV values keep
+ * the 8 significant digits of libsvm's %.8g, produced for almost all values by a scaled integer conversion,
+ * and the coefficients and other doubles are written with the fewest digits that read back exactly, so models
+ * saved here load the same in libsvm and its tools.
+ */
+
+/* Bytes read from the stream at a time, the buffer grows for longer lines. Also the size of the write buffer. */
+#define PHP_SVM_TEXT_BUFFER 65536
+
+/* The SV arrays start with room for this many SVs and double as more are read */
+#define PHP_SVM_TEXT_FIRST_SVS 1024
+
+/* Nodes the SV array starts with, per SV */
+#define PHP_SVM_TEXT_NODES_PER_SV 16
+
+typedef struct _php_svm_text_writer {
+	php_stream *stream;
+	char *buf;    /* PHP_SVM_TEXT_BUFFER bytes */
+	size_t len;
+	zend_bool failed;
+} php_svm_text_writer;
+
+typedef struct _php_svm_text_reader {
+	php_stream *stream;
+	char *buf;
+	size_t size;
+	size_t pos;   /* start of the next line */
+	size_t len;   /* end of the data read */
+	zend_bool eof;
+} php_svm_text_reader;
+
+/* svm_type and kernel_type names as libsvm writes them, also used by svm_compact.c and svm_rff.c */
+const char *php_svm_svm_type_names[] = {
+	"c_svc", "nu_svc", "one_class", "epsilon_svr", "nu_svr", NULL
+};
+
+const char *php_svm_kernel_type_names[] = {
+	"linear", "polynomial", "rbf", "sigmoid", "precomputed", NULL
+};
+
+/* Powers of ten that are exact as doubles */
+static const double php_svm_text_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* ---- START PARSE FUNCS ---- */
+
+/* {{{ static char *php_svm_text_line(php_svm_text_reader *reader)
+The next line, without its line ending, or NULL at the end of the stream. The line stays valid until the next
+call.
+*/
+static char *php_svm_text_line(php_svm_text_reader *reader)
+{
+	size_t scan = reader->pos;
+	char *line, *end;
+
+	for (;;) {
+		char *nl = memchr(reader->buf + scan, '\n', reader->len - scan);
+		ssize_t n;
+
+		if (nl) {
+			end = nl;
+			break;
+		}
+		if (reader->eof) {
+			if (reader->pos == reader->len) {
+				return NULL;
+			}
+			end = reader->buf + reader->len;
+			break;
+		}
+
+		/* Keep the partial line and read more after it, leaving room for the terminator */
+		if (reader->pos > 0) {
+			memmove(reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+			reader->len -= reader->pos;
+			reader->pos = 0;
+		}
+		scan = reader->len;
+		if (reader->size - reader->len < PHP_SVM_TEXT_BUFFER / 2) {
+			reader->size *= 2;
+			reader->buf = erealloc(reader->buf, reader->size);
+		}
+		n = (ssize_t)php_stream_read(reader->stream, reader->buf + reader->len, reader->size - reader->len - 1);
+		if (n <= 0) {
+			reader->eof = 1;
+		} else {
+			reader->len += n;
+		}
+	}
+
+	line = reader->buf + reader->pos;
+	reader->pos = end - reader->buf + (end < reader->buf + reader->len);
+	if (end > line && end[-1] == '\r') {
+		end--;
+	}
+	*end = '\0';
+	return line;
+}
+/* }}} */
+
+/* {{{ static double php_svm_text_double(const char *p, const char **end)
+Parse a number as strtod does in the C locale. *end is left at p if there is none.
+*/
+static zend_always_inline double php_svm_text_double(const char *p, const char **end)
+{
+	const char *s = p;
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0, seen = 0;
+	zend_bool negative = 0;
+	double value;
+
+	if (*s == '-' || *s == '+') {
+		negative = (*s++ == '-');
+	}
+	for (; *s >= '0' && *s <= '9'; s++, seen++) {
+		if (mantissa || *s != '0') {
+			if (++digits > 19) {
+				goto slow;
+			}
+			mantissa = mantissa * 10 + (*s - '0');
+		}
+	}
+	if (*s == '.') {
+		for (s++; *s >= '0' && *s <= '9'; s++, seen++) {
+			if (mantissa || *s != '0') {
+				if (++digits > 19) {
+					goto slow;
+				}
+				mantissa = mantissa * 10 + (*s - '0');
+			}
+			exponent--;
+		}
+	}
+	if (!seen) {
+		goto slow;
+	}
+	if (*s == 'e' || *s == 'E') {
+		const char *e = s + 1;
+		zend_bool e_negative = 0;
+		int e_value = 0;
+
+		if (*e == '-' || *e == '+') {
+			e_negative = (*e++ == '-');
+		}
+		if (*e >= '0' && *e <= '9') {
+			for (; *e >= '0' && *e <= '9'; e++) {
+				if (e_value > 9999) {
+					goto slow;
+				}
+				e_value = e_value * 10 + (*e - '0');
+			}
+			exponent += e_negative ? -e_value : e_value;
+			s = e;
+		}
+	}
+
+	/* Both operands are exact, so the single rounding of the product or quotient is the correct one */
+	if (mantissa > ((uint64_t)1 << 53) || exponent < -22 || exponent > 22) {
+		goto slow;
+	}
+	value = (double)mantissa;
+	value = exponent < 0 ? value / php_svm_text_pow10[-exponent] : value * php_svm_text_pow10[exponent];
+	*end = s;
+	return negative ? -value : value;
+
+slow:
+	return zend_strtod(p, end);
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_text_int(const char *p, const char **end, int *value)
+Parse a decimal int. Fails on overflow or if there is none.
+*/
+static zend_always_inline zend_bool php_svm_text_int(const char *p, const char **end, int *value)
+{
+	const char *s = p;
+	zend_bool negative = 0;
+	int64_t v = 0;
+
+	if (*s == '-' || *s == '+') {
+		negative = (*s++ == '-');
+	}
+	if (*s < '0' || *s > '9') {
+		return 0;
+	}
+	for (; *s >= '0' && *s <= '9'; s++) {
+		v = v * 10 + (*s - '0');
+		if (v > (int64_t)INT_MAX + 1) {
+			return 0;
+		}
+	}
+	if (negative) {
+		v = -v;
+	}
+	if (v > INT_MAX) {
+		return 0;
+	}
+	*value = (int)v;
+	*end = s;
+	return 1;
+}
+/* }}} */
+
+/* {{{ static int php_svm_text_ints(const char *p, int *values, int n)
+Parse n ints following the keyword in a line. Returns the number read.
+*/
+static int php_svm_text_ints(const char *p, int *values, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		while (*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if (!php_svm_text_int(p, &p, &values[i])) {
+			break;
+		}
+	}
+	return i;
+}
+/* }}} */
+
+/* ---- END PARSE FUNCS ---- */
+
+/* ---- START LOAD FUNCS ---- */
+
+/* {{{ static void *php_svm_text_realloc(void *array, size_t count, size_t size)
+Resize a malloc'd array to count elements. Returns NULL, leaving the array as it was, if it can't.
+*/
+static void *php_svm_text_realloc(void *array, size_t count, size_t size)
+{
+	if (count > SIZE_MAX / size) {
+		return NULL;
+	}
+	return realloc(array, count ? count * size : 1);
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_text_header(php_svm_text_reader *reader, struct svm_model *model)
+Read the header up to the SV line, with the keywords libsvm writes.
+*/
+static zend_bool php_svm_text_header(php_svm_text_reader *reader, struct svm_model *model)
+{
+	struct svm_parameter *param = &model->param;
+	int nr_dec = -1;
+	char *line;
+
+	param->svm_type = -1;
+	param->kernel_type = -1;
+
+	while ((line = php_svm_text_line(reader)) != NULL) {
+		char *arg = line + strcspn(line, " \t");
+
+		if (*arg) {
+			*arg++ = '\0';
+		}
+
+		if (!strcmp(line, "SV")) {
+			return param->svm_type >= 0 && param->kernel_type >= 0 && model->nr_class > 0 && model->l >= 0 && model->rho;
+		} else if (!strcmp(line, "svm_type")) {
+			param->svm_type = php_svm_find_name(php_svm_svm_type_names, arg);
+			if (param->svm_type < 0) {
+				return 0;
+			}
+		} else if (!strcmp(line, "kernel_type")) {
+			param->kernel_type = php_svm_find_name(php_svm_kernel_type_names, arg);
+			if (param->kernel_type < 0) {
+				return 0;
+			}
+		} else if (!strcmp(line, "degree")) {
+			if (php_svm_text_ints(arg, &param->degree, 1) != 1) {
+				return 0;
+			}
+		} else if (!strcmp(line, "gamma")) {
+			if (php_svm_read_values(arg, &param->gamma, 1) != 1) {
+				return 0;
+			}
+		} else if (!strcmp(line, "coef0")) {
+			if (php_svm_read_values(arg, &param->coef0, 1) != 1) {
+				return 0;
+			}
+		} else if (!strcmp(line, "nr_class")) {
+			/* The arrays below are sized by it, so it can't change once they exist */
+			if (nr_dec >= 0 || php_svm_text_ints(arg, &model->nr_class, 1) != 1 || model->nr_class < 1 || model->nr_class > 65536) {
+				return 0;
+			}
+			nr_dec = (int)((int64_t)model->nr_class * (model->nr_class - 1) / 2);
+		} else if (!strcmp(line, "total_sv")) {
+			if (php_svm_text_ints(arg, &model->l, 1) != 1) {
+				return 0;
+			}
+		} else if (!strcmp(line, "rho") && nr_dec >= 0 && !model->rho) {
+			/* one spare so that a single class model still gets an array */
+			model->rho = php_svm_text_realloc(NULL, (size_t)nr_dec + 1, sizeof(double));
+			if (!model->rho || php_svm_read_values(arg, model->rho, nr_dec) != nr_dec) {
+				return 0;
+			}
+		} else if (!strcmp(line, "label") && nr_dec >= 0 && !model->label) {
+			model->label = php_svm_text_realloc(NULL, model->nr_class, sizeof(int));
+			if (!model->label || php_svm_text_ints(arg, model->label, model->nr_class) != model->nr_class) {
+				return 0;
+			}
+		} else if (!strcmp(line, "probA") && nr_dec >= 0 && !model->probA) {
+			model->probA = php_svm_text_realloc(NULL, nr_dec, sizeof(double));
+			if (!model->probA || php_svm_read_values(arg, model->probA, nr_dec) != nr_dec) {
+				return 0;
+			}
+		} else if (!strcmp(line, "probB") && nr_dec >= 0 && !model->probB) {
+			model->probB = php_svm_text_realloc(NULL, nr_dec, sizeof(double));
+			if (!model->probB || php_svm_read_values(arg, model->probB, nr_dec) != nr_dec) {
+				return 0;
+			}
+		} else if (!strcmp(line, "nr_sv") && nr_dec >= 0 && !model->nSV) {
+			model->nSV = php_svm_text_realloc(NULL, model->nr_class, sizeof(int));
+			if (!model->nSV || php_svm_text_ints(arg, model->nSV, model->nr_class) != model->nr_class) {
+				return 0;
+			}
+		} else {
+			return 0;
+		}
+	}
+	return 0;
+}
+/* }}} */
+
+/* {{{ static zend_bool php_svm_text_svs(php_svm_text_reader *reader, struct svm_model *model)
+Read the l SV lines, the coefficients of each SV followed by its index:value pairs. The arrays grow as lines
+are read rather than being sized from total_sv, so a header claiming more SVs than the file holds fails
+without first allocating for all of them.
+*/
+static zend_bool php_svm_text_svs(php_svm_text_reader *reader, struct svm_model *model)
+{
+	int m = model->nr_class - 1, l = model->l, i, k;
+	size_t *start = NULL, sv_cap = 0, nodes = 0, cap = PHP_SVM_TEXT_FIRST_SVS * PHP_SVM_TEXT_NODES_PER_SV;
+	struct svm_node *x_space, **SV;
+	zend_bool ok = 0;
+
+	model->sv_coef = calloc(m > 0 ? m : 1, sizeof(double *));
+	if (!model->sv_coef) {
+		return 0;
+	}
+	if (l == 0) {
+		model->SV = calloc(1, sizeof(struct svm_node *));
+		return model->SV != NULL;
+	}
+
+	x_space = malloc(cap * sizeof(struct svm_node));
+	if (!x_space) {
+		return 0;
+	}
+
+	for (i = 0; i < l; i++) {
+		const char *p = php_svm_text_line(reader), *end;
+
+		if (!p) {
+			goto done;
+		}
+		if ((size_t)i == sv_cap) {
+			size_t *grown;
+
+			sv_cap = sv_cap ? MIN(2 * sv_cap, (size_t)l) : MIN(PHP_SVM_TEXT_FIRST_SVS, (size_t)l);
+			for (k = 0; k < m; k++) {
+				double *row = php_svm_text_realloc(model->sv_coef[k], sv_cap, sizeof(double));
+
+				if (!row) {
+					goto done;
+				}
+				model->sv_coef[k] = row;
+			}
+			if (!(grown = php_svm_text_realloc(start, sv_cap, sizeof(size_t)))) {
+				goto done;
+			}
+			start = grown;
+		}
+		for (k = 0; k < m; k++) {
+			while (*p == ' ' || *p == '\t') {
+				p++;
+			}
+			model->sv_coef[k][i] = php_svm_text_double(p, &end);
+			if (end == p) {
+				goto done;
+			}
+			p = end;
+		}
+
+		start[i] = nodes;
+		for (;;) {
+			int index;
+
+			while (*p == ' ' || *p == '\t') {
+				p++;
+			}
+			if (!*p) {
+				break;
+			}
+			/* one spare node for the terminator */
+			if (nodes + 2 > cap) {
+				struct svm_node *grown = php_svm_text_realloc(x_space, 2 * cap, sizeof(struct svm_node));
+
+				if (!grown) {
+					goto done;
+				}
+				x_space = grown;
+				cap *= 2;
+			}
+			if (!php_svm_text_int(p, &end, &index) || *end != ':') {
+				goto done;
+			}
+			p = end + 1;
+			x_space[nodes].index = index;
+			x_space[nodes].value = php_svm_text_double(p, &end);
+			if (end == p) {
+				goto done;
+			}
+			p = end;
+			nodes++;
+		}
+		x_space[nodes].index = -1;
+		x_space[nodes].value = 0;
+		nodes++;
+	}
+
+	/* Every line is in, so the SV array is sized by what was read and x_space stops moving */
+	SV = php_svm_text_realloc(NULL, (size_t)l, sizeof(struct svm_node *));
+	if (!SV) {
+		goto done;
+	}
+	if (nodes < cap) {
+		struct svm_node *shrunk = realloc(x_space, nodes * sizeof(struct svm_node));
+
+		if (shrunk) {
+			x_space = shrunk;
+		}
+	}
+	for (i = 0; i < l; i++) {
+		SV[i] = x_space + start[i];
+	}
+	model->SV = SV;
+	model->free_sv = 1;
+	x_space = NULL;
+	ok = 1;
+
+done:
+	if (x_space) {
+		free(x_space);
+	}
+	if (start) {
+		free(start);
+	}
+	return ok;
+}
+/* }}} */
+
+/* {{{ struct svm_model *php_svm_text_load(php_stream *stream)
+Read a model in libsvm's text format from a stream, giving the same model svm_load_model does. Returns NULL if
+the stream doesn't hold a complete model.
+*/
+struct svm_model *php_svm_text_load(php_stream *stream)
+{
+	php_svm_text_reader reader;
+	struct svm_model *model;
+	zend_bool ok;
+
+	memset(&reader, 0, sizeof(reader));
+	reader.stream = stream;
+	reader.size = PHP_SVM_TEXT_BUFFER;
+	reader.buf = emalloc(reader.size);
+
+	model = calloc(1, sizeof(struct svm_model));
+	if (!model) {
+		efree(reader.buf);
+		return NULL;
+	}
+	ok = php_svm_text_header(&reader, model) && php_svm_text_svs(&reader, model);
+	efree(reader.buf);
+
+	if (!ok) {
+		svm_free_and_destroy_model(&model);
+		return NULL;
+	}
+	return model;
+}
+/* }}} */
+
+/* ---- END LOAD FUNCS ---- */
+
+/* ---- START SAVE FUNCS ---- */
+
+/* {{{ static void php_svm_text_flush(php_svm_text_writer *writer)
+Hand the buffered text to the stream.
+*/
+static void php_svm_text_flush(php_svm_text_writer *writer)
+{
+	if (writer->len && (size_t)php_stream_write(writer->stream, writer->buf, writer->len) != writer->len) {
+		writer->failed = 1;
+	}
+	writer->len = 0;
+}
+/* }}} */
+
+/* {{{ static char *php_svm_text_reserve(php_svm_text_writer *writer, size_t n)
+Room for n more bytes at the end of the buffer.
+*/
+static zend_always_inline char *php_svm_text_reserve(php_svm_text_writer *writer, size_t n)
+{
+	if (writer->len + n > PHP_SVM_TEXT_BUFFER) {
+		php_svm_text_flush(writer);
+	}
+	return writer->buf + writer->len;
+}
+/* }}} */
+
+/* {{{ static void php_svm_text_put(php_svm_text_writer *writer, const char *s)
+Append a string shorter than the buffer.
+*/
+static void php_svm_text_put(php_svm_text_writer *writer, const char *s)
+{
+	size_t n = strlen(s);
+
+	memcpy(php_svm_text_reserve(writer, n), s, n);
+	writer->len += n;
+}
+/* }}} */
+
+/* {{{ static void php_svm_text_put_int(php_svm_text_writer *writer, int value)
+Append an int as %d writes it.
+*/
+static zend_always_inline void php_svm_text_put_int(php_svm_text_writer *writer, int value)
+{
+	char tmp[12], *out = php_svm_text_reserve(writer, sizeof(tmp));
+	unsigned int u = value < 0 ? 0U - (unsigned int)value : (unsigned int)value;
+	int n = 0;
+
+	if (value < 0) {
+		*out++ = '-';
+		writer->len++;
+	}
+	do {
+		tmp[n++] = (char)('0' + u % 10);
+		u /= 10;
+	} while (u);
+	writer->len += n;
+	while (n) {
+		*out++ = tmp[--n];
+	}
+}
+/* }}} */
+
+/* {{{ static int php_svm_text_digits8(double value, char *digits, int *decpt)
+The digits of a positive value rounded to 8 significant digits, without trailing zeros, and the position of the
+decimal point. The value scaled to 8 digits before the point is one exact product or quotient, so its error is
+far below the rounding step, unless it lies right by a tie. Returns 0 for those and for values out of range.
+*/
+static int php_svm_text_digits8(double value, char *digits, int *decpt)
+{
+	int e, x, p, n, tries;
+	uint32_t scaled;
+
+	if (value < 1e-14 || value >= 1e14) {
+		return 0;
+	}
+	frexp(value, &e);
+	x = (int)floor((e - 1) * 0.30102999566398120);
+
+	for (tries = 0; tries < 2; tries++) {
+		double y, r;
+
+		p = 7 - x;
+		y = p >= 0 ? value * php_svm_text_pow10[p] : value / php_svm_text_pow10[-p];
+		if (y < 1e7) {
+			x--;
+			continue;
+		}
+		if (y >= 1e8) {
+			x++;
+			continue;
+		}
+		scaled = (uint32_t)y;
+		r = y - scaled;
+		if (fabs(r - 0.5) < 1e-7) {
+			return 0;
+		}
+		if (r > 0.5 && ++scaled == 100000000) {
+			scaled = 10000000;
+			x++;
+		}
+		for (n = 8; n > 0; n--) {
+			digits[n - 1] = (char)('0' + scaled % 10);
+			scaled /= 10;
+		}
+		for (n = 8; n > 1 && digits[n - 1] == '0'; n--);
+		*decpt = x + 1;
+		return n;
+	}
+	return 0;
+}
+/* }}} */
+
+/* {{{ static void php_svm_text_put_double(php_svm_text_writer *writer, double value, int precision)
+Append a number in the form %.<precision>g gives it, with the digits of %.8g for a precision of 8, or the
+fewest digits that read back as the same double for a precision of 17.
+*/
+static void php_svm_text_put_double(php_svm_text_writer *writer, double value, int precision)
+{
+	char fast[16], *digits, *out = php_svm_text_reserve(writer, 32), *start = out;
+	char *dtoa = NULL;
+	int n = 0, decpt, sign = signbit(value) != 0, x, i;
+
+	if (!zend_finite(value)) {
+		php_svm_text_put(writer, zend_isnan(value) ? (sign ? "-nan" : "nan") : (sign ? "-inf" : "inf"));
+		return;
+	}
+	if (sign) {
+		*out++ = '-';
+		value = -value;
+	}
+	if (value == 0) {
+		*out++ = '0';
+		writer->len += out - start;
+		return;
+	}
+
+	if (precision == 8 && (n = php_svm_text_digits8(value, fast, &decpt)) > 0) {
+		digits = fast;
+	} else if (precision == 17 && value < 1e16 && value == (double)(int64_t)value) {
+		/* Whole numbers, such as coefficients at the bound C, read back exactly from their own digits */
+		int64_t whole = (int64_t)value;
+
+		decpt = 0;
+		do {
+			fast[15 - decpt++] = (char)('0' + whole % 10);
+			whole /= 10;
+		} while (whole);
+		digits = fast + 16 - decpt;
+		for (n = decpt; digits[n - 1] == '0'; n--);
+	} else {
+		char *end;
+		int dtoa_sign;
+
+		digits = dtoa = zend_dtoa(value, precision == 8 ? 2 : 0, precision == 8 ? 8 : 0, &decpt, &dtoa_sign, &end);
+		n = (int)(end - digits);
+	}
+
+	/* %g picks the exponent form when the exponent is below -4 or reaches the precision */
+	x = decpt - 1;
+	if (x < -4 || x >= precision) {
+		*out++ = digits[0];
+		if (n > 1) {
+			*out++ = '.';
+			memcpy(out, digits + 1, n - 1);
+			out += n - 1;
+		}
+		*out++ = 'e';
+		*out++ = x < 0 ? '-' : '+';
+		if (x < 0) {
+			x = -x;
+		}
+		if (x >= 100) {
+			*out++ = (char)('0' + x / 100);
+		}
+		*out++ = (char)('0' + x / 10 % 10);
+		*out++ = (char)('0' + x % 10);
+	} else if (decpt <= 0) {
+		*out++ = '0';
+		*out++ = '.';
+		for (i = decpt; i < 0; i++) {
+			*out++ = '0';
+		}
+		memcpy(out, digits, n);
+		out += n;
+	} else if (decpt >= n) {
+		memcpy(out, digits, n);
+		out += n;
+		for (i = n; i < decpt; i++) {
+			*out++ = '0';
+		}
+	} else {
+		memcpy(out, digits, decpt);
+		out += decpt;
+		*out++ = '.';
+		memcpy(out, digits + decpt, n - decpt);
+		out += n - decpt;
+	}
+	writer->len += out - start;
+
+	if (dtoa) {
+		zend_freedtoa(dtoa);
+	}
+}
+/* }}} */
+
+/* {{{ static void php_svm_text_put_doubles(php_svm_text_writer *writer, const char *key, const double *values, int n)
+Append a header line of n doubles after its keyword.
+*/
+static void php_svm_text_put_doubles(php_svm_text_writer *writer, const char *key, const double *values, int n)
+{
+	int i;
+
+	php_svm_text_put(writer, key);
+	for (i = 0; i < n; i++) {
+		php_svm_text_put(writer, " ");
+		php_svm_text_put_double(writer, values[i], 17);
+	}
+	php_svm_text_put(writer, "\n");
+}
+/* }}} */
+
+/* {{{ static void php_svm_text_put_ints(php_svm_text_writer *writer, const char *key, const int *values, int n)
+Append a header line of n ints after its keyword.
+*/
+static void php_svm_text_put_ints(php_svm_text_writer *writer, const char *key, const int *values, int n)
+{
+	int i;
+
+	php_svm_text_put(writer, key);
+	for (i = 0; i < n; i++) {
+		php_svm_text_put(writer, " ");
+		php_svm_text_put_int(writer, values[i]);
+	}
+	php_svm_text_put(writer, "\n");
+}
+/* }}} */
+
+/* {{{ zend_bool php_svm_text_save(php_stream *stream, const struct svm_model *model)
+Write a model in libsvm's text format, laid out as svm_save_model lays it out. Returns 0 if the stream failed.
+*/
+zend_bool php_svm_text_save(php_stream *stream, const struct svm_model *model)
+{
+	php_svm_text_writer writer;
+	const struct svm_parameter *param = &model->param;
+	int nr_class = model->nr_class, l = model->l, nr_dec = (int)((int64_t)nr_class * (nr_class - 1) / 2), i, k;
+
+	memset(&writer, 0, sizeof(writer));
+	writer.stream = stream;
+	writer.buf = emalloc(PHP_SVM_TEXT_BUFFER);
+
+	php_svm_text_put(&writer, "svm_type ");
+	php_svm_text_put(&writer, php_svm_svm_type_names[param->svm_type]);
+	php_svm_text_put(&writer, "\nkernel_type ");
+	php_svm_text_put(&writer, php_svm_kernel_type_names[param->kernel_type]);
+	php_svm_text_put(&writer, "\n");
+	if (param->kernel_type == POLY) {
+		php_svm_text_put_ints(&writer, "degree", &param->degree, 1);
+	}
+	if (param->kernel_type == POLY || param->kernel_type == RBF || param->kernel_type == SIGMOID) {
+		php_svm_text_put_doubles(&writer, "gamma", &param->gamma, 1);
+	}
+	if (param->kernel_type == POLY || param->kernel_type == SIGMOID) {
+		php_svm_text_put_doubles(&writer, "coef0", &param->coef0, 1);
+	}
+	php_svm_text_put_ints(&writer, "nr_class", &nr_class, 1);
+	php_svm_text_put_ints(&writer, "total_sv", &l, 1);
+	php_svm_text_put_doubles(&writer, "rho", model->rho, nr_dec);
+	if (model->label) {
+		php_svm_text_put_ints(&writer, "label", model->label, nr_class);
+	}
+	if (model->probA) {
+		php_svm_text_put_doubles(&writer, "probA", model->probA, nr_dec);
+	}
+	if (model->probB) {
+		php_svm_text_put_doubles(&writer, "probB", model->probB, nr_dec);
+	}
+	if (model->nSV) {
+		php_svm_text_put_ints(&writer, "nr_sv", model->nSV, nr_class);
+	}
+	php_svm_text_put(&writer, "SV\n");
+
+	for (i = 0; i < l; i++) {
+		const struct svm_node *p = model->SV[i];
+
+		for (k = 0; k < nr_class - 1; k++) {
+			php_svm_text_put_double(&writer, model->sv_coef[k][i], 17);
+			php_svm_text_put(&writer, " ");
+		}
+		if (param->kernel_type == PRECOMPUTED) {
+			php_svm_text_put(&writer, "0:");
+			php_svm_text_put_int(&writer, (int)p->value);
+			php_svm_text_put(&writer, " ");
+		} else {
+			for (; p->index != -1; p++) {
+				php_svm_text_put_int(&writer, p->index);
+				*php_svm_text_reserve(&writer, 1) = ':';
+				writer.len++;
+				php_svm_text_put_double(&writer, p->value, 8);
+				*php_svm_text_reserve(&writer, 1) = ' ';
+				writer.len++;
+			}
+		}
+		php_svm_text_put(&writer, "\n");
+	}
+
+	php_svm_text_flush(&writer);
+	efree(writer.buf);
+	return !writer.failed;
+}
+/* }}} */
+
+/* ---- END SAVE FUNCS ---- */
+
+/* ---- START LINE FUNCS ---- */
+
+/* {{{ int php_svm_find_name(const char **names, const char *name)
+Position of a name in a NULL terminated table, or -1.
+*/
+int php_svm_find_name(const char **names, const char *name)
+{
+	int i;
+
+	for (i = 0; names[i]; i++) {
+		if (!strcmp(names[i], name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+/* }}} */
+
+/* {{{ char *php_svm_get_line(php_stream *stream)
+Read one line, without its line ending. The caller frees it.
+*/
+char *php_svm_get_line(php_stream *stream)
+{
+	size_t len;
+	char *line = php_stream_get_line(stream, NULL, 0, &len);
+
+	if (line) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+	}
+	return line;
+}
+/* }}} */
+
+/* {{{ int php_svm_read_values(const char *p, double *values, int n)
+Parse n numbers following the keyword in a line. Returns the number read.
+*/
+int php_svm_read_values(const char *p, double *values, int n)
+{
+	int i;
+	const char *end;
+
+	for (i = 0; i < n; i++) {
+		values[i] = zend_strtod(p, &end);
+		if (end == p) {
+			break;
+		}
+		p = end;
+	}
+	return i;
+}
+/* }}} */
+
+/* {{{ zend_bool php_svm_write_line(php_stream *stream, const char *format, ...)
+Write formatted text. Returns 0 on a short write.
+*/
+zend_bool php_svm_write_line(php_stream *stream, const char *format, ...)
+{
+	va_list args;
+	char *line;
+	size_t len;
+	zend_bool ok;
+
+	va_start(args, format);
+	len = vspprintf(&line, 0, format, args);
+	va_end(args);
+	ok = (size_t)php_stream_write(stream, line, len) == len;
+	efree(line);
+	return ok;
+}
+/* }}} */
+
+/* {{{ zend_bool php_svm_write_values(php_stream *stream, const char *key, const double *values, int n)
+Write a line of n numbers, after the keyword if there is one. %H is locale independent, so files written under
+any locale read back the same. Returns 0 on a short write.
+*/
+zend_bool php_svm_write_values(php_stream *stream, const char *key, const double *values, int n)
+{
+	char num[32];
+	size_t len;
+	int i;
+
+	if (key && n > 0 && (size_t)php_stream_write(stream, key, strlen(key)) != strlen(key)) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		/* the separating space is skipped before the first number of a line without a keyword */
+		char *p = num + (i == 0 && !key);
+
+		len = slprintf(num, sizeof(num), " %.17H", values[i]) - (p - num);
+		if ((size_t)php_stream_write(stream, p, len) != len) {
+			return 0;
+		}
+	}
+	return php_stream_write(stream, "\n", 1) == 1;
+}
+/* }}} */
+
+/* ---- END LINE FUNCS ---- */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,39 @@
+--TEST--
+Predict a batch of rows and compare against single row predictions
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$batch = $model->predictBatch($rows);
+echo count($batch) == count($rows) ? "ok\n" : "count mismatch\n";
+
+$mismatch = 0;
+foreach ($rows as $i => $row) {
+	if ($model->predict($row) !== $batch[$i]) {
+		$mismatch++;
+	}
+}
+echo $mismatch == 0 ? "ok\n" : "$mismatch mismatches\n";
+
+var_dump($model->predictBatch(array()));
+
+try {
+	$model->predictBatch(array(1, 2));
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+array(0) {
+}
+got exception
@@ -0,0 +1,82 @@
+--TEST--
+Predict with a linear model through the collapsed weight vectors
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale', $labels);
+
+$svm = new svm();
+$svm->setOptions(array(
+	SVM::OPT_KERNEL_TYPE => SVM::KERNEL_LINEAR,
+	SVM::OPT_PROBABILITY => true
+));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$correct = 0;
+foreach ($rows as $i => $row) {
+	if ($model->predict($row) == $labels[$i]) {
+		$correct++;
+	}
+}
+echo $correct / count($rows) > 0.8 ? "ok\n" : "accuracy too low: $correct\n";
+
+$file = dirname(__FILE__) . '/linear.model';
+$model->save($file);
+$loaded = new SVMModel($file);
+unlink($file);
+/* SV values are saved with 8 significant digits, so allow for the odd row right on the boundary */
+$same = count(array_intersect_assoc($loaded->predictBatch($rows), $model->predictBatch($rows)));
+echo $same >= 0.99 * count($rows) ? "ok\n" : "loaded model differs on " . (count($rows) - $same) . " rows\n";
+
+/* Against w.x - rho worked out here from a hand-written three class model, pair by pair as libsvm sums it */
+$text = "svm_type c_svc\nkernel_type linear\nnr_class 3\ntotal_sv 5\nrho 0.25 -0.5 1.125\nlabel 1 2 3\nnr_sv 2 1 2\nSV\n" .
+	"0.5 -0.75 1:0.5 3:-1.5\n" .
+	"1.25 0.375 2:2 4:0.25\n" .
+	"-1 0.625 1:-0.5 2:1 3:0.75\n" .
+	"-0.5 -1.5 3:2.5 4:-1\n" .
+	"-0.25 1.75 1:1.5 4:0.5\n";
+$sv = array(array(1 => 0.5, 3 => -1.5), array(2 => 2, 4 => 0.25), array(1 => -0.5, 2 => 1, 3 => 0.75), array(3 => 2.5, 4 => -1), array(1 => 1.5, 4 => 0.5));
+$coef = array(array(0.5, 1.25, -1, -0.5, -0.25), array(-0.75, 0.375, 0.625, -1.5, 1.75));
+$rho = array(0.25, -0.5, 1.125);
+$start = array(0, 2, 3, 5);
+$hand = new SVMModel();
+$hand->loadFromString($text);
+$tests = array(array(1 => 1, 2 => -0.5, 3 => 0.25), array(2 => 1.5, 4 => -2), array(1 => -1, 3 => 1, 4 => 0.5, 5 => 3));
+$same = true;
+foreach ($tests as $x) {
+	$hand->predictValues($x, $values);
+	$p = 0;
+	for ($a = 0; $a < 3; $a++) {
+		for ($b = $a + 1; $b < 3; $b++) {
+			$expected = -$rho[$p];
+			foreach (array(array($a, $b - 1), array($b, $a)) as $side) {
+				for ($k = $start[$side[0]]; $k < $start[$side[0] + 1]; $k++) {
+					foreach ($sv[$k] as $idx => $value) {
+						if (isset($x[$idx])) {
+							$expected += $coef[$side[1]][$k] * $value * $x[$idx];
+						}
+					}
+				}
+			}
+			$same = $same && abs($values[$p] - $expected) < 1e-9;
+			$p++;
+		}
+	}
+}
+echo $same ? "ok\n" : "decision values differ from w.x - rho\n";
+
+$probs = array();
+$class = $model->predict_probability($rows[0], $probs);
+echo count($probs), "\n";
+echo abs(array_sum($probs) - 1) < 1e-6 ? "ok\n" : "probabilities do not sum to 1\n";
+?>
+--EXPECT--
+ok
+ok
+ok
+2
+ok
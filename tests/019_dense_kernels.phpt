@@ -0,0 +1,45 @@
+--TEST--
+Predict with the dense support vector matrix for each kernel
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale', $labels);
+
+$kernels = array(
+	'poly' => SVM::KERNEL_POLY,
+	'rbf' => SVM::KERNEL_RBF,
+	'sigmoid' => SVM::KERNEL_SIGMOID,
+);
+foreach ($kernels as $name => $kernel) {
+	$svm = new svm();
+	$svm->setOptions(array(SVM::OPT_KERNEL_TYPE => $kernel));
+	$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+	$batch = $model->predictBatch($rows);
+	$correct = 0;
+	$mismatch = 0;
+	foreach ($rows as $i => $row) {
+		$label = $model->predict($row);
+		if ($label !== $batch[$i]) {
+			$mismatch++;
+		}
+		if ($label == $labels[$i]) {
+			$correct++;
+		}
+	}
+	echo $name, ": ", $mismatch == 0 && $correct / count($rows) > 0.7 ? "ok" : "failed ($mismatch, $correct)", "\n";
+}
+
+/* Features the model has never seen still count towards the RBF distance */
+$result = $model->predict(array(1 => 1, 500 => 0.5));
+echo in_array($result, array(-1.0, 1.0), true) ? "ok\n" : "bad label $result\n";
+?>
+--EXPECT--
+poly: ok
+rbf: ok
+sigmoid: ok
+ok
@@ -0,0 +1,50 @@
+--TEST--
+Predict with a sparse RBF model using the cached support vector norms
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+/* Spread the features out so that the model is too sparse for the dense matrix */
+mt_srand(42);
+$data = array();
+for ($i = 0; $i < 200; $i++) {
+	$label = $i % 2 ? 1 : -1;
+	$row = array($label, ($label > 0 ? 1 : 2) => 1);
+	for ($j = 0; $j < 10; $j++) {
+		$idx = mt_rand(1, 500) * 20 + ($label > 0 ? 1 : 2);
+		$row[$idx] = mt_rand(1, 100) / 100;
+	}
+	ksort($row);
+	$data[] = $row;
+}
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_GAMMA => 0.5));
+$model = $svm->train($data);
+
+$rows = array();
+$correct = 0;
+foreach ($data as $row) {
+	$label = $row[0];
+	unset($row[0]);
+	$rows[] = $row;
+	if ($model->predict($row) == $label) {
+		$correct++;
+	}
+}
+echo $correct > 180 ? "ok\n" : "accuracy too low: $correct\n";
+
+$batch = $model->predictBatch($rows);
+$mismatch = 0;
+foreach ($rows as $i => $row) {
+	if ($model->predict($row) !== $batch[$i]) {
+		$mismatch++;
+	}
+}
+echo $mismatch == 0 ? "ok\n" : "$mismatch mismatches\n";
+?>
+--EXPECT--
+ok
+ok
@@ -0,0 +1,61 @@
+--TEST--
+Repeated predictions reuse the model's buffers without leaking state between rows
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$first = array();
+foreach ($rows as $i => $row) {
+	$first[$i] = $model->predict($row);
+}
+
+/* A row much wider than the model grows the input buffer */
+$wide = $rows[0];
+for ($i = 100; $i < 2100; $i++) {
+	$wide[$i] = 0.0;
+}
+echo $model->predict($wide) === $first[0] ? "ok\n" : "wide row mismatch\n";
+
+$mismatch = 0;
+foreach ($rows as $i => $row) {
+	if ($model->predict($row) !== $first[$i]) {
+		$mismatch++;
+	}
+}
+echo $mismatch == 0 ? "ok\n" : "$mismatch mismatches\n";
+
+$label = $model->predict_probability($rows[1], $probs);
+$again = $model->predict_probability($rows[1], $probs2);
+echo ($label === $again && $probs === $probs2) ? "ok\n" : "probabilities differ\n";
+$labels = $model->getLabels();
+sort($labels);
+$keys = array_keys($probs);
+sort($keys);
+echo $keys == $labels ? "ok\n" : "wrong keys\n";
+
+/* Regression models have no labels, so no probabilities either */
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_TYPE => SVM::EPSILON_SVR));
+$model = $svm->train(dirname(__FILE__) . '/abalone.scale');
+$row = array(1 => 1.0, 2 => 0.5, 3 => 0.4, 4 => 0.1);
+$value = $model->predict_probability($row, $probs);
+echo $value === $model->predict($row) ? "ok\n" : "regression mismatch\n";
+var_dump($probs);
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+array(0) {
+}
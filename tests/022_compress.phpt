@@ -0,0 +1,67 @@
+--TEST--
+Compress a model into fewer SVs
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$small = $model->compress(20, $rows, $report);
+echo $report['svs'] == 20 ? "ok\n" : "kept {$report['svs']} SVs\n";
+echo $report['original_svs'] > 20 ? "ok\n" : "original model too small\n";
+echo $report['max_drift'] >= $report['mean_drift'] ? "ok\n" : "bad drift\n";
+echo $report['label_agreement'] >= 0.9 ? "ok\n" : "agreement {$report['label_agreement']}\n";
+
+/* The report matches what the models actually predict */
+$same = 0;
+foreach ($small->predictBatch($rows) as $i => $label) {
+	if ($label == $model->predict($rows[$i])) {
+		$same++;
+	}
+}
+echo abs($same / count($rows) - $report['label_agreement']) < 1e-9 ? "ok\n" : "report mismatch\n";
+
+/* Compressed models save and load like any other */
+$file = tempnam(sys_get_temp_dir(), 'svm');
+$small->save($file);
+$loaded = new SVMModel($file);
+unlink($file);
+$same = 0;
+foreach ($rows as $row) {
+	if ($loaded->predict($row) == $small->predict($row)) {
+		$same++;
+	}
+}
+echo $same >= 0.99 * count($rows) ? "ok\n" : "$same of " . count($rows) . " after reload\n";
+
+/* Error bound, measured on the SVs */
+$bounded = $model->compress(0.5, null, $report);
+echo ($report['max_drift'] <= 0.5 || $report['svs'] == (int)($report['original_svs'] / 2)) ? "ok\n" : "bound not met\n";
+
+try {
+	$model->compress(0);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+try {
+	$model->compress("ten");
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
+got exception
@@ -0,0 +1,89 @@
+--TEST--
+Approximate an RBF model with random Fourier features
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$fast = $model->toRandomFeatures(512, 3, $rows, $report);
+echo $report['dimension'] == 512 ? "ok\n" : "dimension {$report['dimension']}\n";
+echo $report['max_drift'] >= $report['mean_drift'] ? "ok\n" : "bad drift\n";
+echo $report['label_agreement'] >= 0.9 ? "ok\n" : "agreement {$report['label_agreement']}\n";
+echo $fast->getLabels() == $model->getLabels() ? "ok\n" : "labels differ\n";
+echo $fast->checkProbabilityModel() ? "ok\n" : "lost probability model\n";
+
+/* The report matches what the models actually predict */
+$same = 0;
+foreach ($fast->predictBatch($rows) as $i => $label) {
+	if ($label == $model->predict($rows[$i])) {
+		$same++;
+	}
+}
+echo abs($same / count($rows) - $report['label_agreement']) < 1e-9 ? "ok\n" : "report mismatch\n";
+
+/* The same seed gives the same features */
+$again = $model->toRandomFeatures(512, 3);
+$same = 0;
+foreach ($rows as $row) {
+	if ($again->predict($row) == $fast->predict($row)) {
+		$same++;
+	}
+}
+echo $same == count($rows) ? "ok\n" : "seed not reproducible\n";
+
+/* Random feature models save and load */
+$file = tempnam(sys_get_temp_dir(), 'svm');
+$fast->save($file);
+$loaded = new SVMModel($file);
+unlink($file);
+$same = 0;
+foreach ($rows as $row) {
+	if ($loaded->predict($row) == $fast->predict($row)) {
+		$same++;
+	}
+}
+echo $same == count($rows) ? "ok\n" : "$same of " . count($rows) . " after reload\n";
+
+$loaded->predict_probability($rows[0], $probabilities);
+echo abs(array_sum($probabilities) - 1) < 1e-6 ? "ok\n" : "bad probabilities\n";
+
+try {
+	$model->toRandomFeatures(0);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+try {
+	$fast->compress(10);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+
+$svm->setOptions(array(SVM::OPT_KERNEL_TYPE => SVM::KERNEL_LINEAR, SVM::OPT_PROBABILITY => false));
+$linear = $svm->train(dirname(__FILE__) . '/australian.scale');
+try {
+	$linear->toRandomFeatures();
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
+got exception
+got exception
@@ -0,0 +1,67 @@
+--TEST--
+Train on a low-rank approximation of the kernel
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale', $labels);
+
+$svm = new svm();
+$exact = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$svm->setOptions(array(SVM::OPT_APPROX_RANK => 50));
+$options = $svm->getOptions();
+echo $options[SVM::OPT_APPROX_RANK] == 50 ? "ok\n" : "option not kept\n";
+
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+echo $model->getLabels() == $exact->getLabels() ? "ok\n" : "labels differ\n";
+
+$same = 0;
+$right = 0;
+foreach ($model->predictBatch($rows) as $i => $label) {
+	if ($label == $exact->predict($rows[$i])) {
+		$same++;
+	}
+	if ($label == $labels[$i]) {
+		$right++;
+	}
+}
+echo $same >= 0.9 * count($rows) ? "ok\n" : "$same of " . count($rows) . " agree with the full model\n";
+echo $right >= 0.8 * count($rows) ? "ok\n" : "$right of " . count($rows) . " right\n";
+
+/* The landmarks are the SVs, so the model saves and loads like any other */
+$file = tempnam(sys_get_temp_dir(), 'svm');
+$model->save($file);
+$loaded = new SVMModel($file);
+unlink($file);
+$same = 0;
+foreach ($rows as $row) {
+	if ($loaded->predict($row) == $model->predict($row)) {
+		$same++;
+	}
+}
+echo $same == count($rows) ? "ok\n" : "$same of " . count($rows) . " after reload\n";
+
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+try {
+	$svm->train(dirname(__FILE__) . '/australian.scale');
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+try {
+	$svm->setOptions(array(SVM::OPT_APPROX_RANK => -1));
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+got exception
+got exception
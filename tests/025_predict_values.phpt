@@ -0,0 +1,63 @@
+--TEST--
+Expose the decision values of a prediction
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+$data = array(
+	array(1, 1 => 0.9, 2 => 0.1),
+	array(1, 1 => 0.8, 2 => 0.2),
+	array(2, 1 => 0.1, 2 => 0.9),
+	array(2, 1 => 0.2, 2 => 0.8),
+	array(3, 1 => 0.5, 2 => 0.5, 3 => 1.0),
+	array(3, 1 => 0.4, 2 => 0.6, 3 => 0.9),
+);
+$rows = array(
+	array(1 => 0.85, 2 => 0.15),
+	array(1 => 0.15, 2 => 0.85),
+	array(1 => 0.45, 2 => 0.55, 3 => 0.95),
+);
+
+$svm = new SVM();
+$model = $svm->train($data);
+
+$label = $model->predictValues($rows[0], $values);
+echo $label == $model->predict($rows[0]) ? "ok\n" : "label differs\n";
+echo count($values) . "\n";
+
+/* The values decide the vote: the first class of a pair wins when its value is positive */
+$classes = $model->getLabels();
+$votes = array_fill(0, count($classes), 0);
+$p = 0;
+for ($i = 0; $i < count($classes); $i++) {
+	for ($j = $i + 1; $j < count($classes); $j++) {
+		$votes[$values[$p++] > 0 ? $i : $j]++;
+	}
+}
+echo $classes[array_search(max($votes), $votes)] == $label ? "ok\n" : "values don't match the label\n";
+
+$labels = $model->predictValuesBatch($rows, $all);
+echo $labels == $model->predictBatch($rows) ? "ok\n" : "batch labels differ\n";
+$same = true;
+foreach ($rows as $i => $row) {
+	$model->predictValues($row, $values);
+	foreach ($values as $p => $value) {
+		$same = $same && abs($value - $all[$i][$p]) < 1e-12;
+	}
+}
+echo $same ? "ok\n" : "batch values differ\n";
+
+$svm->setOptions(array(SVM::OPT_TYPE => SVM::EPSILON_SVR));
+$model = $svm->train($data);
+$model->predictValues($rows[0], $values);
+echo count($values) . "\n";
+?>
+--EXPECT--
+ok
+3
+ok
+ok
+ok
+1
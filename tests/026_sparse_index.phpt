@@ -0,0 +1,55 @@
+--TEST--
+Predict sparse models through the postings index
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--INI--
+svm.sparse_index=auto
+--FILE--
+<?php
+mt_srand(42);
+function sparse_row($class) {
+	$row = array();
+	for ($k = 0; $k < 8; $k++) {
+		$row[mt_rand(1, 5000)] = 0.5;
+		$row[$class * 10000 + mt_rand(1, 100)] = 1.0;
+	}
+	ksort($row);
+	return $row;
+}
+$data = array();
+$rows = array();
+for ($i = 0; $i < 120; $i++) {
+	$class = $i % 3;
+	$data[] = array($class) + sparse_row($class);
+	$rows[] = sparse_row($class);
+}
+
+foreach (array(SVM::KERNEL_RBF, SVM::KERNEL_POLY, SVM::KERNEL_SIGMOID) as $kernel) {
+	$svm = new SVM();
+	$svm->setOptions(array(SVM::OPT_KERNEL_TYPE => $kernel, SVM::OPT_GAMMA => 0.5));
+
+	ini_set('svm.sparse_index', '0');
+	$plain = $svm->train($data);
+	ini_set('svm.sparse_index', '1');
+	$indexed = $svm->train($data);
+
+	$same = true;
+	$indexed->predictValuesBatch($rows, $all);
+	foreach ($rows as $i => $row) {
+		$label = $plain->predictValues($row, $values);
+		$same = $same && $label == $indexed->predict($row);
+		foreach ($values as $p => $value) {
+			$same = $same && abs($value - $all[$i][$p]) < 1e-9;
+		}
+	}
+	echo $same ? "ok\n" : "kernel $kernel differs\n";
+}
+echo ini_get('svm.sparse_index'), "\n";
+?>
+--EXPECT--
+ok
+ok
+ok
+1
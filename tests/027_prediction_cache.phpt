@@ -0,0 +1,79 @@
+--TEST--
+Cache prediction results per model
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+$data = array(
+	array(-1, 1 => 0.43, 3 => 0.12, 9284 => 0.2),
+	array(1, 1 => 0.22, 5 => 0.01, 94 => 0.11),
+	array(-1, 1 => 0.41, 3 => 0.15, 9284 => 0.25),
+	array(1, 1 => 0.25, 5 => 0.02, 94 => 0.13),
+);
+$rows = array(
+	array(1 => 0.43, 3 => 0.12, 9284 => 0.2),
+	array(1 => 0.22, 5 => 0.01, 94 => 0.11),
+	array(1 => 0.30, 5 => 0.05),
+);
+
+$svm = new SVM();
+$model = $svm->train($data);
+$expected = array();
+foreach ($rows as $row) {
+	$expected[] = $model->predictValues($row, $values);
+}
+
+var_dump($model->setCache(2));
+$same = true;
+foreach (array(0, 1, 0, 1, 2, 0) as $i) {
+	$same = $same && $model->predictValues($rows[$i], $values) == $expected[$i];
+}
+var_dump($same);
+$stats = $model->getCacheStats();
+echo $stats['entries'], " ", $stats['hits'], " ", $stats['misses'], "\n";
+
+// The cached decision values match a fresh prediction
+$model->predictValues($rows[0], $cached);
+$model->setCache(0);
+$model->predictValues($rows[0], $fresh);
+var_dump($cached === $fresh);
+
+// Reloading drops cached results but keeps the budget
+$model->setCache(8);
+$model->predict($rows[0]);
+$model->save(dirname(__FILE__) . '/027.model');
+$model->load(dirname(__FILE__) . '/027.model');
+$stats = $model->getCacheStats();
+echo $stats['entries'], " ", $stats['max_entries'], "\n";
+$model->predict($rows[0]);
+$model->predict($rows[0]);
+$stats = $model->getCacheStats();
+echo $stats['entries'], " ", $stats['hits'], "\n";
+
+// A memory limit too small for any entry caches nothing
+$model->setCache(8, 16);
+$model->predict($rows[1]);
+$stats = $model->getCacheStats();
+echo $stats['entries'], "\n";
+
+try {
+	$model->setCache(-1);
+} catch (SVMException $e) {
+	echo "caught\n";
+}
+?>
+--CLEAN--
+<?php
+@unlink(dirname(__FILE__) . '/027.model');
+?>
+--EXPECT--
+bool(true)
+bool(true)
+2 2 4
+bool(true)
+0 8
+1 1
+0
+caught
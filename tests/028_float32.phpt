@@ -0,0 +1,68 @@
+--TEST--
+Store the SVs of a model as floats
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+foreach (array(false, true) as $float_coef) {
+	$small = $model->toFloat32($float_coef, $rows, $report);
+	echo $report['memory_after'] * 2 <= $report['memory_before'] ? "ok\n" : "memory {$report['memory_before']} -> {$report['memory_after']}\n";
+	echo $report['max_drift'] < 1e-4 ? "ok\n" : "drift {$report['max_drift']}\n";
+	echo $report['label_agreement'] > 0.99 ? "ok\n" : "agreement {$report['label_agreement']}\n";
+
+	/* The report matches what the models actually predict */
+	$max = 0;
+	foreach ($rows as $i => $row) {
+		$model->predictValues($row, $a);
+		$small->predictValues($row, $b);
+		$max = max($max, abs($a[0] - $b[0]));
+	}
+	echo abs($max - $report['max_drift']) < 1e-12 ? "ok\n" : "report mismatch\n";
+}
+echo $small->getLabels() == $model->getLabels() ? "ok\n" : "labels differ\n";
+echo $small->checkProbabilityModel() ? "ok\n" : "lost probability model\n";
+$small->predict_probability($rows[0], $probabilities);
+echo abs(array_sum($probabilities) - 1) < 1e-6 ? "ok\n" : "bad probabilities\n";
+
+/* Float models save and load as floats */
+$file = tempnam(sys_get_temp_dir(), 'svm');
+$small->save($file);
+$loaded = new SVMModel($file);
+unlink($file);
+echo $loaded->predictValuesBatch($rows, $a) == $small->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "differs after reload\n";
+
+try {
+	$small->toFloat32();
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+try {
+	$small->compress(10);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
+got exception
@@ -0,0 +1,60 @@
+--TEST--
+Store the SVs of a model as int8
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$file = dirname(__FILE__) . '/australian.scale';
+$rows = svm_test_rows($file, $labels);
+
+$svm = new svm();
+$model = $svm->train($file);
+
+$small = $model->toInt8(true, $file, $report);
+echo $report['memory_after'] * 8 <= $report['memory_before'] ? "ok\n" : "memory {$report['memory_before']} -> {$report['memory_after']}\n";
+echo $report['max_drift'] < 0.05 ? "ok\n" : "drift {$report['max_drift']}\n";
+echo $report['label_agreement'] > 0.97 ? "ok\n" : "agreement {$report['label_agreement']}\n";
+
+/* The accuracies are those of the models on the held out file */
+$correct = 0;
+foreach ($small->predictBatch($rows) as $i => $label) {
+	$correct += $label == $labels[$i];
+}
+echo abs($correct / count($rows) - $report['accuracy_after']) < 1e-12 ? "ok\n" : "accuracy mismatch\n";
+echo abs($report['accuracy_after'] - $report['accuracy_before'] - $report['accuracy_delta']) < 1e-12 ? "ok\n" : "delta mismatch\n";
+echo abs($report['accuracy_delta']) < 0.03 ? "ok\n" : "accuracy delta {$report['accuracy_delta']}\n";
+
+/* Labelled arrays do as well as files */
+$data = array();
+foreach ($rows as $i => $row) {
+	$data[] = array($labels[$i]) + $row;
+}
+$model->toInt8(true, $data, $arrayReport);
+echo $arrayReport == $report ? "ok\n" : "array report differs\n";
+
+/* int8 models save and load as int8 */
+$saved = tempnam(sys_get_temp_dir(), 'svm');
+$small->save($saved);
+$loaded = new SVMModel($saved);
+unlink($saved);
+echo $loaded->predictValuesBatch($rows, $a) == $small->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "differs after reload\n";
+
+try {
+	$small->toFloat32();
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
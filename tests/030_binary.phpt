@@ -0,0 +1,51 @@
+--TEST--
+Save a model in the binary format and map it back
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$saved = tempnam(sys_get_temp_dir(), 'svm');
+$model->saveBinary($saved);
+$loaded = new SVMModel($saved);
+echo $loaded->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "values differ\n";
+echo $loaded->predict_probability($rows[0], $pa) === $model->predict_probability($rows[0], $pb) && $pa === $pb ? "ok\n" : "probabilities differ\n";
+echo $loaded->getLabels() === $model->getLabels() && $loaded->getSvmType() === $model->getSvmType() ? "ok\n" : "info differs\n";
+
+/* Mapped models save again in either format */
+$text = tempnam(sys_get_temp_dir(), 'svm');
+$loaded->save($text);
+$again = new SVMModel($text);
+echo $again->predictBatch($rows) === $model->predictBatch($rows) ? "ok\n" : "text save differs\n";
+unlink($text);
+
+/* Truncated files are refused */
+file_put_contents($saved, substr(file_get_contents($saved), 0, 200));
+try {
+	new SVMModel($saved);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+unlink($saved);
+
+try {
+	$model->toFloat32()->saveBinary($saved);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+got exception
+got exception
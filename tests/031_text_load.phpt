@@ -0,0 +1,45 @@
+--TEST--
+Load text models without libsvm's loader
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$saved = tempnam(sys_get_temp_dir(), 'svm');
+$model->save($saved);
+
+/* A locale with a decimal comma must not change how numbers are read */
+setlocale(LC_ALL, 'de_DE.UTF-8', 'de_DE', 'fr_FR.UTF-8', 'fr_FR');
+$loaded = new SVMModel($saved);
+setlocale(LC_ALL, 'C');
+echo $loaded->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "values differ\n";
+echo $loaded->predict_probability($rows[0], $pa) === $model->predict_probability($rows[0], $pb) && $pa === $pb ? "ok\n" : "probabilities differ\n";
+
+/* Windows line endings */
+file_put_contents($saved, str_replace("\n", "\r\n", file_get_contents($saved)));
+$loaded = new SVMModel($saved);
+echo $loaded->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "crlf differs\n";
+
+/* Missing SVs are an error rather than a shorter model */
+$lines = file($saved);
+file_put_contents($saved, implode('', array_slice($lines, 0, count($lines) - 3)));
+try {
+	new SVMModel($saved);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+unlink($saved);
+?>
+--EXPECT--
+ok
+ok
+ok
+got exception
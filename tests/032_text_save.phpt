@@ -0,0 +1,38 @@
+--TEST--
+Save text models without libsvm's writer
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+/* A locale with a decimal comma must not change how numbers are written */
+$saved = tempnam(sys_get_temp_dir(), 'svm');
+setlocale(LC_ALL, 'de_DE.UTF-8', 'de_DE', 'fr_FR.UTF-8', 'fr_FR');
+$model->save($saved);
+setlocale(LC_ALL, 'C');
+echo strpos(file_get_contents($saved), ',') === false ? "ok\n" : "decimal comma\n";
+
+$loaded = new SVMModel($saved);
+echo $loaded->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "values differ\n";
+echo $loaded->predict_probability($rows[0], $pa) === $model->predict_probability($rows[0], $pb) && $pa === $pb ? "ok\n" : "probabilities differ\n";
+
+/* Coefficients read back exactly, so saving again gives the same file */
+$again = tempnam(sys_get_temp_dir(), 'svm');
+$loaded->save($again);
+echo file_get_contents($again) === file_get_contents($saved) ? "ok\n" : "files differ\n";
+unlink($saved);
+unlink($again);
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
@@ -0,0 +1,84 @@
+--TEST--
+Load and save models through strings and streams
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+$expected = $model->predictValuesBatch($rows, $values);
+
+/* Strings, in the text and the binary format */
+$text = $model->saveToString();
+$saved = tempnam(sys_get_temp_dir(), 'svm');
+$model->save($saved);
+echo $text === file_get_contents($saved) ? "ok\n" : "text differs from save\n";
+
+foreach (array($text, $model->saveToString(true)) as $data) {
+	$loaded = new SVMModel();
+	$loaded->loadFromString($data);
+	echo $loaded->predictValuesBatch($rows, $v) === $expected && $v === $values ? "ok\n" : "string differs\n";
+}
+
+/* Streams, read from where they are */
+$stream = fopen('php://memory', 'w+');
+fwrite($stream, "header\n");
+$model->saveBinary($stream);
+rewind($stream);
+fgets($stream);
+$loaded = new SVMModel($stream);
+fclose($stream);
+echo $loaded->predictValuesBatch($rows, $v) === $expected && $v === $values ? "ok\n" : "stream differs\n";
+
+/* Other model formats go through strings as well */
+$small = $model->toFloat32();
+$loaded = new SVMModel();
+$loaded->loadFromString($small->saveToString());
+echo $loaded->predictValuesBatch($rows, $a) === $small->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "float32 differs\n";
+
+if (extension_loaded('zlib')) {
+	$stream = fopen('compress.zlib://' . $saved, 'wb');
+	$model->save($stream);
+	fclose($stream);
+	$stream = fopen('compress.zlib://' . $saved, 'rb');
+	$loaded->load($stream);
+	fclose($stream);
+	echo $loaded->predictValuesBatch($rows, $v) === $expected && $v === $values ? "ok\n" : "zlib differs\n";
+} else {
+	echo "ok\n";
+}
+unlink($saved);
+
+/* A failed load leaves the model that was there */
+$before = $loaded->predictValuesBatch($rows, $b);
+foreach (array('not a model', substr($model->saveToString(true), 0, 100)) as $data) {
+	try {
+		$loaded->loadFromString($data);
+	} catch (SvmException $e) {
+		echo "got exception\n";
+	}
+	echo $loaded->predictValuesBatch($rows, $v) === $before && $v === $b ? "ok\n" : "model lost\n";
+}
+try {
+	$small->saveToString(true);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
+ok
+got exception
+ok
+got exception
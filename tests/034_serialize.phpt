@@ -0,0 +1,43 @@
+--TEST--
+Serialize and unserialize models
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true));
+$model = $svm->train(dirname(__FILE__) . '/australian.scale');
+
+$copy = unserialize(serialize($model));
+echo $copy instanceof SVMModel ? "ok\n" : "not a model\n";
+echo $copy->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "values differ\n";
+echo $copy->predict_probability($rows[0], $pa) === $model->predict_probability($rows[0], $pb) && $pa === $pb ? "ok\n" : "probabilities differ\n";
+echo $copy->getLabels() === $model->getLabels() && $copy->getSvmType() === $model->getSvmType() ? "ok\n" : "info differs\n";
+
+/* Models with other storage keep it */
+$small = $model->toFloat32(true);
+$copy = unserialize(serialize($small));
+echo $copy->predictValuesBatch($rows, $a) === $small->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "float32 differs\n";
+
+/* Inside other values, and empty models */
+$copy = unserialize(serialize(array('model' => $model, 'empty' => new SVMModel())));
+echo $copy['model']->predictBatch($rows) === $model->predictBatch($rows) ? "ok\n" : "nested differs\n";
+try {
+	$copy['empty']->predict($rows[0]);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
@@ -0,0 +1,73 @@
+--TEST--
+Keep models across requests with fromCache
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+function stats() {
+	ob_start();
+	phpinfo(INFO_MODULES);
+	preg_match('/model cache.*?hits => (\d+).*?misses => (\d+).*?reloads => (\d+)/s', ob_get_clean(), $m);
+	return array((int)$m[1], (int)$m[2], (int)$m[3]);
+}
+
+$data = dirname(__FILE__) . '/australian.scale';
+$rows = svm_test_rows($data);
+
+$svm = new svm();
+$model = $svm->train($data);
+/* without symlinks, which getcwd() would resolve */
+$file = realpath(tempnam(sys_get_temp_dir(), 'svm'));
+$model->save($file);
+
+$first = SVMModel::fromCache($file);
+$second = SVMModel::fromCache($file);
+echo $first->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "values differ\n";
+echo $second->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "cached values differ\n";
+echo stats() === array(1, 1, 0) ? "ok\n" : "stats " . implode(' ', stats()) . "\n";
+
+/* Relative names are the same model as the full path */
+$cwd = getcwd();
+chdir(dirname($file));
+$relative = SVMModel::fromCache(basename($file));
+chdir($cwd);
+echo $relative->predictBatch($rows) === $model->predictBatch($rows) ? "ok\n" : "relative differs\n";
+echo stats() === array(2, 1, 0) ? "ok\n" : "stats " . implode(' ', stats()) . "\n";
+
+/* A changed file is loaded again, objects from before keep the old model */
+$svm->setOptions(array(SVM::OPT_C => 10));
+$other = $svm->train($data);
+$other->save($file);
+touch($file, time() + 10);
+$third = SVMModel::fromCache($file);
+echo $third->predictValuesBatch($rows, $a) === $other->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "not reloaded\n";
+echo $first->predictValuesBatch($rows, $a) === $model->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "old object changed\n";
+echo stats() === array(2, 1, 1) ? "ok\n" : "stats " . implode(' ', stats()) . "\n";
+
+/* Without a budget nothing is kept, but models still load */
+ini_set('svm.model_cache_size', 0);
+$fourth = SVMModel::fromCache($file);
+echo $fourth->predictBatch($rows) === $other->predictBatch($rows) ? "ok\n" : "uncached differs\n";
+ini_restore('svm.model_cache_size');
+
+unlink($file);
+try {
+	SVMModel::fromCache($file);
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
@@ -0,0 +1,48 @@
+--TEST--
+Share models preloaded at startup with preloaded
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+/* preload.bin was saved by a 64 bit little endian machine */
+if (PHP_INT_SIZE != 8 || pack('L', 1) !== pack('V', 1)) die('skip binary model from another platform');
+?>
+--INI--
+svm.preload=small={PWD}/preload.bin
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$rows = svm_test_rows(dirname(__FILE__) . '/australian.scale');
+
+$loaded = new SVMModel(dirname(__FILE__) . '/preload.bin');
+$first = SVMModel::preloaded('small');
+$second = SVMModel::preloaded('small');
+echo $first->predictValuesBatch($rows, $a) === $loaded->predictValuesBatch($rows, $b) && $a === $b ? "ok\n" : "values differ\n";
+echo $first->predict($rows[0]) === $loaded->predict($rows[0]) ? "ok\n" : "predict differs\n";
+
+/* Objects only share the model, so dropping or reloading one leaves the others alone */
+unset($first);
+echo $second->predictBatch($rows) === $loaded->predictBatch($rows) ? "ok\n" : "shared model released\n";
+$second->loadFromString($loaded->saveToString());
+$third = SVMModel::preloaded('small');
+echo $third->predictBatch($rows) === $loaded->predictBatch($rows) ? "ok\n" : "shared model changed\n";
+$copy = unserialize(serialize($third));
+echo $copy->predictBatch($rows) === $loaded->predictBatch($rows) ? "ok\n" : "copy differs\n";
+
+ob_start();
+phpinfo(INFO_MODULES);
+echo preg_match('/preloaded models => small/', ob_get_clean()) ? "ok\n" : "not in phpinfo\n";
+
+try {
+	SVMModel::preloaded('missing');
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
@@ -0,0 +1,70 @@
+--TEST--
+Train on several threads
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+ob_start();
+phpinfo(INFO_MODULES);
+if (!preg_match('/training threads => supported/', ob_get_clean())) die('skip libsvm without training threads');
+?>
+--INI--
+svm.threads=1
+--FILE--
+<?php
+require dirname(__FILE__) . '/rows.inc';
+$file = dirname(__FILE__) . '/abalone.scale';
+
+/* Two classes over all rows, so the kernel columns are long enough to split */
+$data = array();
+foreach (svm_test_rows($file, $labels) as $i => $row) {
+	$data[] = array($labels[$i] > 9 ? 1 : -1) + $row;
+}
+
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_CACHE_SIZE => 1));
+$serial = $svm->train($data)->saveToString(true);
+
+$svm->setOptions(array(SVM::OPT_THREADS => 4));
+$options = $svm->getOptions();
+echo $options[SVM::OPT_THREADS] == 4 ? "ok\n" : "option not kept\n";
+echo $svm->train($data)->saveToString(true) === $serial ? "ok\n" : "threaded model differs\n";
+
+/* 0 follows svm.threads */
+$svm->setOptions(array(SVM::OPT_THREADS => 0));
+ini_set('svm.threads', 'auto');
+echo $svm->train($data)->saveToString(true) === $serial ? "ok\n" : "auto model differs\n";
+
+$svm->setOptions(array(SVM::OPT_TYPE => SVM::EPSILON_SVR, SVM::OPT_THREADS => 3));
+$regression = $svm->train($file)->saveToString(true);
+$svm->setOptions(array(SVM::OPT_THREADS => 1));
+echo $svm->train($file)->saveToString(true) === $regression ? "ok\n" : "threaded regression differs\n";
+
+/* Many classes train their pairs side by side */
+$svm = new svm();
+$svm->setOptions(array(SVM::OPT_THREADS => 1));
+$serial = $svm->train($file)->saveToString(true);
+$svm->setOptions(array(SVM::OPT_THREADS => 4));
+echo $svm->train($file)->saveToString(true) === $serial ? "ok\n" : "pairs differ\n";
+
+/* Folds are shuffled the same way every time, and trained side by side */
+$svm->setOptions(array(SVM::OPT_THREADS => 1, SVM::OPT_PROBABILITY => true));
+$accuracy = $svm->crossvalidate($data, 5);
+echo $svm->crossvalidate($data, 5) === $accuracy ? "ok\n" : "folds differ between runs\n";
+$svm->setOptions(array(SVM::OPT_THREADS => 5));
+echo $svm->crossvalidate($data, 5) === $accuracy ? "ok\n" : "threaded folds differ\n";
+
+try {
+	$svm->setOptions(array(SVM::OPT_THREADS => -1));
+} catch (SvmException $e) {
+	echo "got exception\n";
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+ok
+ok
+got exception
@@ -0,0 +1,60 @@
+--TEST--
+Calibrate probability estimates on fewer folds
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+ob_start();
+phpinfo(INFO_MODULES);
+if (!preg_match('/training threads => supported/', ob_get_clean())) die('skip libsvm without training threads');
+?>
+--FILE--
+<?php
+$file = dirname(__FILE__) . '/abalone.scale';
+$data = array(
+	1 => -1,
+	2 => 0.027027,
+	3 => 0.0420168,
+	4 => -0.831858,
+	5 => -0.63733,
+	6 => -0.699395,
+	7 => -0.735352,
+	8 => -0.704036
+);
+
+$svm = new svm();
+$options = $svm->getOptions();
+echo $options[SVM::OPT_PROBABILITY_FOLDS] == 5 ? "ok\n" : "default is not 5 folds\n";
+
+/* The folds and pairs of the calibration are trained side by side */
+$svm->setOptions(array(SVM::OPT_PROBABILITY => true, SVM::OPT_THREADS => 1));
+$serial = $svm->train($file)->saveToString(true);
+$svm->setOptions(array(SVM::OPT_THREADS => 4));
+echo $svm->train($file)->saveToString(true) === $serial ? "ok\n" : "threaded probability model differs\n";
+
+/* A single held out split */
+$svm->setOptions(array(SVM::OPT_PROBABILITY_FOLDS => 1));
+$model = $svm->train($file);
+echo $model->saveToString(true) !== $serial ? "ok\n" : "single split calibrated like 5 folds\n";
+$return = array();
+$model->predict_probability($data, $return);
+echo abs(array_sum($return) - 1) < 1e-6 ? "ok\n" : "probabilities do not sum to 1\n";
+
+$svm->setOptions(array(SVM::OPT_TYPE => SVM::EPSILON_SVR));
+echo $svm->train($file)->getSvrProbability() > 0 ? "ok\n" : "no regression calibration\n";
+
+foreach (array(0, 101) as $folds) {
+	try {
+		$svm->setOptions(array(SVM::OPT_PROBABILITY_FOLDS => $folds));
+	} catch (SvmException $e) {
+		echo "got exception\n";
+	}
+}
+?>
+--EXPECT--
+ok
+ok
+ok
+ok
+ok
+got exception
+got exception
@@ -0,0 +1,43 @@
+--TEST--
+Sparse models with feature indexes up to INT_MAX
+--SKIPIF--
+<?php
+if (!extension_loaded('svm')) die('skip');
+?>
+--INI--
+svm.sparse_index=auto
+--FILE--
+<?php
+/* Hashed features: the index is as large as it gets, so a table by feature index can't be built */
+$data = array();
+$rows = array();
+for ($i = 0; $i < 40; $i++) {
+	$sign = $i % 2 ? 1 : -1;
+	$row = array(1 + $i % 7 => $sign, 2147483647 => 0.5 * $sign);
+	$data[] = array($i % 2) + $row;
+	$rows[] = $row;
+}
+
+$svm = new SVM();
+$svm->setOptions(array(SVM::OPT_GAMMA => 0.5));
+$model = $svm->train($data);
+ini_set('svm.sparse_index', '0');
+$plain = $svm->train($data);
+
+$same = true;
+foreach ($rows as $row) {
+	$label = $plain->predictValues($row, $expected);
+	$same = $same && $model->predictValues($row, $values) == $label && abs($values[0] - $expected[0]) < 1e-9;
+}
+echo $same ? "ok\n" : "predictions differ\n";
+
+$file = tempnam(sys_get_temp_dir(), 'svm');
+$model->save($file);
+ini_set('svm.sparse_index', 'auto');
+$loaded = new SVMModel($file);
+echo $loaded->predictBatch($rows) === $plain->predictBatch($rows) ? "ok\n" : "loaded model differs\n";
+unlink($file);
+?>
+--EXPECT--
+ok
+ok